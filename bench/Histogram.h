@@ -0,0 +1,76 @@
+#ifndef SOCNET_BENCH_HISTOGRAM_H
+#define SOCNET_BENCH_HISTOGRAM_H
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Values below 2048 are counted exactly, larger ones in buckets of 1/1024 of
+// their power of two
+class Histogram {
+public:
+  static constexpr int kSubBits = 10;
+  static constexpr uint64_t kSub = 1ull << kSubBits;
+  static constexpr size_t kSize = (65 - kSubBits) * kSub;
+
+  Histogram() : counts_(kSize, 0) {}
+
+  void record(uint64_t v) {
+    ++counts_[index(v)];
+    ++count_;
+    sum_ += v;
+    min_ = std::min(min_, v);
+    max_ = std::max(max_, v);
+  }
+
+  void merge(const Histogram &other) {
+    for (size_t i = 0; i < kSize; ++i)
+      counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return count_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? (double)sum_ / count_ : 0; }
+
+  // the highest value of the bucket holding the percentile
+  uint64_t percentile(double p) const {
+    if (count_ == 0)
+      return 0;
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p / 100 * count_ + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kSize; ++i) {
+      seen += counts_[i];
+      if (seen >= rank)
+        return std::min(highest(i), max_);
+    }
+    return max_;
+  }
+
+private:
+  static size_t index(uint64_t v) {
+    if (v < 2 * kSub)
+      return v;
+    int shift = 63 - __builtin_clzll(v) - kSubBits;
+    return shift * kSub + (v >> shift);
+  }
+  static uint64_t highest(size_t i) {
+    if (i < 2 * kSub)
+      return i;
+    int shift = i / kSub - 1;
+    return ((i - shift * kSub + 1) << shift) - 1;
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  uint64_t sum_ = 0;
+  uint64_t min_ = UINT64_MAX;
+  uint64_t max_ = 0;
+};
+
+#endif
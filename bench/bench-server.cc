@@ -0,0 +1,74 @@
+// Server of the benchmark scenarios, run by bench/run.sh from a directory
+// holding its config.json and the html directory of static files
+#include "../soc/http/include/HttpServer.h"
+
+using namespace soc::http;
+
+class HelloService : public HttpService {
+public:
+  void doGet(const HttpRequest &req, HttpResponse &resp) override {
+    resp.setContentType("text/plain").setBody("hello world");
+  }
+};
+
+// Reads and updates the session of the client
+class SessionService : public HttpService {
+public:
+  void doGet(const HttpRequest &req, HttpResponse &resp) override {
+    HttpSession *session = req.getSession();
+    const int *value = session->getValue<int>("hits");
+    int hits = (value ? *value : 0) + 1;
+    session->setValue("hits", hits);
+    resp.setContentType("text/plain").setBody(std::to_string(hits));
+  }
+};
+
+// Matched by a regex url-pattern
+class RegexService : public HttpService {
+public:
+  void doGet(const HttpRequest &req, HttpResponse &resp) override {
+    const auto &match = req.getMatchResult();
+    resp.setContentType("text/plain")
+        .setBody(match.size() > 1 ? match[1] : "");
+  }
+};
+
+// Routed by a path parameter
+class ItemService : public HttpService {
+public:
+  void doGet(const HttpRequest &req, HttpResponse &resp) override {
+    resp.setContentType("text/plain")
+        .setBody(req.getPathParam("id").value_or(""));
+  }
+};
+
+// Form and multipart bodies
+class UploadService : public HttpService {
+public:
+  void doPost(const HttpRequest &req, HttpResponse &resp) override {
+    size_t n = req.getPostData().size();
+    if (req.hasMultiPart()) {
+      if (auto file = req.getMultiPart().getFile("file"); file != nullptr)
+        n = file->data.size();
+    }
+    resp.setContentType("text/plain").setBody(std::to_string(n));
+  }
+};
+
+HttpServer server;
+
+void handleSignal(int) { server.quit(); }
+
+int main() {
+  ::signal(SIGINT, handleSignal);
+  ::signal(SIGTERM, handleSignal);
+
+  server.addMountDir("/", "./html");
+  server.addService<HelloService>("/hello");
+  server.addService<SessionService>("/session");
+  server.addService<ItemService>("/item/{id:int}");
+  server.addService<UploadService>("/upload");
+  server.addUrlPatternService<RegexService>("^/user/(\\w+)/profile$");
+  server.start();
+  return 0;
+}
@@ -0,0 +1,129 @@
+#!/bin/bash
+# Checks FastCGI multiplexing end to end
+#
+#   bench/fcgi-mux.sh [-b build_dir] [-n requests]
+#
+# Starts socnet-fcgi-stub -m, which reports FCGI_MPXS_CONNS=1 and interleaves
+# its responses across request IDs, and socnet-bench-server with a pool of one
+# connection, then sends the PHP requests at the same time. Every response must
+# carry its own REQUEST_URI, all of them must share one upstream connection,
+# and the stub must have seen more than one request open on it at once.
+
+set -u
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$ROOT/build
+REQUESTS=16
+PORT=${BENCH_PORT:-18080}
+FCGI_PORT=${BENCH_FCGI_PORT:-19000}
+
+while getopts "b:n:h" opt; do
+  case $opt in
+  b) BUILD=$(cd "$OPTARG" && pwd) ;;
+  n) REQUESTS=$OPTARG ;;
+  *)
+    sed -n '2,9p' "$0"
+    exit 1
+    ;;
+  esac
+done
+
+for bin in socnet-bench-server socnet-fcgi-stub; do
+  if [ ! -x "$BUILD/$bin" ]; then
+    echo "$BUILD/$bin not found, build the bench targets first" >&2
+    exit 1
+  fi
+done
+if ! command -v curl >/dev/null; then
+  echo "curl is needed to send the requests" >&2
+  exit 1
+fi
+
+WORK=$(mktemp -d /tmp/socnet-mux.XXXXXX)
+SERVER_PID=
+STUB_PID=
+cleanup() {
+  [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null && wait "$SERVER_PID" 2>/dev/null
+  [ -n "$STUB_PID" ] && kill "$STUB_PID" 2>/dev/null && wait "$STUB_PID" 2>/dev/null
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+mkdir -p "$WORK/html" "$WORK/pass_store" "$WORK/out"
+: >"$WORK/pass_store/user_password"
+echo '<?php echo $_SERVER["REQUEST_URI"]; ?>' >"$WORK/html/echo.php"
+cat >"$WORK/config.json" <<EOF
+{
+    "server": {
+        "listen_ip": "127.0.0.1",
+        "listen_port": $PORT,
+        "idle_timeout": 10000,
+        "server_hostname": "localhost",
+        "enable_https": false,
+        "enable_php": true,
+        "enable_sendfile": false,
+        "default_page": ["index.html"],
+        "user_pass_file": "./pass_store/user_password",
+        "authenticate_realm": "socnet@bench",
+        "session_lifetime": 60
+    },
+    "php-fpm": {
+        "tcp_or_domain": true,
+        "server_ip": "127.0.0.1",
+        "server_port": $FCGI_PORT,
+        "sock_path": "",
+        "pool_size": 1,
+        "request_timeout": 10000
+    }
+}
+EOF
+
+# the stub holds each batch for 50ms so that the requests pile up on the
+# connection
+"$BUILD/socnet-fcgi-stub" -m "$FCGI_PORT" 50000 >"$WORK/stub.log" 2>&1 &
+STUB_PID=$!
+(cd "$WORK" && exec "$BUILD/socnet-bench-server" >server.log 2>&1) &
+SERVER_PID=$!
+for _ in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/hello" && break
+  sleep 0.1
+done
+
+pids=()
+for i in $(seq 1 "$REQUESTS"); do
+  curl -s -m 10 -o "$WORK/out/$i" -w '%{http_code}' \
+    "http://127.0.0.1:$PORT/echo.php?n=$i" >"$WORK/out/$i.status" &
+  pids+=($!)
+done
+wait "${pids[@]}"
+
+failed=0
+conns=
+max_inflight=0
+for i in $(seq 1 "$REQUESTS"); do
+  status=$(cat "$WORK/out/$i.status")
+  body=$(cat "$WORK/out/$i" 2>/dev/null)
+  if [ "$status" != 200 ] || [[ $body != *" uri=/echo.php?n=$i" ]]; then
+    echo "request $i: status $status, body '$body'" >&2
+    failed=1
+    continue
+  fi
+  conn=$(sed -E 's/^conn=([0-9]+) .*/\1/' <<<"$body")
+  inflight=$(sed -E 's/.* inflight=([0-9]+) .*/\1/' <<<"$body")
+  [[ " $conns " != *" $conn "* ]] && conns="$conns $conn"
+  [ "$inflight" -gt "$max_inflight" ] && max_inflight=$inflight
+done
+
+if [ "$(wc -w <<<"$conns")" -ne 1 ]; then
+  echo "expected one upstream connection, got:$conns" >&2
+  failed=1
+fi
+if [ "$max_inflight" -lt 2 ]; then
+  echo "requests were not multiplexed, at most $max_inflight in flight" >&2
+  failed=1
+fi
+if [ "$failed" -ne 0 ]; then
+  tail -5 "$WORK/server.log" >&2
+  exit 1
+fi
+echo "fcgi-mux: $REQUESTS requests over one connection, up to $max_inflight in flight"
@@ -0,0 +1,292 @@
+// FastCGI responder standing in for php-fpm in the benchmarks
+//
+//   socnet-fcgi-stub [-m] [port] [delay_us]
+//
+// Listens on 127.0.0.1:port (9000) and answers every request with a small
+// text/html page after delay_us microseconds, so the numbers measure the
+// server and not PHP. Each connection is served by its own thread.
+//
+// With -m the stub reports FCGI_MPXS_CONNS=1 and answers the requests that
+// arrived together on a connection together, with their FCGI_STDOUT and
+// FCGI_END_REQUEST records interleaved. The page then reads
+// `conn=<n> id=<request id> inflight=<open requests> uri=<REQUEST_URI>`,
+// which bench/fcgi-mux.sh checks
+#include "../soc/modules/php-fastcgi/include/FastCgi.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <errno.h>
+#include <map>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace soc;
+
+namespace {
+int delay_us = 0;
+bool multiplexed = false;
+std::atomic<int> connections{0};
+
+// with -m, ready requests are answered once this many are ready or no
+// record arrived for kBatchWait milliseconds
+constexpr size_t kBatch = 64;
+constexpr int kBatchWait = 20;
+
+bool readFull(int fd, void *buf, size_t len) {
+  char *p = (char *)buf;
+  while (len > 0) {
+    ssize_t n = ::read(fd, p, len);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool writeFull(int fd, const std::string &data) {
+  const char *p = data.data();
+  size_t len = data.size();
+  while (len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+void appendRecord(std::string &out, int type, int id, const std::string &body) {
+  FCGI_Header h;
+  h.version = FCGI_VERSION_1;
+  h.type = type;
+  h.requestIdB1 = (id >> 8) & 0xff;
+  h.requestIdB0 = id & 0xff;
+  h.contentLengthB1 = (body.size() >> 8) & 0xff;
+  h.contentLengthB0 = body.size() & 0xff;
+  h.paddingLength = 0;
+  h.reserved = 0;
+  out.append((const char *)&h, sizeof(h));
+  out.append(body);
+}
+
+std::string nameValue(const std::string &name, const std::string &value) {
+  return std::string(1, (char)name.size()) + (char)value.size() + name +
+         value;
+}
+
+// One FastCGI name-value length, 1 or 4 bytes
+bool readLength(const std::string &s, size_t &pos, size_t &len) {
+  if (pos >= s.size())
+    return false;
+  unsigned char c = s[pos];
+  if (c < 0x80) {
+    len = c;
+    ++pos;
+    return true;
+  }
+  if (s.size() - pos < 4)
+    return false;
+  const unsigned char *p = (const unsigned char *)s.data() + pos;
+  len = ((p[0] & 0x7f) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  pos += 4;
+  return true;
+}
+
+std::string findParam(const std::string &params, const std::string &name) {
+  size_t pos = 0, nlen, vlen;
+  while (readLength(params, pos, nlen) && readLength(params, pos, vlen) &&
+         params.size() - pos >= nlen + vlen) {
+    if (params.compare(pos, nlen, name) == 0)
+      return params.substr(pos + nlen, vlen);
+    pos += nlen + vlen;
+  }
+  return "";
+}
+
+void serve(int fd) {
+  bool keep = false;
+  while (true) {
+    FCGI_Header h;
+    if (!readFull(fd, &h, sizeof(h)))
+      break;
+    int id = (h.requestIdB1 << 8) | h.requestIdB0;
+    size_t len = (h.contentLengthB1 << 8) | h.contentLengthB0;
+    std::string body(len + h.paddingLength, '\0');
+    if (!body.empty() && !readFull(fd, body.data(), body.size()))
+      break;
+
+    std::string out;
+    if (h.type == FCGI_GET_VALUES) {
+      std::string values = nameValue(FCGI_MAX_CONNS, "64") +
+                           nameValue(FCGI_MAX_REQS, "64") +
+                           nameValue(FCGI_MPXS_CONNS, multiplexed ? "1" : "0");
+      appendRecord(out, FCGI_GET_VALUES_RESULT, 0, values);
+      writeFull(fd, out);
+      break;
+    }
+    if (h.type == FCGI_BEGIN_REQUEST && len >= sizeof(FCGI_BeginRequestBody)) {
+      keep = ((const FCGI_BeginRequestBody *)body.data())->flags &
+             FCGI_KEEP_CONN;
+      continue;
+    }
+    // the response starts once the request body has ended
+    if (h.type != FCGI_STDIN || len != 0)
+      continue;
+
+    if (delay_us > 0)
+      ::usleep(delay_us);
+    appendRecord(out, FCGI_STDOUT, id,
+                 "Content-type: text/html\r\n\r\nhello from fastcgi");
+    appendRecord(out, FCGI_STDOUT, id, "");
+    appendRecord(out, FCGI_END_REQUEST, id, std::string(8, '\0'));
+    if (!writeFull(fd, out) || !keep)
+      break;
+  }
+  ::close(fd);
+}
+
+struct Request {
+  std::string params;
+  std::string uri;
+};
+
+void endRequest(std::string &out, int id) {
+  FCGI_EndRequestBody end = {};
+  end.protocolStatus = FCGI_REQUEST_COMPLETE;
+  appendRecord(out, FCGI_END_REQUEST, id,
+               std::string((const char *)&end, sizeof(end)));
+}
+
+// Answers the ready requests in one write: the headers in reverse order, the
+// bodies in order, then the ends in reverse order again, so that the client
+// has to tell the records apart by request ID
+bool respond(int fd, int conn, std::map<int, Request> &requests,
+             const std::vector<int> &ready) {
+  if (delay_us > 0)
+    ::usleep(delay_us);
+  size_t inflight = requests.size();
+  std::string out;
+  for (auto it = ready.rbegin(); it != ready.rend(); ++it)
+    appendRecord(out, FCGI_STDOUT, *it, "Content-type: text/plain\r\n\r\n");
+  for (int id : ready) {
+    appendRecord(out, FCGI_STDOUT, id,
+                 "conn=" + std::to_string(conn) + " id=" + std::to_string(id) +
+                     " inflight=" + std::to_string(inflight) +
+                     " uri=" + requests[id].uri + "\n");
+  }
+  for (auto it = ready.rbegin(); it != ready.rend(); ++it) {
+    appendRecord(out, FCGI_STDOUT, *it, "");
+    endRequest(out, *it);
+    requests.erase(*it);
+  }
+  return writeFull(fd, out);
+}
+
+void serveMultiplexed(int fd) {
+  int conn = ++connections;
+  std::map<int, Request> requests;
+  std::vector<int> ready;
+  bool keep = false;
+  while (true) {
+    if (!ready.empty()) {
+      struct pollfd pfd = {fd, POLLIN, 0};
+      if (ready.size() >= kBatch || ::poll(&pfd, 1, kBatchWait) == 0) {
+        if (!respond(fd, conn, requests, ready))
+          break;
+        ready.clear();
+        if (!keep)
+          break;
+        continue;
+      }
+    }
+
+    FCGI_Header h;
+    if (!readFull(fd, &h, sizeof(h)))
+      break;
+    int id = (h.requestIdB1 << 8) | h.requestIdB0;
+    size_t len = (h.contentLengthB1 << 8) | h.contentLengthB0;
+    std::string body(len + h.paddingLength, '\0');
+    if (!body.empty() && !readFull(fd, body.data(), body.size()))
+      break;
+    body.resize(len);
+
+    std::string out;
+    switch (h.type) {
+    case FCGI_GET_VALUES:
+      appendRecord(out, FCGI_GET_VALUES_RESULT, 0,
+                   nameValue(FCGI_MAX_CONNS, "64") +
+                       nameValue(FCGI_MAX_REQS, "64") +
+                       nameValue(FCGI_MPXS_CONNS, "1"));
+      writeFull(fd, out);
+      ::close(fd);
+      return;
+    case FCGI_BEGIN_REQUEST:
+      if (len >= sizeof(FCGI_BeginRequestBody))
+        keep = ((const FCGI_BeginRequestBody *)body.data())->flags &
+               FCGI_KEEP_CONN;
+      requests[id] = Request();
+      break;
+    case FCGI_PARAMS:
+      if (len > 0)
+        requests[id].params += body;
+      else
+        requests[id].uri = findParam(requests[id].params, "REQUEST_URI");
+      break;
+    case FCGI_STDIN:
+      if (len == 0 && requests.count(id))
+        ready.push_back(id);
+      break;
+    case FCGI_ABORT_REQUEST:
+      if (requests.erase(id)) {
+        std::erase(ready, id);
+        endRequest(out, id);
+        writeFull(fd, out);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  ::close(fd);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && ::strcmp(argv[1], "-m") == 0) {
+    multiplexed = true;
+    --argc;
+    ++argv;
+  }
+  int port = argc > 1 ? ::atoi(argv[1]) : 9000;
+  delay_us = argc > 2 ? ::atoi(argv[2]) : 0;
+  ::signal(SIGPIPE, SIG_IGN);
+
+  int lfd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int one = 1;
+  ::setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::bind(lfd, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      ::listen(lfd, 128) < 0) {
+    fprintf(stderr, "listen on port %d: %s\n", port, ::strerror(errno));
+    return 1;
+  }
+  while (true) {
+    int fd = ::accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0)
+      continue;
+    std::thread(multiplexed ? serveMultiplexed : serve, fd).detach();
+  }
+}
@@ -0,0 +1,418 @@
+// Microbenchmarks of the parsers and codecs on the request path
+//
+//   socnet-microbench [-t seconds] [-C corpus_dir] [-j] [-l] [filter...]
+//
+// Every benchmark runs for at least -t seconds (0.5) and reports ns/op and the
+// input bytes processed per second. Only benchmarks whose name contains one of
+// the filters are run, -l lists the names and -j prints the results as a JSON
+// array. Inputs come from bench/corpus, the request files are stored with LF
+// line endings and sent to the parser with CRLF
+#include "../soc/http/include/HttpRequest.h"
+#include "../soc/libjson/include/JsonDocument.h"
+#include "../soc/libjson/include/JsonFormatter.h"
+#include "../soc/libjson/include/JsonParser.h"
+#include "../soc/libjson/include/JsonSaxParser.h"
+#include "../soc/net/include/TcpConnection.h"
+#include "../soc/net/include/TimerHeap.h"
+#include "../soc/utility/include/EncodeUtil.h"
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#ifndef SOCNET_CORPUS_DIR
+#define SOCNET_CORPUS_DIR "bench/corpus"
+#endif
+
+using namespace soc;
+using namespace soc::net;
+using namespace soc::http;
+
+namespace {
+struct Options {
+  double min_time = 0.5;
+  std::string corpus = SOCNET_CORPUS_DIR;
+  bool json = false;
+  bool list = false;
+  std::vector<std::string> filters;
+} options;
+
+struct Result {
+  std::string name;
+  double ns_per_op;
+  double bytes_per_sec;
+  uint64_t ops;
+};
+std::vector<Result> results;
+
+// keeps the compiler from dropping a result nobody reads
+template <class T> inline void keep(T &v) {
+  asm volatile("" : : "r"(&v) : "memory");
+}
+
+bool selected(const std::string &name) {
+  if (options.filters.empty())
+    return true;
+  for (const auto &filter : options.filters) {
+    if (name.find(filter) != std::string::npos)
+      return true;
+  }
+  return false;
+}
+
+// Calls fn until min_time has passed, each call does ops operations over
+// bytes bytes of input
+void run(const std::string &name, size_t bytes, size_t ops,
+         const std::function<void()> &fn) {
+  if (options.list) {
+    printf("%s\n", name.c_str());
+    return;
+  }
+  if (!selected(name))
+    return;
+
+  using Clock = std::chrono::steady_clock;
+  fn();
+  uint64_t iters = 1;
+  double elapsed = 0;
+  while (true) {
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < iters; ++i)
+      fn();
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    if (elapsed >= options.min_time)
+      break;
+    // aim a little past min_time, but never more than 100x at once
+    double scale = elapsed > 0 ? options.min_time * 1.2 / elapsed : 100;
+    iters = std::max<uint64_t>(iters + 1, iters * std::min(scale, 100.0));
+  }
+
+  Result r{name, elapsed * 1e9 / (iters * ops),
+           bytes ? bytes * iters / elapsed : 0, iters * ops};
+  results.push_back(r);
+  if (!options.json) {
+    if (bytes)
+      printf("%-32s %12.1f ns/op %10.2f MB/s\n", name.c_str(), r.ns_per_op,
+             r.bytes_per_sec / (1024 * 1024));
+    else
+      printf("%-32s %12.1f ns/op\n", name.c_str(), r.ns_per_op);
+    fflush(stdout);
+  }
+}
+
+std::string readCorpus(const char *file) {
+  std::string path = options.corpus + "/" + file;
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs) {
+    fprintf(stderr, "cannot read %s, see -C\n", path.c_str());
+    exit(1);
+  }
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  return ss.str();
+}
+
+// The header lines get CRLF, the body loses the newline ending the file
+std::string readRequest(const char *file) {
+  std::string text = readCorpus(file);
+  size_t end = text.find("\n\n");
+  std::string header = text.substr(0, end == std::string::npos ? text.size()
+                                                               : end + 2);
+  std::string body = end == std::string::npos ? "" : text.substr(end + 2);
+  if (!body.empty() && body.back() == '\n')
+    body.pop_back();
+
+  std::string out;
+  for (char c : header) {
+    if (c == '\n')
+      out += '\r';
+    out += c;
+  }
+  return out + body;
+}
+
+std::string randomBytes(size_t n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::string s(n, '\0');
+  for (auto &c : s)
+    c = (char)gen();
+  return s;
+}
+
+std::string multipartBody(const std::string &boundary, size_t file_size) {
+  std::string body;
+  auto field = [&](const std::string &name, const std::string &value) {
+    body += "--" + boundary + "\r\n";
+    body += "Content-Disposition: form-data; name=\"" + name + "\"\r\n\r\n";
+    body += value + "\r\n";
+  };
+  field("name", "alice");
+  field("comment", std::string(512, 'x'));
+  body += "--" + boundary + "\r\n";
+  body += "Content-Disposition: form-data; name=\"file\"; "
+          "filename=\"upload.bin\"\r\n";
+  body += "Content-Type: application/octet-stream\r\n\r\n";
+  body += randomBytes(file_size, 1) + "\r\n";
+  body += "--" + boundary + "--\r\n";
+  return body;
+}
+
+void benchRequest() {
+  static const char *files[][2] = {{"request/minimal", "request-minimal.txt"},
+                                   {"request/browser", "request-browser.txt"},
+                                   {"request/api-post", "request-api.txt"}};
+  TcpConnection conn;
+  conn.initialize(-1);
+  conn.setChannel(new RawChannel(-1, false));
+  Buffer *recver = conn.getRecver();
+
+  for (auto &file : files) {
+    std::string data = readRequest(file[1]);
+    recver->append(data);
+    {
+      HttpRequest req(&conn, nullptr);
+      if (req.parseRequest() != HttpRequest::REQUEST_CONTENT_DONE) {
+        fprintf(stderr, "%s: not a complete request\n", file[1]);
+        exit(1);
+      }
+    }
+    // the server keeps one HttpRequest per connection, a fresh one per call
+    // includes its construction, as for the first request of a connection
+    run(file[0], data.size(), 1, [&] {
+      recver->append(data);
+      HttpRequest req(&conn, nullptr);
+      auto code = req.parseRequest();
+      keep(code);
+    });
+  }
+}
+
+void benchHeader() {
+  std::string data = readRequest("request-browser.txt");
+  // without the request line
+  data = data.substr(data.find("\r\n") + 2);
+  run("header/parse", data.size(), 1, [&] {
+    HttpHeader header;
+    int n = header.parse(data);
+    keep(n);
+  });
+}
+
+void benchMultiPart() {
+  const std::string boundary = "----socnetMicroBoundary7MA4YWxkTrZu0gW";
+  for (size_t size : {16 * 1024, 1024 * 1024}) {
+    std::string body = multipartBody(boundary, size);
+    std::string name =
+        "multipart/" + std::to_string(size / 1024) + "k";
+    run(name, body.size(), 1, [&] {
+      HttpMultiPart multipart;
+      multipart.setBoundary(boundary);
+      multipart.parse(body);
+      keep(multipart);
+    });
+  }
+}
+
+void benchJson() {
+  std::string small = readCorpus("small.json");
+  std::string medium = readCorpus("medium.json");
+  // 64 copies of medium.json in an array, about 1MB
+  std::string large = "[";
+  for (int i = 0; i < 64; ++i)
+    large += (i ? "," : "") + medium;
+  large += "]";
+
+  for (auto [name, doc] : {std::make_pair("small", &small),
+                           std::make_pair("medium", &medium),
+                           std::make_pair("large", &large)}) {
+    run(std::string("json/parse-") + name, doc->size(), 1, [&] {
+      libjson::JsonParser parser(*doc);
+      auto value = parser.parse();
+      keep(value);
+    });
+  }
+  for (auto [name, doc] : {std::make_pair("small", &small),
+                           std::make_pair("medium", &medium),
+                           std::make_pair("large", &large)}) {
+    run(std::string("json/document-") + name, doc->size(), 1, [&] {
+      libjson::JsonDocument document;
+      const libjson::JsonNode *root = document.parseInPlace(*doc);
+      keep(root);
+    });
+  }
+  // fed in 16KB pieces, as a request body arrives
+  for (auto [name, doc] : {std::make_pair("medium", &medium),
+                           std::make_pair("large", &large)}) {
+    run(std::string("json/sax-") + name, doc->size(), 1, [&] {
+      libjson::JsonSaxHandler handler;
+      libjson::JsonSaxParser parser(&handler);
+      for (size_t i = 0; i < doc->size(); i += 16 * 1024)
+        parser.feed(doc->data() + i, std::min<size_t>(16 * 1024,
+                                                       doc->size() - i));
+      parser.finish();
+      keep(parser);
+    });
+  }
+
+  for (auto [name, doc] : {std::make_pair("medium", &medium),
+                           std::make_pair("large", &large)}) {
+    libjson::JsonParser parser(*doc);
+    auto [object, array, value] = parser.parse();
+    for (int indent : {4, 0}) {
+      libjson::JsonFormatter formatter(indent);
+      if (object)
+        formatter.set_source(object.get());
+      else
+        formatter.set_source(array.get());
+      size_t out = formatter.format().size();
+      run(std::string("json/format-") + name + (indent ? "" : "-compact"),
+          out, 1, [&] {
+            std::string s = formatter.format();
+            keep(s);
+          });
+    }
+  }
+}
+
+void benchEncode() {
+  std::string query = readCorpus("query.txt");
+  std::string decoded = EncodeUtil::urlDecode(query);
+  run("url/decode", query.size(), 1, [&] {
+    std::string s = EncodeUtil::urlDecode(query);
+    keep(s);
+  });
+  run("url/encode", decoded.size(), 1, [&] {
+    std::string s = EncodeUtil::urlEncode(decoded);
+    keep(s);
+  });
+
+  std::string text = readCorpus("medium.json");
+  std::string binary = randomBytes(64 * 1024, 2);
+  run("gzip/text-15k", text.size(), 1, [&] {
+    std::vector<uint8_t> out;
+    EncodeUtil::gzipCompress(text, out);
+    keep(out);
+  });
+  run("gzip/random-64k", binary.size(), 1, [&] {
+    std::vector<uint8_t> out;
+    EncodeUtil::gzipCompress(binary, out);
+    keep(out);
+  });
+
+  std::string nonce = randomBytes(64, 3);
+  run("md5/64", nonce.size(), 1, [&] {
+    std::string s = EncodeUtil::md5Hash(nonce);
+    keep(s);
+  });
+  run("md5/64k", binary.size(), 1, [&] {
+    std::string s = EncodeUtil::md5Hash(binary);
+    keep(s);
+  });
+
+  std::string encoded = EncodeUtil::base64Encode(binary);
+  run("base64/encode-64k", binary.size(), 1, [&] {
+    std::string s = EncodeUtil::base64Encode(binary);
+    keep(s);
+  });
+  run("base64/decode-64k", encoded.size(), 1, [&] {
+    std::string s = EncodeUtil::base64Decode(encoded);
+    keep(s);
+  });
+}
+
+void benchTimerHeap() {
+  // as many timers as idle connections of a busy server
+  constexpr int kTimers = 4096;
+  std::mt19937 gen(4);
+  std::vector<uint64_t> expiry(kTimers);
+  for (auto &us : expiry)
+    us = gen() % 10000000;
+  TimeoutCallback cb = [] {};
+
+  run("timerheap/push", 0, kTimers, [&] {
+    TimerHeap heap;
+    for (int fd = 0; fd < kTimers; ++fd)
+      heap.push(Timer(fd, TimeStamp(expiry[fd]), cb));
+    keep(heap);
+  });
+
+  TimerHeap heap;
+  for (int fd = 0; fd < kTimers; ++fd)
+    heap.push(Timer(fd, TimeStamp(expiry[fd]), cb));
+  uint64_t now = 10000000;
+  int fd = 0;
+  // a request on a kept-alive connection moves its timer to the back
+  run("timerheap/adjust", 0, 1, [&] {
+    heap.adjust(Timer(fd, TimeStamp(++now), cb));
+    fd = (fd + 97) % kTimers;
+  });
+  // the earliest timer expires and its connection gets a new one
+  run("timerheap/pop-push", 0, 1, [&] {
+    int expired = heap.top().fd;
+    heap.pop();
+    heap.push(Timer(expired, TimeStamp(++now), cb));
+  });
+}
+
+void printJson() {
+  printf("[\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result &r = results[i];
+    printf("  {\"name\":\"%s\",\"ns_per_op\":%.2f,\"bytes_per_sec\":%.0f,"
+           "\"ops\":%llu}%s\n",
+           r.name.c_str(), r.ns_per_op, r.bytes_per_sec,
+           (unsigned long long)r.ops, i + 1 < results.size() ? "," : "");
+  }
+  printf("]\n");
+}
+
+void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [-t seconds] [-C corpus_dir] [-j] [-l] [filter...]\n",
+          prog);
+  exit(1);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int opt;
+  while ((opt = ::getopt(argc, argv, "t:C:jlh")) != -1) {
+    switch (opt) {
+    case 't':
+      options.min_time = ::atof(optarg);
+      break;
+    case 'C':
+      options.corpus = optarg;
+      break;
+    case 'j':
+      options.json = true;
+      break;
+    case 'l':
+      options.list = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  for (int i = optind; i < argc; ++i)
+    options.filters.emplace_back(argv[i]);
+  if (options.min_time <= 0)
+    usage(argv[0]);
+
+  benchRequest();
+  benchHeader();
+  benchMultiPart();
+  benchJson();
+  benchEncode();
+  benchTimerHeap();
+
+  if (options.json && !options.list)
+    printJson();
+  return 0;
+}
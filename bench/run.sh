@@ -0,0 +1,204 @@
+#!/bin/bash
+# End-to-end benchmark scenarios over loopback
+#
+#   bench/run.sh [-b build_dir] [-d seconds] [-o results.json] [-B baseline.json]
+#                [scenario...]
+#
+# Starts socnet-bench-server in a scratch directory with generated static
+# files, socnet-fcgi-stub in place of php-fpm, and runs socnet-bench for every
+# scenario (all of them by default). The results are written as a JSON array,
+# and compared against a baseline file from an earlier run when one is given.
+
+set -u
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BUILD=$ROOT/build
+DURATION=5
+OUTPUT=bench-results.json
+BASELINE=
+PORT=${BENCH_PORT:-18080}
+FCGI_PORT=${BENCH_FCGI_PORT:-19000}
+THREADS=${BENCH_THREADS:-2}
+
+while getopts "b:d:o:B:h" opt; do
+  case $opt in
+  b) BUILD=$(cd "$OPTARG" && pwd) ;;
+  d) DURATION=$OPTARG ;;
+  o) OUTPUT=$OPTARG ;;
+  B) BASELINE=$OPTARG ;;
+  *)
+    sed -n '2,10p' "$0"
+    exit 1
+    ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+for bin in socnet-bench socnet-bench-server socnet-fcgi-stub; do
+  if [ ! -x "$BUILD/$bin" ]; then
+    echo "$BUILD/$bin not found, build the bench targets first" >&2
+    exit 1
+  fi
+done
+
+# name|client options|path, https scenarios need the server restarted
+SCENARIOS=(
+  "hello|-c 64|/hello"
+  "hello-pipeline|-c 16 -p 16|/hello"
+  "hello-close|-c 16 -K|/hello"
+  "static-small|-c 64|/small.html"
+  "static-large|-c 16|/large.bin"
+  "gzip|-c 32 -z|/medium.html"
+  "session|-c 64 -C|/session"
+  "regex-route|-c 64|/user/alice/profile"
+  "param-route|-c 64|/item/42"
+  "post-form|-c 64 -D name=bench&age=1|/upload"
+  "post-multipart|-c 32 -F name=bench -F file=@html/small.html|/upload"
+  "fastcgi|-c 32|/hello.php"
+  "https-hello|-c 64|https:/hello"
+)
+
+WORK=$(mktemp -d /tmp/socnet-bench.XXXXXX)
+SERVER_PID=
+STUB_PID=
+cleanup() {
+  [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null && wait "$SERVER_PID" 2>/dev/null
+  [ -n "$STUB_PID" ] && kill "$STUB_PID" 2>/dev/null && wait "$STUB_PID" 2>/dev/null
+  rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+# static files: 1KB and 64KB of text, 8MB of binary
+mkdir -p "$WORK/html" "$WORK/pass_store" "$WORK/ssl"
+: >"$WORK/pass_store/user_password"
+head -c 768 /dev/urandom | base64 -w 76 >"$WORK/html/small.html"
+for i in $(seq 1 1024); do
+  echo "<p>line $i of the medium page, repeated text compresses well</p>"
+done | head -c 65536 >"$WORK/html/medium.html"
+head -c $((8 * 1024 * 1024)) /dev/urandom >"$WORK/html/large.bin"
+echo '<?php echo "hello"; ?>' >"$WORK/html/hello.php"
+
+if [ -f "$ROOT/build/ssl/cert.crt" ] && [ -f "$ROOT/build/ssl/private.pem" ]; then
+  cp "$ROOT/build/ssl/cert.crt" "$ROOT/build/ssl/private.pem" "$WORK/ssl/"
+elif command -v openssl >/dev/null; then
+  openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=localhost \
+    -keyout "$WORK/ssl/private.pem" -out "$WORK/ssl/cert.crt" 2>/dev/null
+fi
+
+writeConfig() {
+  cat >"$WORK/config.json" <<EOF
+{
+    "server": {
+        "listen_ip": "127.0.0.1",
+        "listen_port": $PORT,
+        "idle_timeout": 10000,
+        "server_hostname": "localhost",
+        "enable_https": $1,
+        "enable_php": true,
+        "enable_sendfile": false,
+        "default_page": ["index.html"],
+        "user_pass_file": "./pass_store/user_password",
+        "authenticate_realm": "socnet@bench",
+        "session_lifetime": 60
+    },
+    "https": {
+        "cert_file": "./ssl/cert.crt",
+        "private_key_file": "./ssl/private.pem",
+        "password": ""
+    },
+    "php-fpm": {
+        "tcp_or_domain": true,
+        "server_ip": "127.0.0.1",
+        "server_port": $FCGI_PORT,
+        "sock_path": "",
+        "pool_size": 16,
+        "request_timeout": 30000
+    }
+}
+EOF
+}
+
+startServer() {
+  local scheme=$1
+  if [ -n "$SERVER_PID" ]; then
+    kill "$SERVER_PID" 2>/dev/null
+    wait "$SERVER_PID" 2>/dev/null
+  fi
+  writeConfig $([ "$scheme" = https ] && echo true || echo false)
+  (cd "$WORK" && exec "$BUILD/socnet-bench-server" >>server.log 2>&1) &
+  SERVER_PID=$!
+  for _ in $(seq 1 50); do
+    if "$BUILD/socnet-bench" -t 1 -c 1 -n 1 -d 1 \
+      "$scheme://127.0.0.1:$PORT/hello" >/dev/null 2>&1; then
+      SERVER_SCHEME=$scheme
+      return 0
+    fi
+    sleep 0.1
+  done
+  echo "server did not start, see $WORK/server.log" >&2
+  tail -5 "$WORK/server.log" >&2
+  return 1
+}
+
+"$BUILD/socnet-fcgi-stub" "$FCGI_PORT" >"$WORK/stub.log" 2>&1 &
+STUB_PID=$!
+
+SERVER_SCHEME=
+RESULTS=()
+for scenario in "${SCENARIOS[@]}"; do
+  IFS='|' read -r name args path <<<"$scenario"
+  if [ $# -gt 0 ] && [[ " $* " != *" $name "* ]]; then
+    continue
+  fi
+  scheme=http
+  if [[ $path == https:* ]]; then
+    scheme=https
+    path=${path#https:}
+  fi
+  if [ "$SERVER_SCHEME" != "$scheme" ]; then
+    startServer "$scheme" || exit 1
+  fi
+
+  # word splitting of args is intended, -D keeps its value in one word
+  result=$(cd "$WORK" && "$BUILD/socnet-bench" -j -s "$name" -t "$THREADS" \
+    -d "$DURATION" $args "$scheme://127.0.0.1:$PORT$path")
+  if [ -z "$result" ]; then
+    echo "$name: failed" >&2
+    continue
+  fi
+  RESULTS+=("$result")
+  echo "$result" | sed -E 's/.*"scenario":"([^"]*)".*"rps":([0-9.]+).*"p50":([0-9.]+).*"p99":([0-9.]+),.*/\1: \2 req\/s, p50 \3us, p99 \4us/'
+done
+
+{
+  echo "["
+  for i in "${!RESULTS[@]}"; do
+    sep=,
+    [ "$i" -eq $((${#RESULTS[@]} - 1)) ] && sep=
+    echo "  ${RESULTS[$i]}$sep"
+  done
+  echo "]"
+} >"$OUTPUT"
+echo "results: $OUTPUT"
+
+if [ -n "$BASELINE" ]; then
+  if ! command -v python3 >/dev/null; then
+    echo "python3 is needed to compare with $BASELINE" >&2
+    exit 0
+  fi
+  python3 - "$BASELINE" "$OUTPUT" <<'EOF'
+import json, sys
+
+base = {r["scenario"]: r for r in json.load(open(sys.argv[1]))}
+print("%-16s %12s %8s %12s %8s" % ("scenario", "req/s", "diff", "p99 us", "diff"))
+for r in json.load(open(sys.argv[2])):
+    b = base.get(r["scenario"])
+    if b is None:
+        continue
+    rps, brps = r["rps"], b["rps"]
+    p99, bp99 = r["latency_us"]["p99"], b["latency_us"]["p99"]
+    print("%-16s %12.1f %+7.1f%% %12.1f %+7.1f%%" % (
+        r["scenario"], rps, (rps / brps - 1) * 100 if brps else 0,
+        p99, (p99 / bp99 - 1) * 100 if bp99 else 0))
+EOF
+fi
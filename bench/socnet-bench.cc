@@ -0,0 +1,810 @@
+// HTTP load generator
+//
+//   socnet-bench [options] http[s]://host:port/path
+//
+// Every thread drives its share of the connections from its own epoll loop.
+// Requests are pipelined up to the given depth on each connection, closed
+// connections are reopened, and latencies go into a log-linear histogram
+// with 0.1% resolution, as HdrHistogram does. The summary is printed as text
+// or with -j as one JSON object, which bench/run.sh collects
+#include "Histogram.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+uint64_t nowNanos() {
+  timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct Options {
+  bool https = false;
+  std::string host;
+  int port = 80;
+  std::string path = "/";
+  int threads = 2;
+  int connections = 10;
+  double duration = 10;
+  uint64_t requests = 0;
+  int pipeline = 1;
+  bool keepalive = true;
+  bool gzip = false;
+  bool cookies = false;
+  bool json = false;
+  std::string method;
+  std::string scenario;
+  std::string content_type = "application/x-www-form-urlencoded";
+  std::string body;
+  std::vector<std::string> headers;
+  std::vector<std::string> fields;
+};
+
+struct Stats {
+  Histogram latency;
+  uint64_t responses = 0;
+  uint64_t bytes = 0;
+  uint64_t status[6] = {};
+  uint64_t connect_errors = 0;
+  uint64_t io_errors = 0;
+  uint64_t parse_errors = 0;
+  uint64_t reconnects = 0;
+};
+
+// A response is read through these states
+enum class ReadState { Head, Body, ChunkSize, ChunkData, Trailer, UntilClose };
+
+struct Connection {
+  int fd = -1;
+  SSL *ssl = nullptr;
+  bool connecting = false;
+  bool handshaking = false;
+  std::string out;
+  size_t out_pos = 0;
+  std::string in;
+  // send times of the requests waiting for their responses
+  std::deque<uint64_t> sent;
+  ReadState state = ReadState::Head;
+  size_t remaining = 0;
+  bool close_after = false;
+  int status = 0;
+  // with -C, the cookies set on the connection and their Cookie header
+  std::vector<std::pair<std::string, std::string>> cookies;
+  std::string cookie;
+};
+
+class Worker {
+public:
+  Worker(const Options &options, const sockaddr_in &addr, SSL_CTX *ctx,
+         const std::string &prefix, const std::string &suffix, int conns,
+         std::atomic<uint64_t> &budget, uint64_t deadline)
+      : options_(options), addr_(addr), ctx_(ctx), prefix_(prefix),
+        suffix_(suffix), conns_(conns), budget_(budget), deadline_(deadline) {}
+
+  void run();
+  const Stats &stats() const { return stats_; }
+
+private:
+  bool open(Connection &conn);
+  void close(Connection &conn);
+  void reopen(Connection &conn);
+  bool handshake(Connection &conn);
+  void fill(Connection &conn);
+  bool flush(Connection &conn);
+  bool receive(Connection &conn);
+  bool parse(Connection &conn);
+  void setCookie(Connection &conn, std::string_view pair);
+  void complete(Connection &conn);
+  // take a request from the -n budget
+  bool takeRequest();
+
+  const Options &options_;
+  sockaddr_in addr_;
+  SSL_CTX *ctx_;
+  const std::string &prefix_;
+  const std::string &suffix_;
+  int conns_;
+  std::atomic<uint64_t> &budget_;
+  uint64_t deadline_;
+  int epfd_ = -1;
+  std::vector<Connection> connections_;
+  Stats stats_;
+};
+
+bool Worker::takeRequest() {
+  if (nowNanos() >= deadline_)
+    return false;
+  if (options_.requests == 0)
+    return true;
+  uint64_t n = budget_.load(std::memory_order_relaxed);
+  while (n > 0) {
+    if (budget_.compare_exchange_weak(n, n - 1, std::memory_order_relaxed))
+      return true;
+  }
+  return false;
+}
+
+bool Worker::open(Connection &conn) {
+  conn = Connection{};
+  conn.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (conn.fd < 0) {
+    ++stats_.connect_errors;
+    return false;
+  }
+  int one = 1;
+  ::setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (::connect(conn.fd, (const sockaddr *)&addr_, sizeof(addr_)) < 0 &&
+      errno != EINPROGRESS) {
+    ++stats_.connect_errors;
+    ::close(conn.fd);
+    conn.fd = -1;
+    return false;
+  }
+  conn.connecting = true;
+  epoll_event ev;
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+  ev.data.ptr = &conn;
+  ::epoll_ctl(epfd_, EPOLL_CTL_ADD, conn.fd, &ev);
+  fill(conn);
+  return true;
+}
+
+void Worker::close(Connection &conn) {
+  if (conn.fd < 0)
+    return;
+  if (conn.ssl) {
+    SSL_free(conn.ssl);
+    conn.ssl = nullptr;
+  }
+  ::epoll_ctl(epfd_, EPOLL_CTL_DEL, conn.fd, nullptr);
+  ::close(conn.fd);
+  conn.fd = -1;
+}
+
+void Worker::reopen(Connection &conn) {
+  // requests without responses are lost with the connection
+  stats_.io_errors += conn.sent.size();
+  close(conn);
+  if (nowNanos() < deadline_ &&
+      (options_.requests == 0 || budget_.load(std::memory_order_relaxed))) {
+    ++stats_.reconnects;
+    open(conn);
+  }
+}
+
+bool Worker::handshake(Connection &conn) {
+  if (conn.connecting) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    ::getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err == EINPROGRESS)
+      return true;
+    if (err != 0) {
+      ++stats_.connect_errors;
+      return false;
+    }
+    conn.connecting = false;
+    if (ctx_) {
+      conn.ssl = SSL_new(ctx_);
+      SSL_set_fd(conn.ssl, conn.fd);
+      SSL_set_tlsext_host_name(conn.ssl, options_.host.c_str());
+      conn.handshaking = true;
+    }
+  }
+  if (conn.handshaking) {
+    int r = SSL_connect(conn.ssl);
+    if (r == 1) {
+      conn.handshaking = false;
+    } else {
+      int err = SSL_get_error(conn.ssl, r);
+      if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+        return true;
+      ++stats_.connect_errors;
+      return false;
+    }
+  }
+  return true;
+}
+
+void Worker::fill(Connection &conn) {
+  // a connection that will be closed after the current response takes no
+  // more requests
+  while ((int)conn.sent.size() < options_.pipeline && !conn.close_after &&
+         (options_.keepalive || conn.sent.empty()) && takeRequest()) {
+    conn.out.append(prefix_);
+    if (!conn.cookie.empty())
+      conn.out.append("Cookie: " + conn.cookie + "\r\n");
+    conn.out.append(suffix_);
+    conn.sent.push_back(nowNanos());
+  }
+}
+
+bool Worker::flush(Connection &conn) {
+  while (conn.out_pos < conn.out.size()) {
+    const char *p = conn.out.data() + conn.out_pos;
+    size_t len = conn.out.size() - conn.out_pos;
+    ssize_t n;
+    if (conn.ssl) {
+      n = SSL_write(conn.ssl, p, len);
+      if (n <= 0) {
+        int err = SSL_get_error(conn.ssl, n);
+        if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ)
+          return true;
+        return false;
+      }
+    } else {
+      n = ::send(conn.fd, p, len, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return errno == EAGAIN;
+      }
+    }
+    conn.out_pos += n;
+  }
+  conn.out.clear();
+  conn.out_pos = 0;
+  return true;
+}
+
+// Returns false once the connection is closed or failed
+bool Worker::receive(Connection &conn) {
+  char buf[65536];
+  while (true) {
+    ssize_t n;
+    if (conn.ssl) {
+      n = SSL_read(conn.ssl, buf, sizeof(buf));
+      if (n <= 0) {
+        int err = SSL_get_error(conn.ssl, n);
+        if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+          return true;
+        n = 0;
+      }
+    } else {
+      n = ::recv(conn.fd, buf, sizeof(buf), 0);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN)
+          return true;
+        return false;
+      }
+    }
+    if (n == 0) {
+      // the body of a response without a length ends here
+      if (conn.state == ReadState::UntilClose && !conn.sent.empty())
+        complete(conn);
+      return false;
+    }
+    stats_.bytes += n;
+    conn.in.append(buf, n);
+    if (!parse(conn)) {
+      ++stats_.parse_errors;
+      return false;
+    }
+  }
+}
+
+bool Worker::parse(Connection &conn) {
+  size_t pos = 0;
+  std::string &in = conn.in;
+  while (true) {
+    switch (conn.state) {
+    case ReadState::Head: {
+      size_t end = in.find("\r\n\r\n", pos);
+      if (end == std::string::npos)
+        goto done;
+      if (conn.sent.empty())
+        return false;
+      std::string_view head(in.data() + pos, end - pos);
+      pos = end + 4;
+      if (head.size() < 12 || head.substr(0, 5) != "HTTP/")
+        return false;
+      conn.status = ::atoi(std::string(head.substr(9, 3)).c_str());
+      bool has_length = false, chunked = false;
+      conn.remaining = 0;
+      conn.close_after = head.substr(5, 3) == "1.0";
+      size_t line = head.find("\r\n");
+      while (line != std::string_view::npos) {
+        size_t next = head.find("\r\n", line + 2);
+        std::string_view h = head.substr(
+            line + 2, next == std::string_view::npos ? std::string_view::npos
+                                                     : next - line - 2);
+        line = next;
+        size_t colon = h.find(':');
+        if (colon == std::string_view::npos)
+          continue;
+        std::string_view name = h.substr(0, colon);
+        std::string_view value = h.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ')
+          value.remove_prefix(1);
+        if (name.size() == 14 &&
+            ::strncasecmp(name.data(), "Content-Length", 14) == 0) {
+          has_length = true;
+          conn.remaining = ::strtoull(std::string(value).c_str(), nullptr, 10);
+        } else if (name.size() == 17 &&
+                   ::strncasecmp(name.data(), "Transfer-Encoding", 17) == 0) {
+          chunked = value.find("chunked") != std::string_view::npos;
+        } else if (name.size() == 10 &&
+                   ::strncasecmp(name.data(), "Connection", 10) == 0) {
+          if (value.size() >= 5 && ::strncasecmp(value.data(), "close", 5) == 0)
+            conn.close_after = true;
+          else if (value.size() >= 10 &&
+                   ::strncasecmp(value.data(), "keep-alive", 10) == 0)
+            conn.close_after = false;
+        } else if (options_.cookies && name.size() == 10 &&
+                   ::strncasecmp(name.data(), "Set-Cookie", 10) == 0) {
+          setCookie(conn, value.substr(0, value.find(';')));
+        }
+      }
+      if (options_.method == "HEAD" || conn.status == 204 ||
+          conn.status == 304 || conn.status / 100 == 1) {
+        complete(conn);
+      } else if (chunked) {
+        conn.state = ReadState::ChunkSize;
+      } else if (has_length) {
+        conn.state = ReadState::Body;
+      } else {
+        conn.close_after = true;
+        conn.state = ReadState::UntilClose;
+      }
+      break;
+    }
+    case ReadState::Body: {
+      size_t n = std::min(conn.remaining, in.size() - pos);
+      pos += n;
+      conn.remaining -= n;
+      if (conn.remaining > 0)
+        goto done;
+      complete(conn);
+      break;
+    }
+    case ReadState::ChunkSize: {
+      size_t end = in.find("\r\n", pos);
+      if (end == std::string::npos)
+        goto done;
+      conn.remaining = ::strtoull(in.c_str() + pos, nullptr, 16);
+      pos = end + 2;
+      conn.state =
+          conn.remaining == 0 ? ReadState::Trailer : ReadState::ChunkData;
+      // with the CRLF after the data
+      conn.remaining += 2;
+      break;
+    }
+    case ReadState::ChunkData: {
+      size_t n = std::min(conn.remaining, in.size() - pos);
+      pos += n;
+      conn.remaining -= n;
+      if (conn.remaining > 0)
+        goto done;
+      conn.state = ReadState::ChunkSize;
+      break;
+    }
+    case ReadState::Trailer: {
+      // the last chunk is followed by optional trailers and a blank line
+      if (in.compare(pos, 2, "\r\n") == 0) {
+        pos += 2;
+      } else {
+        size_t end = in.find("\r\n\r\n", pos);
+        if (end == std::string::npos)
+          goto done;
+        pos = end + 4;
+      }
+      complete(conn);
+      break;
+    }
+    case ReadState::UntilClose:
+      pos = in.size();
+      goto done;
+    }
+  }
+done:
+  in.erase(0, pos);
+  return true;
+}
+
+void Worker::setCookie(Connection &conn, std::string_view pair) {
+  size_t eq = pair.find('=');
+  if (eq == std::string_view::npos || eq == 0)
+    return;
+  std::string name(pair.substr(0, eq));
+  std::string value(pair.substr(eq + 1));
+  auto it = std::find_if(conn.cookies.begin(), conn.cookies.end(),
+                         [&](const auto &c) { return c.first == name; });
+  if (it != conn.cookies.end())
+    it->second = value;
+  else
+    conn.cookies.emplace_back(name, value);
+  conn.cookie.clear();
+  for (const auto &[k, v] : conn.cookies) {
+    if (!conn.cookie.empty())
+      conn.cookie += "; ";
+    conn.cookie += k + "=" + v;
+  }
+}
+
+void Worker::complete(Connection &conn) {
+  stats_.latency.record(nowNanos() - conn.sent.front());
+  conn.sent.pop_front();
+  ++stats_.responses;
+  int cls = conn.status / 100;
+  ++stats_.status[cls >= 1 && cls <= 5 ? cls : 0];
+  conn.state = ReadState::Head;
+}
+
+void Worker::run() {
+  epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  // connections are referenced by epoll, the vector never reallocates
+  connections_.resize(conns_);
+  for (auto &conn : connections_)
+    open(conn);
+
+  std::vector<epoll_event> events(256);
+  while (true) {
+    uint64_t now = nowNanos();
+    if (now >= deadline_)
+      break;
+    bool active = false;
+    for (auto &conn : connections_)
+      active |= conn.fd >= 0;
+    if (!active)
+      break;
+
+    int timeout = std::min<uint64_t>((deadline_ - now) / 1000000 + 1, 100);
+    int n = ::epoll_wait(epfd_, events.data(), events.size(), timeout);
+    for (int i = 0; i < n; ++i) {
+      Connection &conn = *(Connection *)events[i].data.ptr;
+      if (conn.fd < 0)
+        continue;
+      if (!handshake(conn)) {
+        close(conn);
+        reopen(conn);
+        continue;
+      }
+      if (conn.connecting || conn.handshaking)
+        continue;
+      bool alive = receive(conn);
+      if (alive && conn.sent.empty() && conn.close_after)
+        alive = false;
+      if (!alive) {
+        reopen(conn);
+        continue;
+      }
+      fill(conn);
+      if (!flush(conn)) {
+        ++stats_.io_errors;
+        reopen(conn);
+        continue;
+      }
+      // nothing left to wait for, the -n budget is spent
+      if (conn.sent.empty() && conn.out.empty())
+        close(conn);
+    }
+  }
+  for (auto &conn : connections_)
+    close(conn);
+  ::close(epfd_);
+}
+
+std::string readFile(const std::string &path) {
+  FILE *fp = ::fopen(path.c_str(), "rb");
+  if (fp == nullptr) {
+    fprintf(stderr, "%s: %s\n", path.c_str(), ::strerror(errno));
+    ::exit(1);
+  }
+  std::string s;
+  char buf[65536];
+  size_t n;
+  while ((n = ::fread(buf, 1, sizeof(buf), fp)) > 0)
+    s.append(buf, n);
+  ::fclose(fp);
+  return s;
+}
+
+// -F name=value and name=@file as multipart/form-data
+void buildMultipart(Options &options) {
+  std::string boundary =
+      "----socnetbench" + std::to_string(::getpid()) + std::to_string(::time(0));
+  std::string body;
+  for (const auto &field : options.fields) {
+    size_t eq = field.find('=');
+    if (eq == std::string::npos) {
+      fprintf(stderr, "invalid field: %s\n", field.c_str());
+      ::exit(1);
+    }
+    std::string name = field.substr(0, eq);
+    std::string value = field.substr(eq + 1);
+    body += "--" + boundary + "\r\n";
+    if (!value.empty() && value[0] == '@') {
+      std::string path = value.substr(1);
+      std::string file = path.substr(path.rfind('/') + 1);
+      body += "Content-Disposition: form-data; name=\"" + name +
+              "\"; filename=\"" + file +
+              "\"\r\nContent-Type: application/octet-stream\r\n\r\n";
+      body += readFile(path);
+    } else {
+      body += "Content-Disposition: form-data; name=\"" + name + "\"\r\n\r\n";
+      body += value;
+    }
+    body += "\r\n";
+  }
+  body += "--" + boundary + "--\r\n";
+  options.body = body;
+  options.content_type = "multipart/form-data; boundary=" + boundary;
+}
+
+bool parseUrl(const std::string &url, Options &options) {
+  std::string rest;
+  if (url.compare(0, 7, "http://") == 0) {
+    rest = url.substr(7);
+  } else if (url.compare(0, 8, "https://") == 0) {
+    rest = url.substr(8);
+    options.https = true;
+    options.port = 443;
+  } else {
+    return false;
+  }
+  size_t slash = rest.find('/');
+  std::string hostport = rest.substr(0, slash);
+  options.path = slash == std::string::npos ? "/" : rest.substr(slash);
+  size_t colon = hostport.find(':');
+  options.host = hostport.substr(0, colon);
+  if (colon != std::string::npos)
+    options.port = ::atoi(hostport.c_str() + colon + 1);
+  return !options.host.empty() && options.port > 0;
+}
+
+void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] http[s]://host:port/path\n"
+          "  -t threads      worker threads (2)\n"
+          "  -c connections  open connections (10)\n"
+          "  -d seconds      run time (10)\n"
+          "  -n requests     stop after this many requests\n"
+          "  -p depth        requests pipelined per connection (1)\n"
+          "  -K              close the connection after every response\n"
+          "  -m method       GET, HEAD or POST (POST with a body)\n"
+          "  -D data         request body\n"
+          "  -b file         request body from a file\n"
+          "  -T type         content type of the body\n"
+          "  -F name=value   multipart field, name=@file for a file\n"
+          "  -H header       extra header, \"Name: value\"\n"
+          "  -z              accept gzip\n"
+          "  -C              keep the cookies of each connection\n"
+          "  -s name         scenario name for the report\n"
+          "  -j              report as JSON\n",
+          name);
+  ::exit(1);
+}
+
+void report(const Options &options, const Stats &stats, double elapsed) {
+  const Histogram &h = stats.latency;
+  auto us = [](uint64_t ns) { return ns / 1000.0; };
+  double rps = elapsed > 0 ? stats.responses / elapsed : 0;
+  double mbps = elapsed > 0 ? stats.bytes / elapsed / (1024 * 1024) : 0;
+  std::string url = std::string(options.https ? "https://" : "http://") +
+                    options.host + ":" + std::to_string(options.port) +
+                    options.path;
+
+  if (options.json) {
+    printf("{\"scenario\":\"%s\",\"url\":\"%s\",\"method\":\"%s\","
+           "\"threads\":%d,\"connections\":%d,\"pipeline\":%d,"
+           "\"keepalive\":%s,\"duration_s\":%.3f,\"requests\":%llu,"
+           "\"rps\":%.1f,\"bytes\":%llu,\"mb_per_s\":%.2f,"
+           "\"status\":{\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,"
+           "\"5xx\":%llu,\"other\":%llu},"
+           "\"errors\":{\"connect\":%llu,\"io\":%llu,\"parse\":%llu},"
+           "\"reconnects\":%llu,"
+           "\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,"
+           "\"p90\":%.1f,\"p99\":%.1f,\"p99.9\":%.1f,\"p99.99\":%.1f,"
+           "\"max\":%.1f}}\n",
+           options.scenario.c_str(), url.c_str(), options.method.c_str(),
+           options.threads, options.connections, options.pipeline,
+           options.keepalive ? "true" : "false", elapsed,
+           (unsigned long long)stats.responses, rps,
+           (unsigned long long)stats.bytes, mbps,
+           (unsigned long long)stats.status[1],
+           (unsigned long long)stats.status[2],
+           (unsigned long long)stats.status[3],
+           (unsigned long long)stats.status[4],
+           (unsigned long long)stats.status[5],
+           (unsigned long long)stats.status[0],
+           (unsigned long long)stats.connect_errors,
+           (unsigned long long)stats.io_errors,
+           (unsigned long long)stats.parse_errors,
+           (unsigned long long)stats.reconnects, us(h.min()), us(h.mean()),
+           us(h.percentile(50)), us(h.percentile(90)), us(h.percentile(99)),
+           us(h.percentile(99.9)), us(h.percentile(99.99)), us(h.max()));
+    return;
+  }
+
+  printf("%s %s, %d threads, %d connections, pipeline %d%s\n",
+         options.method.c_str(), url.c_str(), options.threads,
+         options.connections, options.pipeline,
+         options.keepalive ? "" : ", no keep-alive");
+  printf("  %llu requests in %.2fs, %.1f req/s, %.2f MB/s\n",
+         (unsigned long long)stats.responses, elapsed, rps, mbps);
+  printf("  status 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu, other %llu\n",
+         (unsigned long long)stats.status[2],
+         (unsigned long long)stats.status[3],
+         (unsigned long long)stats.status[4],
+         (unsigned long long)stats.status[5],
+         (unsigned long long)(stats.status[0] + stats.status[1]));
+  printf("  errors connect %llu, io %llu, parse %llu, reconnects %llu\n",
+         (unsigned long long)stats.connect_errors,
+         (unsigned long long)stats.io_errors,
+         (unsigned long long)stats.parse_errors,
+         (unsigned long long)stats.reconnects);
+  printf("  latency us  min %.1f  mean %.1f  max %.1f\n", us(h.min()),
+         us(h.mean()), us(h.max()));
+  for (double p : {50.0, 90.0, 99.0, 99.9, 99.99})
+    printf("    p%-6g %10.1f\n", p, us(h.percentile(p)));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  int c;
+  while ((c = ::getopt(argc, argv, "t:c:d:n:p:Km:D:b:T:F:H:zCs:jh")) != -1) {
+    switch (c) {
+    case 't':
+      options.threads = std::max(1, ::atoi(optarg));
+      break;
+    case 'c':
+      options.connections = std::max(1, ::atoi(optarg));
+      break;
+    case 'd':
+      options.duration = ::atof(optarg);
+      break;
+    case 'n':
+      options.requests = ::strtoull(optarg, nullptr, 10);
+      break;
+    case 'p':
+      options.pipeline = std::max(1, ::atoi(optarg));
+      break;
+    case 'K':
+      options.keepalive = false;
+      break;
+    case 'm':
+      options.method = optarg;
+      break;
+    case 'D':
+      options.body = optarg;
+      break;
+    case 'b':
+      options.body = readFile(optarg);
+      break;
+    case 'T':
+      options.content_type = optarg;
+      break;
+    case 'F':
+      options.fields.push_back(optarg);
+      break;
+    case 'H':
+      options.headers.push_back(optarg);
+      break;
+    case 'z':
+      options.gzip = true;
+      break;
+    case 'C':
+      options.cookies = true;
+      break;
+    case 's':
+      options.scenario = optarg;
+      break;
+    case 'j':
+      options.json = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || !parseUrl(argv[optind], options))
+    usage(argv[0]);
+  if (!options.fields.empty())
+    buildMultipart(options);
+  bool has_body = !options.body.empty() || !options.fields.empty();
+  if (options.method.empty())
+    options.method = has_body ? "POST" : "GET";
+  if (options.threads > options.connections)
+    options.threads = options.connections;
+
+  addrinfo hints = {}, *res;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (::getaddrinfo(options.host.c_str(), nullptr, &hints, &res) != 0) {
+    fprintf(stderr, "cannot resolve %s\n", options.host.c_str());
+    return 1;
+  }
+  sockaddr_in addr = *(sockaddr_in *)res->ai_addr;
+  addr.sin_port = htons(options.port);
+  ::freeaddrinfo(res);
+
+  SSL_CTX *ctx = nullptr;
+  if (options.https) {
+    ctx = SSL_CTX_new(TLS_client_method());
+    // a benchmark against local test certificates
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+  }
+
+  // the Cookie header of a connection goes between the two parts
+  std::string prefix = options.method + " " + options.path +
+                       " HTTP/1.1\r\nHost: " + options.host + ":" +
+                       std::to_string(options.port) + "\r\n";
+  std::string suffix = "User-Agent: socnet-bench\r\n";
+  if (!options.keepalive)
+    suffix += "Connection: close\r\n";
+  if (options.gzip)
+    suffix += "Accept-Encoding: gzip\r\n";
+  for (const auto &header : options.headers)
+    suffix += header + "\r\n";
+  if (has_body)
+    suffix += "Content-Type: " + options.content_type +
+              "\r\nContent-Length: " + std::to_string(options.body.size()) +
+              "\r\n";
+  suffix += "\r\n" + options.body;
+
+  std::atomic<uint64_t> budget(options.requests);
+  uint64_t start = nowNanos();
+  uint64_t deadline =
+      options.duration > 0 ? start + (uint64_t)(options.duration * 1e9)
+                           : UINT64_MAX;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.threads; ++i) {
+    int conns = options.connections / options.threads +
+                (i < options.connections % options.threads ? 1 : 0);
+    workers.push_back(std::make_unique<Worker>(options, addr, ctx, prefix,
+                                               suffix, conns, budget,
+                                               deadline));
+  }
+  for (auto &worker : workers)
+    threads.emplace_back(&Worker::run, worker.get());
+  for (auto &th : threads)
+    th.join();
+  double elapsed = (nowNanos() - start) / 1e9;
+
+  Stats total;
+  for (const auto &worker : workers) {
+    const Stats &s = worker->stats();
+    total.latency.merge(s.latency);
+    total.responses += s.responses;
+    total.bytes += s.bytes;
+    for (int i = 0; i < 6; ++i)
+      total.status[i] += s.status[i];
+    total.connect_errors += s.connect_errors;
+    total.io_errors += s.io_errors;
+    total.parse_errors += s.parse_errors;
+    total.reconnects += s.reconnects;
+  }
+  report(options, total, elapsed);
+  if (ctx)
+    SSL_CTX_free(ctx);
+  return total.responses > 0 ? 0 : 1;
+}
@@ -0,0 +1,817 @@
+// Replay the traffic recorded with the capture_file option
+//
+//   socnet-replay [-x speed] [-w seconds] [-j] <capture> host:port
+//   socnet-replay -i <capture>
+//
+// Every captured connection is opened, sent its bytes and closed at the
+// original times divided by speed (1), with -x 0 everything is sent as soon
+// as the connections take it. Request boundaries are found in the captured
+// bytes. As the server may not take pipelined requests, a request is held
+// back until the ones before it on its connection are answered, and its
+// latency runs from the moment it is sent until its response has been read.
+// Requests still unanswered -w seconds (10) after the last event count as
+// timeouts. The summary is printed as text or with -j as one JSON object, -i
+// describes the capture instead. HTTPS traffic is captured decrypted and
+// replayed as HTTP
+#include "../soc/net/include/TcpCapture.h"
+#include "Histogram.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using soc::net::TcpCaptureHeader;
+using soc::net::TcpCaptureRecord;
+
+namespace {
+
+uint64_t nowNanos() {
+  timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+struct Event {
+  uint64_t time;
+  uint32_t conn;
+  uint8_t type;
+  const char *data;
+  uint32_t size;
+};
+
+bool loadCapture(const char *path, std::vector<Event> &events) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, ::strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(TcpCaptureHeader)) {
+    fprintf(stderr, "%s: not a capture file\n", path);
+    ::close(fd);
+    return false;
+  }
+  // mapped for the lifetime of the process, the events point into it
+  void *p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "%s: %s\n", path, ::strerror(errno));
+    return false;
+  }
+
+  const auto *header = (const TcpCaptureHeader *)p;
+  if (::memcmp(header->magic, TcpCaptureHeader::kMagic,
+               sizeof(header->magic)) != 0 ||
+      header->version != TcpCaptureHeader::kVersion ||
+      header->record_size != sizeof(TcpCaptureRecord)) {
+    fprintf(stderr, "%s: not a capture file\n", path);
+    return false;
+  }
+  const char *at = (const char *)p + sizeof(TcpCaptureHeader);
+  const char *end = (const char *)p + st.st_size;
+  while (end - at >= (ptrdiff_t)sizeof(TcpCaptureRecord)) {
+    TcpCaptureRecord r;
+    ::memcpy(&r, at, sizeof(r));
+    at += sizeof(r);
+    // the capture of a crashed server may end in the middle of a record
+    if ((size_t)(end - at) < r.size)
+      break;
+    events.push_back({r.time, r.conn, r.type, at, r.size});
+    at += r.size;
+  }
+  return true;
+}
+
+// Finds the ends of the requests in the bytes a client sent, from the
+// header block and Content-Length
+class RequestFramer {
+public:
+  // calls done(head, size, end) for every request that ends in data, end
+  // is the offset in data after the request
+  template <class F> void feed(std::string_view data, F &&done) {
+    const size_t length = data.size();
+    while (!data.empty()) {
+      if (body_ > 0) {
+        size_t n = std::min<uint64_t>(body_, data.size());
+        data.remove_prefix(n);
+        body_ -= n;
+        size_ += n;
+        if (body_ == 0)
+          finish(done, length - data.size());
+        continue;
+      }
+      size_t old = header_.size();
+      header_.append(data);
+      size_t end = header_.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+      if (end == std::string::npos)
+        return;
+      data.remove_prefix(end + 4 - old);
+      header_.resize(end + 4);
+      head_ = header_.compare(0, 5, "HEAD ") == 0;
+      body_ = contentLength();
+      size_ = header_.size();
+      header_.clear();
+      if (body_ == 0)
+        finish(done, length - data.size());
+    }
+  }
+
+private:
+  template <class F> void finish(F &&done, size_t end) {
+    done(head_, size_, end);
+    size_ = 0;
+  }
+
+  uint64_t contentLength() const {
+    size_t line = header_.find("\r\n");
+    while (line != std::string::npos && line + 2 < header_.size()) {
+      size_t next = header_.find("\r\n", line + 2);
+      std::string_view h(header_.data() + line + 2, next - line - 2);
+      if (h.size() > 15 &&
+          ::strncasecmp(h.data(), "Content-Length:", 15) == 0)
+        return ::strtoull(h.data() + 15, nullptr, 10);
+      line = next;
+    }
+    return 0;
+  }
+
+  std::string header_;
+  uint64_t body_ = 0;
+  uint64_t size_ = 0;
+  bool head_ = false;
+};
+
+struct Stats {
+  Histogram latency;
+  uint64_t connections = 0;
+  uint64_t requests = 0;
+  uint64_t responses = 0;
+  uint64_t bytes = 0;
+  uint64_t status[6] = {};
+  uint64_t connect_errors = 0;
+  uint64_t io_errors = 0;
+  uint64_t parse_errors = 0;
+  // requests of connections the server had already closed
+  uint64_t dropped = 0;
+  // requests that waited for the answer to an earlier one
+  uint64_t held = 0;
+  uint64_t timeouts = 0;
+  // how far the replay fell behind the scaled capture times
+  uint64_t max_lag_ns = 0;
+};
+
+// A response is read through these states
+enum class ReadState { Head, Body, ChunkSize, ChunkData, Trailer, UntilClose };
+
+// A captured request, the last one of a connection may be incomplete
+struct Request {
+  std::string bytes;
+  bool head = false;
+  bool complete = false;
+  // its first bytes are out, the rest follows as it is captured
+  bool started = false;
+  bool held = false;
+};
+
+struct Connection {
+  int fd = -1;
+  uint32_t id = 0;
+  bool connecting = true;
+  // the capture closed the connection, once the responses are read
+  bool closing = false;
+  std::string out;
+  size_t out_pos = 0;
+  std::string in;
+  RequestFramer framer;
+  // requests waiting for the answers to those before them
+  std::deque<Request> queue;
+  // send times of the requests waiting for their responses, and whether
+  // they were HEAD requests
+  std::deque<std::pair<uint64_t, bool>> sent;
+  ReadState state = ReadState::Head;
+  uint64_t remaining = 0;
+  int status = 0;
+};
+
+class Replayer {
+public:
+  Replayer(const std::vector<Event> &events, const sockaddr_in &addr,
+           double speed, double wait)
+      : events_(events), addr_(addr), speed_(speed), wait_(wait) {
+    epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  }
+  ~Replayer() { ::close(epfd_); }
+
+  void run();
+  const Stats &stats() const { return stats_; }
+  double elapsed() const { return (last_ - start_) / 1e9; }
+
+private:
+  void handle(const Event &e, uint64_t now);
+  void open(uint32_t id);
+  void close(Connection *conn);
+  void closeIfDone(Connection *conn);
+  void append(Connection *conn, std::string_view data, bool head,
+              bool complete);
+  void pump(Connection *conn, uint64_t now);
+  bool flush(Connection *conn);
+  bool receive(Connection *conn);
+  bool parse(Connection *conn);
+  void complete(Connection *conn);
+  void onEvent(Connection *conn, uint32_t events);
+
+  const std::vector<Event> &events_;
+  sockaddr_in addr_;
+  double speed_;
+  double wait_;
+  int epfd_;
+  uint64_t start_ = 0;
+  uint64_t last_ = 0;
+  Stats stats_;
+  // open connections by fd, and those a captured fd stands for. A closed
+  // capture connection stays open here until its answers are read, while
+  // the fd may already stand for the next one
+  std::unordered_map<int, std::unique_ptr<Connection>> conns_;
+  std::unordered_map<uint32_t, Connection *> ids_;
+};
+
+void Replayer::run() {
+  start_ = last_ = nowNanos();
+  size_t next = 0;
+  uint64_t drained_at = 0;
+  std::vector<epoll_event> ready(256);
+  while (true) {
+    uint64_t now = nowNanos();
+    while (next < events_.size()) {
+      uint64_t due =
+          speed_ > 0 ? start_ + (uint64_t)(events_[next].time * 1000 / speed_)
+                     : now;
+      if (due > now)
+        break;
+      stats_.max_lag_ns = std::max(stats_.max_lag_ns, now - due);
+      handle(events_[next++], now);
+    }
+
+    int timeout = 100;
+    if (next < events_.size() && speed_ > 0) {
+      uint64_t due = start_ + (uint64_t)(events_[next].time * 1000 / speed_);
+      timeout = (int)std::min<uint64_t>((due - now + 999999) / 1000000, 100);
+    } else {
+      if (drained_at == 0) {
+        // connections the capture left open are closed once answered
+        drained_at = now;
+        std::vector<Connection *> open;
+        for (auto &[id, conn] : ids_)
+          open.push_back(conn);
+        ids_.clear();
+        for (Connection *conn : open) {
+          conn->closing = true;
+          closeIfDone(conn);
+        }
+      }
+      if (conns_.empty())
+        break;
+      if (now - drained_at > wait_ * 1e9) {
+        for (auto &[fd, conn] : conns_) {
+          stats_.timeouts += conn->sent.size() + conn->queue.size();
+          ::close(fd);
+        }
+        conns_.clear();
+        break;
+      }
+    }
+
+    int n = ::epoll_wait(epfd_, ready.data(), ready.size(), timeout);
+    for (int i = 0; i < n; ++i) {
+      auto it = conns_.find(ready[i].data.fd);
+      if (it != conns_.end())
+        onEvent(it->second.get(), ready[i].events);
+    }
+  }
+}
+
+void Replayer::handle(const Event &e, uint64_t now) {
+  auto it = ids_.find(e.conn);
+  Connection *conn = it == ids_.end() ? nullptr : it->second;
+  switch (e.type) {
+  case TcpCaptureRecord::Open:
+    // the capture missed the close of an earlier connection on the fd
+    if (conn) {
+      ids_.erase(it);
+      conn->closing = true;
+      closeIfDone(conn);
+    }
+    open(e.conn);
+    break;
+  case TcpCaptureRecord::Data:
+    if (conn == nullptr) {
+      // the server closed the connection earlier than in the capture
+      RequestFramer framer;
+      framer.feed({e.data, e.size},
+                   [&](bool, uint64_t, size_t) { ++stats_.dropped; });
+      break;
+    }
+    {
+      std::string_view data(e.data, e.size);
+      size_t from = 0;
+      conn->framer.feed(data, [&](bool head, uint64_t, size_t end) {
+        append(conn, data.substr(from, end - from), head, true);
+        from = end;
+      });
+      if (from < data.size())
+        append(conn, data.substr(from), false, false);
+    }
+    pump(conn, now);
+    if (!conn->connecting && !flush(conn))
+      close(conn);
+    break;
+  case TcpCaptureRecord::Close:
+    if (conn) {
+      ids_.erase(it);
+      conn->closing = true;
+      closeIfDone(conn);
+    }
+    break;
+  }
+}
+
+void Replayer::open(uint32_t id) {
+  int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    ++stats_.connect_errors;
+    return;
+  }
+  int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (::connect(fd, (const sockaddr *)&addr_, sizeof(addr_)) < 0 &&
+      errno != EINPROGRESS) {
+    ++stats_.connect_errors;
+    ::close(fd);
+    return;
+  }
+  auto conn = std::make_unique<Connection>();
+  conn->fd = fd;
+  conn->id = id;
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLOUT;
+  ev.data.fd = fd;
+  ::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+  ids_[id] = conn.get();
+  conns_[fd] = std::move(conn);
+  ++stats_.connections;
+}
+
+void Replayer::append(Connection *conn, std::string_view data, bool head,
+                      bool complete) {
+  if (conn->queue.empty() || conn->queue.back().complete)
+    conn->queue.emplace_back();
+  Request &r = conn->queue.back();
+  r.bytes.append(data);
+  r.head = head;
+  r.complete = complete;
+  if (complete)
+    ++stats_.requests;
+}
+
+// Moves the requests that may go out to the send buffer
+void Replayer::pump(Connection *conn, uint64_t now) {
+  while (!conn->queue.empty()) {
+    Request &r = conn->queue.front();
+    if (!r.started && !conn->sent.empty()) {
+      r.held = true;
+      break;
+    }
+    r.started = true;
+    conn->out.append(r.bytes);
+    r.bytes.clear();
+    if (!r.complete)
+      break;
+    conn->sent.emplace_back(now, r.head);
+    stats_.held += r.held;
+    conn->queue.pop_front();
+  }
+}
+
+void Replayer::close(Connection *conn) {
+  // the requests sent on it are lost, those not sent yet are dropped
+  stats_.io_errors += conn->sent.size();
+  for (const Request &r : conn->queue)
+    stats_.dropped += r.complete;
+  ::close(conn->fd);
+  if (auto it = ids_.find(conn->id); it != ids_.end() && it->second == conn)
+    ids_.erase(it);
+  conns_.erase(conn->fd);
+}
+
+void Replayer::closeIfDone(Connection *conn) {
+  if (conn->closing && conn->sent.empty() && conn->queue.empty() &&
+      conn->out_pos == conn->out.size())
+    close(conn);
+}
+
+bool Replayer::flush(Connection *conn) {
+  while (conn->out_pos < conn->out.size()) {
+    ssize_t n = ::send(conn->fd, conn->out.data() + conn->out_pos,
+                       conn->out.size() - conn->out_pos, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EAGAIN)
+        break;
+      return false;
+    }
+    conn->out_pos += n;
+  }
+  if (conn->out_pos == conn->out.size()) {
+    conn->out.clear();
+    conn->out_pos = 0;
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN | (conn->out.empty() ? 0 : (int)EPOLLOUT);
+  ev.data.fd = conn->fd;
+  ::epoll_ctl(epfd_, EPOLL_CTL_MOD, conn->fd, &ev);
+  return true;
+}
+
+void Replayer::onEvent(Connection *conn, uint32_t events) {
+  if (conn->connecting) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    ::getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+      ++stats_.connect_errors;
+      stats_.dropped += conn->sent.size();
+      conn->sent.clear();
+      close(conn);
+      return;
+    }
+    conn->connecting = false;
+  }
+  if ((events & EPOLLOUT) && !flush(conn)) {
+    close(conn);
+    return;
+  }
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+    if (!receive(conn))
+      return;
+  }
+  closeIfDone(conn);
+}
+
+// false when the connection was closed
+bool Replayer::receive(Connection *conn) {
+  char buf[64 * 1024];
+  while (true) {
+    ssize_t n = ::recv(conn->fd, buf, sizeof(buf), 0);
+    if (n > 0) {
+      stats_.bytes += n;
+      conn->in.append(buf, n);
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN)
+      break;
+    // the end of a response read until close
+    if (conn->state == ReadState::UntilClose && !conn->sent.empty())
+      complete(conn);
+    close(conn);
+    return false;
+  }
+  if (!parse(conn)) {
+    ++stats_.parse_errors;
+    conn->sent.clear();
+    close(conn);
+    return false;
+  }
+  // the answers let the next requests go
+  pump(conn, nowNanos());
+  if (!flush(conn)) {
+    close(conn);
+    return false;
+  }
+  return true;
+}
+
+bool Replayer::parse(Connection *conn) {
+  size_t pos = 0;
+  std::string &in = conn->in;
+  while (true) {
+    switch (conn->state) {
+    case ReadState::Head: {
+      size_t end = in.find("\r\n\r\n", pos);
+      if (end == std::string::npos)
+        goto done;
+      if (conn->sent.empty())
+        return false;
+      std::string_view head(in.data() + pos, end - pos);
+      pos = end + 4;
+      if (head.size() < 12 || head.substr(0, 5) != "HTTP/")
+        return false;
+      conn->status = ::atoi(std::string(head.substr(9, 3)).c_str());
+      bool has_length = false, chunked = false;
+      conn->remaining = 0;
+      size_t line = head.find("\r\n");
+      while (line != std::string_view::npos) {
+        size_t next = head.find("\r\n", line + 2);
+        std::string_view h = head.substr(
+            line + 2, next == std::string_view::npos ? std::string_view::npos
+                                                     : next - line - 2);
+        line = next;
+        size_t colon = h.find(':');
+        if (colon == std::string_view::npos)
+          continue;
+        std::string_view name = h.substr(0, colon);
+        std::string_view value = h.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ')
+          value.remove_prefix(1);
+        if (name.size() == 14 &&
+            ::strncasecmp(name.data(), "Content-Length", 14) == 0) {
+          has_length = true;
+          conn->remaining =
+              ::strtoull(std::string(value).c_str(), nullptr, 10);
+        } else if (name.size() == 17 &&
+                   ::strncasecmp(name.data(), "Transfer-Encoding", 17) == 0) {
+          chunked = value.find("chunked") != std::string_view::npos;
+        }
+      }
+      if (conn->status / 100 == 1) {
+        // interim response, the final one follows
+        break;
+      } else if (conn->sent.front().second || conn->status == 204 ||
+                 conn->status == 304) {
+        complete(conn);
+      } else if (chunked) {
+        conn->state = ReadState::ChunkSize;
+      } else if (has_length) {
+        conn->state = ReadState::Body;
+        if (conn->remaining == 0)
+          complete(conn);
+      } else {
+        conn->state = ReadState::UntilClose;
+      }
+      break;
+    }
+    case ReadState::Body: {
+      size_t n = std::min<uint64_t>(conn->remaining, in.size() - pos);
+      pos += n;
+      conn->remaining -= n;
+      if (conn->remaining > 0)
+        goto done;
+      complete(conn);
+      break;
+    }
+    case ReadState::ChunkSize: {
+      size_t end = in.find("\r\n", pos);
+      if (end == std::string::npos)
+        goto done;
+      conn->remaining = ::strtoull(in.c_str() + pos, nullptr, 16);
+      pos = end + 2;
+      conn->state =
+          conn->remaining == 0 ? ReadState::Trailer : ReadState::ChunkData;
+      // with the CRLF after the data
+      conn->remaining += 2;
+      break;
+    }
+    case ReadState::ChunkData: {
+      size_t n = std::min<uint64_t>(conn->remaining, in.size() - pos);
+      pos += n;
+      conn->remaining -= n;
+      if (conn->remaining > 0)
+        goto done;
+      conn->state = ReadState::ChunkSize;
+      break;
+    }
+    case ReadState::Trailer: {
+      if (in.compare(pos, 2, "\r\n") == 0) {
+        pos += 2;
+      } else {
+        size_t end = in.find("\r\n\r\n", pos);
+        if (end == std::string::npos)
+          goto done;
+        pos = end + 4;
+      }
+      complete(conn);
+      break;
+    }
+    case ReadState::UntilClose:
+      pos = in.size();
+      goto done;
+    }
+  }
+done:
+  in.erase(0, pos);
+  return true;
+}
+
+void Replayer::complete(Connection *conn) {
+  uint64_t now = nowNanos();
+  stats_.latency.record(now - conn->sent.front().first);
+  conn->sent.pop_front();
+  ++stats_.responses;
+  int cls = conn->status / 100;
+  ++stats_.status[cls >= 1 && cls <= 5 ? cls : 0];
+  conn->state = ReadState::Head;
+  last_ = now;
+}
+
+// -i, what the capture holds
+void describe(const char *path, const std::vector<Event> &events) {
+  uint64_t conns = 0, requests = 0, bytes = 0, largest = 0;
+  size_t open = 0, max_open = 0;
+  std::unordered_map<uint32_t, RequestFramer> framers;
+  for (const Event &e : events) {
+    switch (e.type) {
+    case TcpCaptureRecord::Open:
+      ++conns;
+      framers[e.conn] = {};
+      max_open = std::max(max_open, ++open);
+      break;
+    case TcpCaptureRecord::Data:
+      bytes += e.size;
+      framers[e.conn].feed({e.data, e.size}, [&](bool, uint64_t size, size_t) {
+        ++requests;
+        largest = std::max(largest, size);
+      });
+      break;
+    case TcpCaptureRecord::Close:
+      if (framers.erase(e.conn))
+        --open;
+      break;
+    }
+  }
+  double duration = events.empty() ? 0 : events.back().time / 1e6;
+  printf("%s: %.3fs, %llu connections (at most %zu open), %llu requests, "
+         "%llu bytes\n",
+         path, duration, (unsigned long long)conns, max_open,
+         (unsigned long long)requests, (unsigned long long)bytes);
+  printf("  %.1f req/s, %.1f requests per connection, largest request %llu "
+         "bytes\n",
+         duration > 0 ? requests / duration : 0,
+         conns ? (double)requests / conns : 0, (unsigned long long)largest);
+}
+
+void report(const char *path, double speed, const Stats &stats,
+            double elapsed, bool json) {
+  const Histogram &h = stats.latency;
+  auto us = [](uint64_t ns) { return ns / 1000.0; };
+  double rps = elapsed > 0 ? stats.responses / elapsed : 0;
+  double mbps = elapsed > 0 ? stats.bytes / elapsed / (1024 * 1024) : 0;
+
+  if (json) {
+    printf("{\"capture\":\"%s\",\"speed\":%g,\"duration_s\":%.3f,"
+           "\"connections\":%llu,\"requests\":%llu,\"responses\":%llu,"
+           "\"rps\":%.1f,\"bytes\":%llu,\"mb_per_s\":%.2f,"
+           "\"status\":{\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,"
+           "\"5xx\":%llu,\"other\":%llu},"
+           "\"errors\":{\"connect\":%llu,\"io\":%llu,\"parse\":%llu,"
+           "\"dropped\":%llu,\"timeout\":%llu},\"held\":%llu,"
+           "\"max_lag_ms\":%.3f,"
+           "\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,"
+           "\"p90\":%.1f,\"p99\":%.1f,\"p99.9\":%.1f,\"p99.99\":%.1f,"
+           "\"max\":%.1f}}\n",
+           path, speed, elapsed, (unsigned long long)stats.connections,
+           (unsigned long long)stats.requests,
+           (unsigned long long)stats.responses, rps,
+           (unsigned long long)stats.bytes, mbps,
+           (unsigned long long)stats.status[1],
+           (unsigned long long)stats.status[2],
+           (unsigned long long)stats.status[3],
+           (unsigned long long)stats.status[4],
+           (unsigned long long)stats.status[5],
+           (unsigned long long)stats.status[0],
+           (unsigned long long)stats.connect_errors,
+           (unsigned long long)stats.io_errors,
+           (unsigned long long)stats.parse_errors,
+           (unsigned long long)stats.dropped,
+           (unsigned long long)stats.timeouts,
+           (unsigned long long)stats.held, stats.max_lag_ns / 1e6,
+           us(h.min()), us(h.mean()), us(h.percentile(50)),
+           us(h.percentile(90)), us(h.percentile(99)), us(h.percentile(99.9)),
+           us(h.percentile(99.99)), us(h.max()));
+    return;
+  }
+
+  printf("%s at %gx, %llu connections\n", path, speed,
+         (unsigned long long)stats.connections);
+  printf("  %llu of %llu requests answered in %.2fs, %.1f req/s, %.2f MB/s\n",
+         (unsigned long long)stats.responses,
+         (unsigned long long)stats.requests, elapsed, rps, mbps);
+  printf("  status 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu, other %llu\n",
+         (unsigned long long)stats.status[2],
+         (unsigned long long)stats.status[3],
+         (unsigned long long)stats.status[4],
+         (unsigned long long)stats.status[5],
+         (unsigned long long)(stats.status[0] + stats.status[1]));
+  printf("  errors connect %llu, io %llu, parse %llu, dropped %llu, "
+         "timeout %llu\n",
+         (unsigned long long)stats.connect_errors,
+         (unsigned long long)stats.io_errors,
+         (unsigned long long)stats.parse_errors,
+         (unsigned long long)stats.dropped,
+         (unsigned long long)stats.timeouts);
+  printf("  %llu requests held for earlier answers, fell behind the capture "
+         "by up to %.3fms\n",
+         (unsigned long long)stats.held, stats.max_lag_ns / 1e6);
+  printf("  latency us  min %.1f  mean %.1f  max %.1f\n", us(h.min()),
+         us(h.mean()), us(h.max()));
+  for (double p : {50.0, 90.0, 99.0, 99.9, 99.99})
+    printf("    p%-6g %10.1f\n", p, us(h.percentile(p)));
+}
+
+bool parseAddress(const std::string &target, sockaddr_in &addr) {
+  size_t colon = target.rfind(':');
+  if (colon == std::string::npos)
+    return false;
+  std::string host = target.substr(0, colon);
+  addrinfo hints{}, *res = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (::getaddrinfo(host.c_str(), target.c_str() + colon + 1, &hints, &res) !=
+          0 ||
+      res == nullptr)
+    return false;
+  ::memcpy(&addr, res->ai_addr, sizeof(addr));
+  ::freeaddrinfo(res);
+  return true;
+}
+
+void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-x speed] [-w seconds] [-j] <capture> host:port\n"
+          "       %s -i <capture>\n"
+          "  -x  replay at speed times the original pace, 0 without pauses "
+          "(1)\n"
+          "  -w  seconds to wait for responses after the last event (10)\n"
+          "  -j  print the summary as JSON\n"
+          "  -i  describe the capture\n",
+          name, name);
+  exit(1);
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  double speed = 1;
+  double wait = 10;
+  bool json = false;
+  bool info = false;
+  int c;
+  while ((c = ::getopt(argc, argv, "x:w:jih")) != -1) {
+    switch (c) {
+    case 'x':
+      speed = ::atof(optarg);
+      break;
+    case 'w':
+      wait = ::atof(optarg);
+      break;
+    case 'j':
+      json = true;
+      break;
+    case 'i':
+      info = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind >= argc || speed < 0 || (!info && optind + 2 != argc))
+    usage(argv[0]);
+
+  const char *path = argv[optind];
+  std::vector<Event> events;
+  if (!loadCapture(path, events))
+    return 1;
+  if (info) {
+    describe(path, events);
+    return 0;
+  }
+
+  sockaddr_in addr{};
+  if (!parseAddress(argv[optind + 1], addr)) {
+    fprintf(stderr, "cannot resolve %s\n", argv[optind + 1]);
+    return 1;
+  }
+  ::signal(SIGPIPE, SIG_IGN);
+
+  Replayer replayer(events, addr, speed, wait);
+  replayer.run();
+  report(path, speed, replayer.stats(), replayer.elapsed(), json);
+  return 0;
+}
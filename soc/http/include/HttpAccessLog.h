@@ -0,0 +1,80 @@
+#ifndef SOC_HTTP_HTTPACCESSLOG_H
+#define SOC_HTTP_HTTPACCESSLOG_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace soc {
+namespace http {
+
+// One request in the access log, written as is into the segment files
+struct HttpAccessRecord {
+  static constexpr size_t kPathSize = 92;
+
+  // wall clock microseconds when the request arrived, 0 marks the unused
+  // tail of a segment
+  uint64_t time;
+  // response body bytes
+  uint64_t bytes;
+  // microseconds from the arrival of the request until its response was
+  // ready, and of that the time php-fpm took
+  uint32_t latency;
+  uint32_t upstream;
+  // IPv4 peer address in network byte order, port in host byte order
+  uint32_t addr;
+  uint16_t port;
+  uint16_t status;
+  // HttpMethod and HttpVersion values
+  uint8_t method;
+  uint8_t version;
+  // the url with its query string, path keeps the first kPathSize bytes
+  uint16_t path_len;
+  char path[kPathSize];
+};
+static_assert(sizeof(HttpAccessRecord) == 128);
+
+// Starts every segment file, the records follow
+struct HttpAccessSegmentHeader {
+  static constexpr char kMagic[8] = {'S', 'O', 'C', 'A', 'L', 'O', 'G', '\0'};
+  static constexpr uint32_t kVersion = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  // wall clock microseconds
+  uint64_t created;
+  char reserved[40];
+};
+static_assert(sizeof(HttpAccessSegmentHeader) == 64);
+
+// Every thread appends to its own segment file mapped with mmap(), so a
+// request is logged with a copy into the mapping and no lock or system call.
+// A full segment is truncated to its records and the next one is created as
+// <prefix>.<pid>-<sequence>. tools/socnet-alog decodes the files
+class HttpAccessLog {
+public:
+  HttpAccessLog(const std::string &prefix, size_t segment_bytes);
+
+  void write(const HttpAccessRecord &record);
+
+  // CLOCK_MONOTONIC microseconds, for the latencies
+  static uint64_t now();
+
+private:
+  struct Segment;
+  bool openSegment(Segment &segment);
+
+private:
+  std::string prefix_;
+  size_t segment_bytes_;
+  std::atomic<uint64_t> sequence_;
+  // a segment could not be created, reported once
+  std::atomic<bool> failed_;
+};
+
+} // namespace http
+} // namespace soc
+
+#endif
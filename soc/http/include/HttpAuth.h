@@ -2,6 +2,7 @@
 #define SOC_HTTP_HTTPAUTH_H
 
 #include "HttpPassStore.h"
+#include <vector>
 
 namespace soc {
 namespace http {
@@ -10,23 +11,43 @@ enum class HttpAuthType { Basic = 0x01, Digest = 0x02 };
 
 class HttpAuth {
 public:
+  // HttpRequest deletes its credentials through this class
+  virtual ~HttpAuth() = default;
   virtual bool verify() const = 0;
   virtual HttpAuthType getAuthType() const noexcept = 0;
+  // The credentials are right but were sent with an outdated nonce, the
+  // client can retry without asking the user again
+  virtual bool stale() const noexcept { return false; }
+};
+
+// A small per-thread map for results of the authentication hashes, so a
+// client that keeps sending the same credentials costs a lookup. When full,
+// the oldest entry is replaced
+class HttpAuthCache {
+public:
+  // Basic credentials that verified: token -> user:password
+  static HttpAuthCache &credentials();
+  // Digest h2: method:uri -> md5(method:uri)
+  static HttpAuthCache &digests();
+
+  const std::string *get(const std::string &key) const;
+  void put(const std::string &key, const std::string &value);
+  void clear();
+
+private:
+  static constexpr size_t kCapacity = 256;
+  std::unordered_map<std::string, std::string> map_;
+  // keys in insertion order, next_ is the oldest once full
+  std::vector<std::string> order_;
+  size_t next_ = 0;
+  // HttpPassStore generation the entries were verified against
+  uint64_t generation_ = 0;
 };
 
 class HttpBasicAuth : public HttpAuth {
 public:
-  explicit HttpBasicAuth(std::string_view user, std::string_view pass) {
-    user_ = std::string(user.data(), user.size());
-    pass_ = std::string(pass.data(), pass.size());
-    auto x = HttpPassStore::instance().fetch(user_);
-    // user authentication succeeded
-    if (x.has_value()) {
-      std::string hashv =
-          user_ + ":" + HttpPassStore::instance().getRealm() + ":" + pass_;
-      verify_successed_ = EncodeUtil::md5HashEqual(hashv, x.value());
-    }
-  }
+  // token is the base64 part of the Authorization header
+  explicit HttpBasicAuth(std::string_view token);
 
   const std::string &getUsername() const noexcept { return user_; }
   const std::string &getPassword() const noexcept { return pass_; }
@@ -42,69 +63,16 @@ private:
 class HttpDigestAuth : public HttpAuth {
 public:
   explicit HttpDigestAuth(const std::string &digest_info,
-                          const HttpMap<std::string, std::string> &da)
-      : digest_info_(digest_info) {
-    // h1 = md5(username:realm:password)
-    // h2 = md5(method:uri)
-    // resp = md5(h1:nonce:nc:cnonce:qop:h2)
-
-    auto username = da.get("username");
-    if (!username.has_value())
-      return;
-    // clear password
-    auto x = HttpPassStore::instance().fetch(username.value());
-    if (!x.has_value())
-      return;
-
-    auto method = da.get("method");
-    auto uri = da.get("uri");
-    auto nonce = da.get("nonce");
-    auto nc = da.get("nc");
-    auto cnonce = da.get("cnonce");
-    auto qop = da.get("qop");
-    auto response = da.get("response");
-
-    char buffer[128]{0};
-    // h1
-    std::string h1 = x.value();
-
-    // h2
-    ::memset(buffer, 0, 128);
-    ::snprintf(buffer, 128, "%s:%s", method.value().data(), uri.value().data());
-    std::string h2 = EncodeUtil::md5Hash(buffer);
-
-    // resp
-    ::memset(buffer, 0, 128);
-    ::strncat(buffer, h1.data(), h1.size());
-    if (nonce.has_value()) {
-      ::strncat(buffer, ":", 2);
-      ::strcat(buffer, nonce.value().data());
-    }
-    if (nc.has_value()) {
-      ::strncat(buffer, ":", 2);
-      ::strcat(buffer, nc.value().data());
-    }
-    if (cnonce.has_value()) {
-      ::strncat(buffer, ":", 2);
-      ::strcat(buffer, cnonce.value().data());
-    }
-    if (qop.has_value()) {
-      ::strncat(buffer, ":", 2);
-      ::strcat(buffer, qop.value().data());
-    }
-    ::strncat(buffer, ":", 2);
-    ::strncat(buffer, h2.data(), h2.size());
-
-    verify_successed_ =
-        EncodeUtil::md5HashEqual(buffer, response.value().data());
-  }
+                          const HttpMap<std::string, std::string> &da);
 
   const std::string &getDigestInfo() const noexcept { return digest_info_; }
   bool verify() const override { return verify_successed_; }
   HttpAuthType getAuthType() const noexcept { return HttpAuthType::Digest; }
+  bool stale() const noexcept override { return stale_; }
 
 private:
   bool verify_successed_ = false;
+  bool stale_ = false;
   std::string digest_info_;
 };
 
@@ -0,0 +1,59 @@
+#ifndef SOC_HTTP_HTTPMOUNT_H
+#define SOC_HTTP_HTTPMOUNT_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace soc {
+namespace http {
+
+struct HttpMountOptions {
+  std::vector<std::string> index_pages;
+  bool enable_sendfile = true;
+  bool enable_gzip = true;
+};
+
+struct HttpMount {
+  // url prefix and canonical directory, both end with '/'
+  std::string prefix;
+  std::string root;
+  HttpMountOptions options;
+  // the next shorter mount whose prefix also matches, tried when the file
+  // does not exist under this mount
+  const HttpMount *parent = nullptr;
+};
+
+// Mount directories stored in a trie keyed by url path segments.
+// The trie is built by freeze() and never modified afterwards, so find() takes
+// no lock and always returns the longest matching prefix in O(path length)
+class HttpMountTable {
+public:
+  HttpMountTable() : root_(nullptr) {}
+  ~HttpMountTable();
+
+  bool add(const std::string &url, const std::string &dir,
+           const HttpMountOptions &options);
+  void freeze();
+
+  bool empty() const noexcept { return mounts_.empty(); }
+  const HttpMount *find(std::string_view url) const;
+
+private:
+  struct Node {
+    // sorted by path segment
+    std::vector<std::pair<std::string, std::unique_ptr<Node>>> children;
+    const HttpMount *mount = nullptr;
+
+    Node *child(std::string_view segment) const;
+  };
+
+  std::atomic<Node *> root_;
+  std::vector<std::unique_ptr<HttpMount>> mounts_;
+};
+
+} // namespace http
+} // namespace soc
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef SOC_HTTP_HTTPNONCESTORE_H
+#define SOC_HTTP_HTTPNONCESTORE_H
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace soc {
+namespace http {
+
+// Digest nonces issued by this server. A nonce carries its issue time and an
+// HMAC of it under a key made at startup, so issuing one stores nothing;
+// only nonces that authenticated a request are remembered, with the nonce
+// counts seen, until they expire
+class HttpNonceStore {
+public:
+  static HttpNonceStore &instance() {
+    static HttpNonceStore ns;
+    return ns;
+  }
+
+  // A new nonce, valid for kLifetime milliseconds
+  std::string issue();
+  // Accept a request with this nonce and nonce count: the nonce must have
+  // been issued by this process and not expired, and nc must not have been
+  // seen before. Counts may arrive out of order within kWindow of the
+  // highest one. nc 0 means the client sent no count (RFC 2069)
+  bool use(const std::string &nonce, unsigned long nc);
+
+  static constexpr uint64_t kLifetime = 300 * 1000;
+
+private:
+  HttpNonceStore();
+  HttpNonceStore(const HttpNonceStore &) = delete;
+  HttpNonceStore &operator=(const HttpNonceStore &) = delete;
+
+  // hex of the first bytes of HMAC-SHA256(key, stamp)
+  std::string sign(std::string_view stamp) const;
+  // issue time of a nonce this process made, 0 when it did not make it
+  uint64_t issuedAt(const std::string &nonce) const;
+
+  struct Counts {
+    // highest nonce count, and bit i set when highest - i was seen
+    unsigned long highest = 0;
+    uint64_t seen = 0;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, Counts> counts;
+    // used nonces with their monotonic deadlines, roughly oldest first
+    std::deque<std::pair<uint64_t, std::string>> order;
+  };
+
+  Shard &shardOf(const std::string &nonce);
+  void expire(Shard &shard, uint64_t now);
+
+private:
+  static constexpr size_t kShards = 8;
+  static constexpr unsigned long kWindow = 64;
+  unsigned char key_[32];
+  Shard shards_[kShards];
+};
+
+} // namespace http
+} // namespace soc
+
+#endif
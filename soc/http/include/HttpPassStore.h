@@ -9,6 +9,9 @@
 namespace soc {
 namespace http {
 
+// Users and their password hashes, published as an immutable table so that
+// lookups take no lock while reload() swaps in a new one. A replaced table is
+// freed once no thread reads it
 class HttpPassStore {
 public:
   static HttpPassStore &instance() {
@@ -17,20 +20,46 @@ public:
   }
 
   std::optional<std::string> fetch(const std::string &user) const {
-    return user_pass_.get(user);
+    const Table *table = current_.get();
+    auto x = table->user_pass.find(user);
+    if (x == table->user_pass.end())
+      return std::nullopt;
+    return x->second;
   }
 
-  const std::string &getRealm() const noexcept { return realm_; }
+  // valid until the calling thread reads the store again
+  const std::string &getRealm() const { return current_.get()->realm; }
+
+  // Changes with every reload, caches of verified credentials compare it
+  uint64_t generation() const { return current_.get()->generation; }
+
+  // Read the user-password file and realm of the current config again
+  void reload() {
+    auto table = load();
+    table->generation = ++generation_;
+    current_.publish(std::move(table));
+  }
 
 private:
+  struct Table {
+    // {user:md5(username:realm:password)}
+    std::unordered_map<std::string, std::string> user_pass;
+    std::string realm;
+    uint64_t generation = 0;
+  };
+
   HttpPassStore(const HttpPassStore &) = delete;
   HttpPassStore(HttpPassStore &&) = delete;
   HttpPassStore &operator=(const HttpPassStore &) = delete;
   HttpPassStore &operator=(HttpPassStore &&) = delete;
 
-  HttpPassStore() {
-    realm_ = GET_CONFIG(std::string, "server", "authenticate_realm");
-    std::string file = GET_CONFIG(std::string, "server", "user_pass_file");
+  HttpPassStore() { current_.publish(load()); }
+
+  static std::unique_ptr<Table> load() {
+    auto table = std::make_unique<Table>();
+    const ServerConfig &config = SERVER_CONFIG();
+    table->realm = config.authenticate_realm;
+    const std::string &file = config.user_pass_file;
 
     FileUtil loader(file);
     if (!loader.isOpen()) {
@@ -38,15 +67,16 @@ private:
     } else {
       std::string line;
       while (loader.readLine(line)) {
-        // {user:md5(username:realm:password)}
         size_t pos = line.find_first_of(":");
-        user_pass_.add(line.substr(0, pos), line.substr(pos + 1));
+        table->user_pass[line.substr(0, pos)] = line.substr(pos + 1);
       }
     }
+    return table;
   }
 
-  HttpMap<std::string, std::string> user_pass_;
-  std::string realm_;
+  RcuPtr<Table> current_;
+  // reload() runs on the event loop only
+  uint64_t generation_ = 0;
 };
 
 } // namespace http
@@ -0,0 +1,50 @@
+#ifndef SOC_HTTP_HTTPPATHPARAMS_H
+#define SOC_HTTP_HTTPPATHPARAMS_H
+
+#include <array>
+#include <optional>
+#include <string_view>
+
+namespace soc {
+namespace http {
+
+// Path parameters captured by HttpRouter, such as {id} in "/user/{id:int}".
+// Names point into the frozen routing table and values point into the request
+// url, so capturing a parameter never allocates
+class HttpPathParams {
+public:
+  static constexpr size_t kMaxParams = 8;
+
+  void clear() noexcept { n_ = 0; }
+  bool push(std::string_view name, std::string_view value) noexcept {
+    if (n_ == kMaxParams)
+      return false;
+    params_[n_++] = {name, value};
+    return true;
+  }
+  void pop() noexcept {
+    if (n_ > 0)
+      n_--;
+  }
+
+  size_t size() const noexcept { return n_; }
+  bool empty() const noexcept { return n_ == 0; }
+
+  std::optional<std::string_view> get(std::string_view name) const noexcept {
+    for (size_t i = 0; i < n_; ++i)
+      if (params_[i].first == name)
+        return params_[i].second;
+    return std::nullopt;
+  }
+  std::string_view name(size_t i) const noexcept { return params_[i].first; }
+  std::string_view value(size_t i) const noexcept { return params_[i].second; }
+
+private:
+  std::array<std::pair<std::string_view, std::string_view>, kMaxParams> params_;
+  size_t n_ = 0;
+};
+
+} // namespace http
+} // namespace soc
+
+#endif
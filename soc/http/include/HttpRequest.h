@@ -4,8 +4,10 @@
 #include "HttpAuth.h"
 #include "HttpCookie.h"
 #include "HttpMultiPart.h"
+#include "HttpPathParams.h"
 #include "HttpSession.h"
 #include "HttpSessionServer.h"
+#include "HttpTrace.h"
 namespace soc {
 namespace http {
 
@@ -38,8 +40,12 @@ public:
   const HttpMultiPart &getMultiPart() const noexcept { return multipart_; }
   const std::string &getQueryString() const noexcept { return query_s_; }
   const std::string &getUrl() const noexcept { return url_; }
+  // the request target as sent by the client
+  const std::string &getRawUrl() const noexcept { return req_url_; }
   const std::string &getPhpMessage() const noexcept { return php_message_; }
   std::string getFullUrl() const noexcept;
+  // CLOCK_MONOTONIC microseconds when the first bytes of the request arrived
+  uint64_t getArrivalTime() const noexcept { return arrival_; }
 
   bool hasQueryString() const noexcept { return !query_.empty(); }
   bool hasForm() const noexcept { return !form_.empty(); }
@@ -63,8 +69,16 @@ public:
   const std::vector<std::string> &getMatchResult() const noexcept {
     return match_;
   }
+  const HttpPathParams &getPathParams() const noexcept { return params_; }
+  std::optional<std::string_view> getPathParam(std::string_view name) const {
+    return params_.get(name);
+  }
 
   HttpAuth *getAuth() const noexcept { return auth_; }
+  // set when the body was streamed, see HttpService::doJsonStream
+  libjson::JsonSaxHandler *getJsonHandler() const noexcept {
+    return json_handler_.get();
+  }
   HttpSession *getSession() const;
 
   RetCode parseRequest();
@@ -81,6 +95,7 @@ private:
   void parseCookie();
   void parseMultiPartData();
   void parseAuthorization();
+  void openJsonStream();
 
   void parseKeyValue(std::string_view, const std::string_view &,
                      const std::string_view &,
@@ -101,6 +116,7 @@ private:
   RetCode ret_code_;
   HttpCookie cookies_;
   net::InetAddress remote_addr_;
+  uint64_t arrival_;
 
   bool keepalive_;
   bool compressed_;
@@ -108,10 +124,18 @@ private:
   bool has_cookies_;
 
   HttpAuth *auth_;
-  mutable HttpSession *session_;
+  std::unique_ptr<libjson::JsonSaxHandler> json_handler_;
+  std::unique_ptr<libjson::JsonSaxParser> json_parser_;
+  // bytes of the streamed body still to come
+  size_t body_remaining_;
+  // keeps an expired or evicted session valid until the request is done
+  mutable std::shared_ptr<HttpSession> session_;
 
   mutable std::vector<std::string> match_;
+  mutable HttpPathParams params_;
   mutable std::string php_message_;
+  // phase boundaries, marked by HttpServer when tracing is configured
+  mutable HttpTrace trace_;
 
   HttpMap<std::string, std::string> query_;
   HttpMap<std::string, std::string> form_;
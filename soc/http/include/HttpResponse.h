@@ -5,6 +5,7 @@
 #include "../../libjson/include/JsonFormatter.h"
 #include "../../libjson/include/JsonParser.h"
 #include "HttpRequest.h"
+#include "HttpResponseHeader.h"
 
 namespace soc {
 namespace http {
@@ -30,17 +31,21 @@ public:
   }
 
   HttpResponseBuilder &setHeader(const HttpHeader &header) {
-    header_.add(header);
+    header.forEach([this](const auto &k, const auto &v) { header_.set(k, v); });
     return *this;
   }
 
   HttpResponseBuilder &setHeader(const std::string &key,
                                  const std::string &value) {
-    header_.add(key, value);
+    header_.set(key, value);
+    return *this;
+  }
+  HttpResponseBuilder &setHeader(HttpHeaderId id, std::string_view value) {
+    header_.set(id, value);
     return *this;
   }
   HttpResponseBuilder &setCookie(const std::string &value) {
-    header_.add("Set-Cookie", value);
+    header_.set(HttpHeaderId::SetCookie, value);
     return *this;
   }
   HttpResponseBuilder &appendBody(const std::string_view &body) {
@@ -66,7 +71,7 @@ public:
     tmp_buffer_.reset();
     file_name_ = filename;
     resp_file_ = true;
-    header_.add("Content-Type", "text/html; charset=utf-8");
+    header_.set(HttpHeaderId::ContentType, "text/html; charset=utf-8");
     return *this;
   }
 
@@ -79,7 +84,17 @@ public:
     } else {
       setBody(root->toString());
     }
-    header_.add("Content-Type", "application/json; charset=utf-8");
+    header_.set(HttpHeaderId::ContentType, "application/json; charset=utf-8");
+    return *this;
+  }
+
+  HttpResponseBuilder &setSendFile(bool on) {
+    sendfile_ = on;
+    return *this;
+  }
+
+  HttpResponseBuilder &setGzip(bool on) {
+    gzip_ = on;
     return *this;
   }
 
@@ -87,13 +102,18 @@ public:
 
   HttpVersion getVersion() const noexcept { return version_; }
   int getCode() const noexcept { return code_; }
+  // bytes of the body put into the response by build()
+  size_t getBodyLength() const noexcept { return body_length_; }
   bool isKeepAlive() const noexcept { return keepalive_; }
-  const HttpHeader &getHeader() const noexcept { return header_; }
+  const HttpResponseHeader &getHeader() const noexcept { return header_; }
   std::string_view getBody() noexcept {
     return std::string_view(tmp_buffer_.peek(), tmp_buffer_.readable());
   }
 
   void build();
+  // Only the status line and headers, the body follows in pieces. Returns
+  // true when the pieces must be sent with chunked transfer coding
+  bool buildHeader();
   net::TcpConnection *connection() const { return conn_; }
 
 private:
@@ -105,13 +125,18 @@ private:
   std::string file_name_;
 
   HttpVersion version_;
-  HttpHeader header_;
+  HttpResponseHeader header_;
   HttpMethod method_;
 
   bool resp_file_;
   bool keepalive_;
   bool compressed_;
+  bool sendfile_;
+  bool gzip_;
+  // the request failed Digest only because of its nonce
+  bool stale_;
   int code_;
+  size_t body_length_;
 
   net::Buffer tmp_buffer_;
   net::TcpConnection *conn_;
@@ -131,11 +156,14 @@ public:
   }
 
   HttpVersion getVersion() const noexcept { return builder_->getVersion(); }
-  const HttpHeader &getHeader() const noexcept { return builder_->getHeader(); }
+  const HttpResponseHeader &getHeader() const noexcept {
+    return builder_->getHeader();
+  }
   int getCode() const noexcept { return builder_->getCode(); }
 
   HttpResponse &setContentType(const std::string &content_type) {
-    return setHeader("Content-Type", content_type);
+    builder_->setHeader(HttpHeaderId::ContentType, content_type);
+    return *this;
   }
   HttpResponse &setVersion(HttpVersion version) {
     builder_->setVersion(version);
@@ -188,9 +216,13 @@ public:
 
 private:
   void send();
+  bool sendHeader();
 
 private:
   HttpResponseBuilder *builder_;
+  // the response is completed later, e.g. by php-fpm, and the connection
+  // stays suspended until then
+  bool suspended_;
 };
 } // namespace http
 } // namespace soc
@@ -0,0 +1,80 @@
+#ifndef SOC_HTTP_HTTPRESPONSEHEADER_H
+#define SOC_HTTP_HTTPRESPONSEHEADER_H
+
+#include "../../net/include/Buffer.h"
+#include "HttpUtil.h"
+#include <functional>
+#include <optional>
+
+namespace soc {
+namespace http {
+
+// Well-known response headers, so that the common ones are found without
+// comparing strings
+enum class HttpHeaderId : uint8_t {
+  Server,
+  Date,
+  ContentType,
+  ContentLength,
+  ContentEncoding,
+  Connection,
+  LastModified,
+  Location,
+  SetCookie,
+  WWWAuthenticate,
+  TransferEncoding,
+  CacheControl,
+  Other
+};
+
+// Response header fields kept in a flat vector in insertion order and
+// serialized straight into the send buffer.
+// Unlike HttpHeader it has no lock, a response is only built by one thread
+class HttpResponseHeader {
+public:
+  using Callback = std::function<void(std::string_view, std::string_view)>;
+
+  struct Entry {
+    HttpHeaderId id;
+    // only used by HttpHeaderId::Other
+    std::string name;
+    std::string value;
+  };
+
+  HttpResponseHeader() { entries_.reserve(8); }
+
+  static HttpHeaderId lookup(std::string_view name) noexcept;
+  static std::string_view name(HttpHeaderId id) noexcept;
+
+  // Replace the value of an existing field, Set-Cookie is always appended
+  void set(HttpHeaderId id, std::string_view value);
+  void set(std::string_view name, std::string_view value);
+  void remove(HttpHeaderId id);
+  void remove(std::string_view name);
+
+  const std::string *get(HttpHeaderId id) const noexcept;
+  std::optional<std::string> get(std::string_view name) const;
+  bool contain(HttpHeaderId id) const noexcept { return get(id) != nullptr; }
+  bool contain(std::string_view name) const { return get(name).has_value(); }
+
+  size_t size() const noexcept { return entries_.size(); }
+  bool empty() const noexcept { return entries_.empty(); }
+  void clear() noexcept { entries_.clear(); }
+  void forEach(const Callback &callback) const;
+
+  // "Name: value\r\n" for every field, plus Date when it is not set
+  void store(net::Buffer *sender) const;
+
+private:
+  Entry *find(HttpHeaderId id, std::string_view name) noexcept;
+
+  std::vector<Entry> entries_;
+};
+
+// Status line such as "HTTP/1.1 200 OK\r\n", precomputed for every known code
+std::string_view statusLine(HttpVersion version, int code);
+
+} // namespace http
+} // namespace soc
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef SOC_HTTP_HTTPROUTER_H
+#define SOC_HTTP_HTTPROUTER_H
+
+#include "HttpPathParams.h"
+#include <atomic>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace soc {
+namespace http {
+
+class BaseService;
+class HttpService;
+
+// Routing table for HttpServer.
+// Routes are registered before the server starts and compiled by freeze()
+// into an immutable radix tree, so lookups take no lock and never allocate.
+//
+// Route syntax:
+//   /index.html            static route
+//   /user/{name}           parameter, matches one non-empty path segment
+//   /user/{id:int}         typed parameter, matches digits only
+//   /static/{path:*}       wildcard, matches the rest of the path
+//   /static/*              unnamed wildcard
+// Static edges are preferred over parameters and parameters over wildcards.
+//
+// Regex url-patterns are kept apart, compiled once by freeze() and only tried
+// in registration order when the radix tree has no match.
+class HttpRouter {
+public:
+  enum class ParamType { String, Int, Wildcard };
+
+  using MatchGroup = std::vector<std::string>;
+
+  HttpRouter() : root_(nullptr) {}
+  ~HttpRouter();
+
+  // Registration, only takes effect before freeze()
+  bool add(const std::string &route, BaseService *service);
+  bool remove(const std::string &route);
+  bool addPattern(const std::string &pattern, HttpService *service);
+  bool removePattern(const std::string &pattern);
+
+  void freeze();
+  bool frozen() const noexcept {
+    return root_.load(std::memory_order_acquire) != nullptr;
+  }
+
+  BaseService *find(std::string_view path, HttpPathParams &params) const;
+  HttpService *findPattern(std::string_view path, MatchGroup &match) const;
+
+private:
+  struct Node {
+    std::string prefix;
+    // first byte of every static child, in the same order as children
+    std::string indices;
+    std::vector<std::unique_ptr<Node>> children;
+    std::unique_ptr<Node> param;
+    std::unique_ptr<Node> wildcard;
+
+    std::string name;
+    ParamType type = ParamType::String;
+    BaseService *service = nullptr;
+  };
+
+  struct Pattern {
+    std::regex regex;
+    // literal text following a leading '^', used to reject urls cheaply
+    std::string anchor;
+    HttpService *service;
+  };
+
+  bool insert(Node *node, std::string_view route, BaseService *service);
+  const Node *match(const Node *node, std::string_view path,
+                    HttpPathParams &params) const;
+
+  static bool matchType(ParamType type, std::string_view segment) noexcept;
+
+private:
+  std::atomic<Node *> root_;
+  std::vector<Pattern> compiled_;
+
+  std::vector<std::pair<std::string, BaseService *>> routes_;
+  std::vector<std::pair<std::string, HttpService *>> patterns_;
+};
+
+} // namespace http
+} // namespace soc
+
+#endif
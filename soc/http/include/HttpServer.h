@@ -1,8 +1,15 @@
 #ifndef SOC_HTTP_HTTPSERVER_H
 #define SOC_HTTP_HTTPSERVER_H
 
+#include "../../modules/php-fastcgi/include/FastCgiPool.h"
 #include "../../net/include/TcpServer.h"
+#include "../../utility/include/RcuPtr.h"
+#include "HttpAccessLog.h"
+#include "HttpMount.h"
+#include "HttpRouter.h"
 #include "HttpService.h"
+#include "HttpSessionSnapshot.h"
+#include "HttpTrace.h"
 
 using namespace soc;
 using namespace soc::net;
@@ -25,7 +32,12 @@ public:
   void start();
   void quit();
 
+  // Mount directories must be added before start(), a request is served from
+  // the mount with the longest matching url prefix. Mounts without options
+  // follow default_page and enable_sendfile of the config
   void addMountDir(const std::string &url, const std::string &dir);
+  void addMountDir(const std::string &url, const std::string &dir,
+                   const HttpMountOptions &options);
 
   template <class ErrorService> void setErrorService() {
     if constexpr (std::is_base_of_v<HttpErrorService, ErrorService>) {
@@ -33,57 +45,143 @@ public:
     }
   }
 
+  // Services are routed by HttpRouter and must be registered before start(),
+  // the url may contain path parameters such as "/user/{id:int}"
   template <class Service> void addService(const std::string &url) {
     if constexpr (std::is_base_of_v<HttpService, Service>) {
-      services_.add(url, std::make_shared<Service>());
+      auto service = std::make_shared<Service>();
+      if (router_.add(url, service.get()))
+        services_.add(url, service);
     }
   }
 
   template <class Service>
   void addUrlPatternService(const std::string &url_pattern) {
     if constexpr (std::is_base_of_v<HttpService, Service>) {
-      urlp_services_.add(url_pattern, std::make_shared<Service>());
+      auto service = std::make_shared<Service>();
+      if (router_.addPattern(url_pattern, service.get()))
+        urlp_services_.add(url_pattern, service);
     }
   }
 
   void removeErrorService() { setErrorService<DefaultErrorService>(); }
-  void removeService(const std::string &url) { services_.remove(url); }
+  void removeService(const std::string &url) {
+    if (router_.remove(url))
+      services_.remove(url);
+  }
   void removeUrlPatternService(const std::string &url_pattern) {
-    urlp_services_.remove(url_pattern);
+    if (router_.removePattern(url_pattern))
+      urlp_services_.remove(url_pattern);
   }
 
 private:
+  struct PhpTask;
+
   void initialize();
-  bool onMessage(TcpConnection *);
+  // SIGHUP: config file, password store and mount tables
+  void reload();
+  void setLogging(const ServerConfig &);
+  bool buildMounts();
+  TcpServer::MessageStatus onMessage(TcpConnection *);
+  void onClose(TcpConnection *);
+  void finishRequest(HttpRequest *, HttpResponse &, uint32_t upstream = 0);
+  // Metrics and the access log of a finished request
+  void accountRequest(const HttpRequest &, int status, uint64_t bytes,
+                      uint32_t upstream);
+  // Hand a finished request to the tracer. Unless its response is already
+  // written, the trace waits for the send buffer to drain
+  void traceRequest(const HttpRequest &, int fd, int status, bool written);
+  void onWriteComplete(TcpConnection *);
   BaseService *getErrorService() const;
 
   bool dispatchMountDir(const HttpRequest &, HttpResponse &);
   bool dispatchUrlPattern(const HttpRequest &, HttpResponse &);
-  void dispatchPhpProcessor(const std::string &, const HttpRequest &,
-                            HttpResponse &);
-  bool dispatchFile(std::string_view, std::string_view, std::string,
-                    const HttpRequest &, HttpResponse &);
+  void dispatchPhpProcessor(const HttpMount &, const std::string &,
+                            const HttpRequest &, HttpResponse &);
+  void sendPhpRequest(PhpFastCgi &, const PhpTask &);
+  FastCgiPool::Connection acquireUpstream(const std::shared_ptr<PhpTask> &,
+                                          bool &pending);
+  void onUpstreamAcquired(const std::shared_ptr<PhpTask> &,
+                          const FastCgiPool::Connection &);
+  void startPhpTask(const std::shared_ptr<PhpTask> &,
+                    const FastCgiPool::Connection &);
+  bool retryPhpTask(const std::shared_ptr<PhpTask> &);
+  void onUpstreamEvent(const FastCgiPool::Connection &, int events);
+  void armUpstream(const FastCgiPool::Connection &);
+  void dropUpstream(const FastCgiPool::Connection &);
+  void onPhpOutput(const std::shared_ptr<PhpTask> &,
+                   const FastCgiPool::Connection &,
+                   FastCgiConnection::Response &);
+  void startStreaming(const std::shared_ptr<PhpTask> &,
+                      FastCgiConnection::Response &);
+  void relayResponseBody(const std::shared_ptr<PhpTask> &, const char *data,
+                         size_t len);
+  void onClientEvent(const std::shared_ptr<PhpTask> &, int events);
+  bool readingRequestBody(const PhpTask &);
+  void forwardRequestBody(const std::shared_ptr<PhpTask> &);
+  void onRequestBodyDrained(const std::shared_ptr<PhpTask> &);
+  void flushClient(const std::shared_ptr<PhpTask> &,
+                   std::unique_lock<std::mutex> &);
+  void armClient(const std::shared_ptr<PhpTask> &);
+  void finishPhpTask(const std::shared_ptr<PhpTask> &, int code,
+                     FastCgiConnection::Response *);
+  size_t applyPhpHeader(FastCgiConnection::Response &, HttpResponse &);
+  void applyPhpResponse(FastCgiConnection::Response &, const HttpRequest &,
+                        HttpResponse &);
+  bool dispatchFile(const HttpMount &, std::string_view, const HttpRequest &,
+                    HttpResponse &);
 
   std::string mappingMimeType(const std::string_view &);
-  bool getIndexPageFileName(std::string &);
+  bool getIndexPageFileName(const HttpMount &, std::string &);
 
   void setIdleTime(int millsecond);
   void setCertificate(const std::string &cert_file,
                       const std::string &private_key_file,
                       const std::string &password = "");
 
-  HttpSession *createSession();
+  std::shared_ptr<HttpSession> createSession();
   void associateRequestSession(const HttpRequest &, HttpResponse &);
 
-  HttpSession *associateSession(HttpRequest *) override;
-  void handleSessionTimeout(HttpSession *);
+  std::shared_ptr<HttpSession> associateSession(HttpRequest *) override;
+  std::unique_ptr<libjson::JsonSaxHandler>
+  openJsonStream(HttpRequest *) override;
+  void scheduleSessionSweep();
+  void handleSessionSweep();
 
 private:
   std::unique_ptr<TcpServer> server_;
-  std::vector<std::string> default_pages_;
-
-  HttpMap<std::string, std::string> mount_dir_;
-  HttpMap<std::string, std::shared_ptr<HttpSession>> sessions_;
+  HttpMountOptions default_mount_;
+  HttpRouter router_;
+
+  struct MountDir {
+    std::string url;
+    std::string dir;
+    // the config defaults when empty
+    std::optional<HttpMountOptions> options;
+  };
+  std::vector<MountDir> mount_dirs_;
+  // rebuilt from mount_dirs_ by a reload, a replaced table is freed once no
+  // request points into it
+  RcuPtr<HttpMountTable> mounts_;
+  std::unique_ptr<FastCgiPool> php_pool_;
+  // the file Logger writes to, empty for stdout
+  std::string log_file_;
+  // when access_log is configured
+  std::unique_ptr<HttpAccessLog> access_log_;
+  // when trace_file is configured, with the traces of responses being
+  // written by connection fd
+  std::unique_ptr<HttpTracer> tracer_;
+  HttpMap<int, HttpTracer::Entry> pending_traces_;
+  // in-flight PHP requests by client connection fd
+  HttpMap<int, std::shared_ptr<PhpTask>> php_tasks_;
+
+  std::unique_ptr<HttpSessionStore> sessions_;
+  // Metrics reader of sessions_->size()
+  size_t sessions_gauge_ = SIZE_MAX;
+  // sessions of the previous run, when session_snapshot is configured
+  std::unique_ptr<HttpSessionSnapshot> session_snapshot_;
+  // a sweep of expired sessions is scheduled
+  std::atomic<bool> session_sweep_;
   HttpMap<std::string, std::shared_ptr<BaseService>> services_;
   HttpMap<std::string, std::shared_ptr<HttpService>> urlp_services_;
 };
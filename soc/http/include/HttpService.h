@@ -28,6 +28,15 @@ public:
   virtual void doPost(const HttpRequest &req, HttpResponse &resp) {
     resp.setCode(HttpStatus::METHOD_NOT_ALLOWED);
   }
+  // Called once the header of a POST with an application/json body and a
+  // Content-Length has arrived. A returned handler gets the body as parse
+  // events while it is read, in place of getPostData(), and doPost() finds
+  // it with req.getJsonHandler() after the last one. A syntax error or a
+  // JsonError thrown by the handler ends the request with 400
+  virtual std::unique_ptr<libjson::JsonSaxHandler>
+  doJsonStream(const HttpRequest &req) {
+    return nullptr;
+  }
 
 private:
   void service(const HttpRequest &req, HttpResponse &resp) override;
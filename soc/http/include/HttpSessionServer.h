@@ -1,6 +1,8 @@
 #ifndef SOC_HTTP_HTTPSESSIONSERVER_H
 #define SOC_HTTP_HTTPSESSIONSERVER_H
+#include "../../libjson/include/JsonSaxParser.h"
 #include "../../net/include/TcpConnection.h"
+#include <memory>
 namespace soc {
 namespace http {
 class HttpSession;
@@ -9,7 +11,12 @@ class HttpSessionServer {
 public:
   virtual ~HttpSessionServer() {}
 
-  virtual HttpSession *associateSession(HttpRequest *) = 0;
+  virtual std::shared_ptr<HttpSession> associateSession(HttpRequest *) = 0;
+  // The handler of the service routed for an application/json body
+  virtual std::unique_ptr<libjson::JsonSaxHandler>
+  openJsonStream(HttpRequest *) {
+    return nullptr;
+  }
 };
 
 } // namespace http
@@ -0,0 +1,51 @@
+#ifndef SOC_HTTP_HTTPSESSIONSNAPSHOT_H
+#define SOC_HTTP_HTTPSESSIONSNAPSHOT_H
+
+#include "HttpSessionStore.h"
+
+namespace soc {
+namespace http {
+
+// Sessions written to a file at shutdown and picked up again after a
+// restart. The file holds an open-addressing table of record offsets keyed by
+// session id, so opening it is a single mmap() and a session is only decoded
+// when its client comes back. Attributes of type std::string, bool, int,
+// long, long long, unsigned, double and float are kept, others are dropped
+class HttpSessionSnapshot {
+public:
+  explicit HttpSessionSnapshot(const std::string &path);
+  ~HttpSessionSnapshot();
+
+  // Map the snapshot of the previous run, false when there is none
+  bool open();
+  // Decode and forget the session with this id, nullptr when it is not in
+  // the snapshot or has expired
+  std::shared_ptr<HttpSession> take(const std::string &id);
+  // Replace the file with the sessions of the store and the sessions of the
+  // previous snapshot that were never taken
+  bool save(const HttpSessionStore &store);
+
+private:
+  struct Header;
+  struct Record;
+
+  const Header *header() const;
+  uint64_t *slots() const;
+  bool decode(uint64_t offset, Record &record) const;
+  std::shared_ptr<HttpSession> restore(const Record &record) const;
+  static void encode(std::string &out, const HttpSession &session,
+                     uint64_t expires);
+
+private:
+  std::string path_;
+  std::mutex mutex_;
+  // private writable mapping, taken sessions are cleared from its table
+  // without touching the file
+  char *data_;
+  size_t size_;
+};
+
+} // namespace http
+} // namespace soc
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SOC_HTTP_HTTPSESSIONSTORE_H
+#define SOC_HTTP_HTTPSESSIONSTORE_H
+
+#include "HttpSession.h"
+#include <list>
+#include <memory>
+
+namespace soc {
+namespace http {
+
+// Sessions split into shards by id, each shard with its own lock and an LRU
+// list. Accessing a session moves it to the front and pushes its deadline
+// back, so for sessions of equal lifetime the LRU order is also the expiry
+// order: expired sessions are dropped from the back of a shard when the shard
+// is used and by sweep(), without a timer per session. With a capacity, the
+// least recently used session of a full shard is evicted
+class HttpSessionStore {
+public:
+  // capacity 0 keeps any number of sessions
+  explicit HttpSessionStore(size_t capacity = 0);
+
+  // nullptr when the session does not exist, expired or was invalidated
+  std::shared_ptr<HttpSession> get(const std::string &id);
+  void add(const std::shared_ptr<HttpSession> &session);
+  void remove(const std::string &id);
+
+  // Drop every expired session, returns how many were dropped
+  size_t sweep();
+  // Visit the live sessions with the milliseconds they have left
+  void forEach(const std::function<void(const std::shared_ptr<HttpSession> &,
+                                        uint64_t)> &callback) const;
+  size_t size() const;
+  bool empty() const { return size() == 0; }
+  void clear();
+
+private:
+  struct Node {
+    std::string id;
+    std::shared_ptr<HttpSession> session;
+    // monotonic milliseconds
+    uint64_t deadline;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    // most recently used first
+    std::list<Node> lru;
+    std::unordered_map<std::string, std::list<Node>::iterator> index;
+  };
+
+  Shard &shardOf(const std::string &id);
+  // Drop at most limit expired sessions from the back of the shard
+  size_t expire(Shard &shard, uint64_t now, size_t limit);
+  void erase(Shard &shard, std::list<Node>::iterator it);
+  static uint64_t deadlineOf(const HttpSession &session, uint64_t now);
+
+private:
+  static constexpr size_t kShards = 16;
+  Shard shards_[kShards];
+  // per shard, 0 without a limit
+  size_t shard_capacity_;
+};
+
+} // namespace http
+} // namespace soc
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SOC_HTTP_HTTPTRACE_H
+#define SOC_HTTP_HTTPTRACE_H
+
+#include "../../net/include/TimeStamp.h"
+#include "HttpUtil.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace soc {
+namespace http {
+
+// Phase boundaries of a request in CLOCK_MONOTONIC microseconds, 0 when the
+// request did not pass the boundary. A phase is named after the boundary it
+// ends at and begins at the previous boundary that was passed
+struct HttpTrace {
+  enum Phase {
+    // the first read of the request was queued
+    Arrival,
+    // the read completing the request was queued, ends "receive"
+    Ready,
+    // a pool thread picked that read up, ends "queue"
+    Start,
+    Parsed,
+    Routed,
+    // the service or file handler returned, ends "handler"
+    Handled,
+    // the response was built and queued for sending, ends "response"
+    Built,
+    // the send buffer drained, ends "write"
+    Written,
+    kPhases
+  };
+
+  uint64_t at[kPhases] = {};
+
+  void mark(Phase phase) { at[phase] = net::TimeStamp::monotonicMicros(); }
+};
+
+// Requests slower than the threshold are appended to a file in the Chrome
+// trace event format, loadable in chrome://tracing or Perfetto. One of every
+// `sample` slow requests is written, each as a span per phase on a track
+// named after its connection. The file is a JSON array left open, which the
+// viewers accept, so it stays valid while the server runs
+class HttpTracer {
+public:
+  struct Entry {
+    HttpTrace trace;
+    std::string url;
+    HttpMethod method;
+    int status;
+    int fd;
+  };
+
+  HttpTracer(const std::string &path, uint32_t threshold_us, uint32_t sample);
+  ~HttpTracer();
+
+  void record(const Entry &entry);
+
+private:
+  std::mutex mutex_;
+  int fd_;
+  uint32_t threshold_;
+  uint32_t sample_;
+  std::atomic<uint64_t> slow_;
+};
+
+} // namespace http
+} // namespace soc
+
+#endif
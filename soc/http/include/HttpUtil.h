@@ -1,6 +1,9 @@
 #ifndef SOC_HTTP_HTTPUTIL_H
 #define SOC_HTTP_HTTPUTIL_H
 
+#include <string_view>
+#include <unordered_map>
+
 namespace soc {
 namespace http {
 
@@ -0,0 +1,107 @@
+#include "../include/HttpAccessLog.h"
+#include "../../net/include/TimeStamp.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace soc::http;
+
+// The segment of one thread, closed when the thread exits
+struct HttpAccessLog::Segment {
+  const HttpAccessLog *owner = nullptr;
+  int fd = -1;
+  char *data = nullptr;
+  size_t length = 0;
+  // records
+  size_t capacity = 0;
+  size_t count = 0;
+
+  ~Segment() { close(); }
+
+  void close() {
+    if (fd < 0)
+      return;
+    ::munmap(data, length);
+    // drop the unused tail
+    ::ftruncate(fd, sizeof(HttpAccessSegmentHeader) +
+                        count * sizeof(HttpAccessRecord));
+    ::close(fd);
+    fd = -1;
+    data = nullptr;
+  }
+};
+
+HttpAccessLog::HttpAccessLog(const std::string &prefix, size_t segment_bytes)
+    : prefix_(prefix), segment_bytes_(segment_bytes), sequence_(0),
+      failed_(false) {
+  // at least one record
+  if (segment_bytes_ <
+      sizeof(HttpAccessSegmentHeader) + sizeof(HttpAccessRecord))
+    segment_bytes_ =
+        sizeof(HttpAccessSegmentHeader) + sizeof(HttpAccessRecord);
+}
+
+uint64_t HttpAccessLog::now() {
+  return soc::net::TimeStamp::monotonicMicros();
+}
+
+bool HttpAccessLog::openSegment(Segment &segment) {
+  segment.close();
+  // logging stops after a failure instead of retrying on every request
+  if (failed_.load(std::memory_order_relaxed))
+    return false;
+  std::string path = prefix_ + "." + std::to_string(::getpid()) + "-" +
+                     std::to_string(sequence_.fetch_add(1));
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0 || ::ftruncate(fd, segment_bytes_) < 0) {
+    if (!failed_.exchange(true))
+      fprintf(stderr, "Create access log failed: %s: %s\n", path.c_str(),
+              ::strerror(errno));
+    if (fd >= 0)
+      ::close(fd);
+    return false;
+  }
+  void *p =
+      ::mmap(nullptr, segment_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    if (!failed_.exchange(true))
+      fprintf(stderr, "Map access log failed: %s\n", ::strerror(errno));
+    ::close(fd);
+    return false;
+  }
+
+  HttpAccessSegmentHeader header{};
+  ::memcpy(header.magic, HttpAccessSegmentHeader::kMagic,
+           sizeof(header.magic));
+  header.version = HttpAccessSegmentHeader::kVersion;
+  header.record_size = sizeof(HttpAccessRecord);
+  timespec ts;
+  ::clock_gettime(CLOCK_REALTIME, &ts);
+  header.created = ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  ::memcpy(p, &header, sizeof(header));
+
+  segment.owner = this;
+  segment.fd = fd;
+  segment.data = (char *)p;
+  segment.length = segment_bytes_;
+  segment.capacity = (segment_bytes_ - sizeof(HttpAccessSegmentHeader)) /
+                     sizeof(HttpAccessRecord);
+  segment.count = 0;
+  return true;
+}
+
+void HttpAccessLog::write(const HttpAccessRecord &record) {
+  thread_local Segment segment;
+  if (segment.owner != this || segment.count == segment.capacity) {
+    if (!openSegment(segment))
+      return;
+  }
+  ::memcpy(segment.data + sizeof(HttpAccessSegmentHeader) +
+               segment.count * sizeof(HttpAccessRecord),
+           &record, sizeof(record));
+  ++segment.count;
+}
@@ -0,0 +1,131 @@
+#include "../include/HttpAuth.h"
+#include "../include/HttpNonceStore.h"
+
+using namespace soc;
+using namespace soc::http;
+
+HttpAuthCache &HttpAuthCache::credentials() {
+  thread_local HttpAuthCache cache;
+  // a reloaded password file may have changed or removed any of them
+  uint64_t generation = HttpPassStore::instance().generation();
+  if (cache.generation_ != generation) {
+    cache.clear();
+    cache.generation_ = generation;
+  }
+  return cache;
+}
+
+HttpAuthCache &HttpAuthCache::digests() {
+  thread_local HttpAuthCache cache;
+  return cache;
+}
+
+const std::string *HttpAuthCache::get(const std::string &key) const {
+  auto x = map_.find(key);
+  return x == map_.end() ? nullptr : &x->second;
+}
+
+void HttpAuthCache::clear() {
+  map_.clear();
+  order_.clear();
+  next_ = 0;
+}
+
+void HttpAuthCache::put(const std::string &key, const std::string &value) {
+  if (map_.count(key))
+    return;
+  if (order_.size() < kCapacity) {
+    order_.push_back(key);
+  } else {
+    map_.erase(order_[next_]);
+    order_[next_] = key;
+    next_ = (next_ + 1) % kCapacity;
+  }
+  map_.emplace(key, value);
+}
+
+HttpBasicAuth::HttpBasicAuth(std::string_view token) {
+  std::string key(token);
+  std::string user_pass;
+  const std::string *cached = HttpAuthCache::credentials().get(key);
+  if (cached)
+    user_pass = *cached;
+  else
+    user_pass = EncodeUtil::base64Decode(token);
+
+  size_t pos = user_pass.find_first_of(":");
+  if (pos == std::string::npos)
+    return;
+  user_ = user_pass.substr(0, pos);
+  pass_ = user_pass.substr(pos + 1);
+  if (cached) {
+    verify_successed_ = true;
+    return;
+  }
+
+  auto x = HttpPassStore::instance().fetch(user_);
+  // user authentication succeeded
+  if (x.has_value()) {
+    std::string hashv =
+        user_ + ":" + HttpPassStore::instance().getRealm() + ":" + pass_;
+    verify_successed_ = EncodeUtil::md5HashEqual(hashv, x.value());
+    // only verified credentials are kept, so bad guesses cannot evict them
+    if (verify_successed_)
+      HttpAuthCache::credentials().put(key, user_pass);
+  }
+}
+
+HttpDigestAuth::HttpDigestAuth(const std::string &digest_info,
+                               const HttpMap<std::string, std::string> &da)
+    : digest_info_(digest_info) {
+  // h1 = md5(username:realm:password)
+  // h2 = md5(method:uri)
+  // resp = md5(h1:nonce:nc:cnonce:qop:h2)
+
+  auto username = da.get("username");
+  if (!username.has_value())
+    return;
+  // stored as h1
+  auto x = HttpPassStore::instance().fetch(username.value());
+  if (!x.has_value())
+    return;
+
+  auto method = da.get("method");
+  auto uri = da.get("uri");
+  auto nonce = da.get("nonce");
+  auto nc = da.get("nc");
+  auto cnonce = da.get("cnonce");
+  auto qop = da.get("qop");
+  auto response = da.get("response");
+  if (!method.has_value() || !uri.has_value() || !nonce.has_value() ||
+      !response.has_value() || response.value().size() != 32)
+    return;
+
+  // h2
+  std::string a2 = method.value() + ":" + uri.value();
+  const std::string *h2 = HttpAuthCache::digests().get(a2);
+  if (h2 == nullptr) {
+    HttpAuthCache::digests().put(a2, EncodeUtil::md5Hash(a2));
+    h2 = HttpAuthCache::digests().get(a2);
+  }
+
+  // resp
+  std::string buffer = x.value();
+  for (const auto &part : {nonce, nc, cnonce, qop}) {
+    if (part.has_value()) {
+      buffer += ':';
+      buffer += part.value();
+    }
+  }
+  buffer += ':';
+  buffer += *h2;
+  if (!EncodeUtil::md5HashEqual(buffer, response.value()))
+    return;
+
+  // the nonce must be ours, current and its count new, otherwise it is
+  // stale or a replay
+  unsigned long count =
+      nc.has_value() ? ::strtoul(nc.value().c_str(), nullptr, 16) : 0;
+  verify_successed_ = HttpNonceStore::instance().use(nonce.value(), count);
+  stale_ = !verify_successed_;
+}
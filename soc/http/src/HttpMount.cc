@@ -0,0 +1,120 @@
+#include "../include/HttpMount.h"
+#include <algorithm>
+#include <filesystem>
+#include <stdio.h>
+
+using namespace soc::http;
+
+HttpMountTable::~HttpMountTable() {
+  delete root_.load(std::memory_order_acquire);
+}
+
+bool HttpMountTable::add(const std::string &url, const std::string &dir,
+                         const HttpMountOptions &options) {
+  if (root_.load(std::memory_order_acquire))
+    return false;
+
+  std::string prefix = url;
+  if (prefix.empty() || prefix.front() != '/')
+    prefix.insert(prefix.begin(), '/');
+  if (prefix.back() != '/')
+    prefix += "/";
+
+  std::error_code ec;
+  std::string root = std::filesystem::canonical(dir, ec).string();
+  if (ec) {
+    ::fprintf(stderr, "mount directory not found : [%s]\n", dir.c_str());
+    return false;
+  }
+  root += "/";
+
+  auto mount = std::make_unique<HttpMount>();
+  mount->prefix = std::move(prefix);
+  mount->root = std::move(root);
+  mount->options = options;
+
+  // remount the same url prefix
+  for (auto &x : mounts_) {
+    if (x->prefix == mount->prefix) {
+      x = std::move(mount);
+      return true;
+    }
+  }
+  mounts_.emplace_back(std::move(mount));
+  return true;
+}
+
+HttpMountTable::Node *HttpMountTable::Node::child(std::string_view seg) const {
+  auto it = std::lower_bound(
+      children.begin(), children.end(), seg,
+      [](const auto &x, std::string_view s) { return x.first < s; });
+  if (it == children.end() || it->first != seg)
+    return nullptr;
+  return it->second.get();
+}
+
+void HttpMountTable::freeze() {
+  if (root_.load(std::memory_order_acquire))
+    return;
+
+  Node *root = new Node;
+  for (const auto &mount : mounts_) {
+    Node *node = root;
+    std::string_view prefix = mount->prefix;
+    // "/a/b/" => "a", "b"
+    size_t pos = 1;
+    while (pos < prefix.size()) {
+      size_t end = prefix.find('/', pos);
+      std::string_view seg = prefix.substr(pos, end - pos);
+      Node *next = node->child(seg);
+      if (!next) {
+        auto it = std::lower_bound(
+            node->children.begin(), node->children.end(), seg,
+            [](const auto &x, std::string_view s) { return x.first < s; });
+        it = node->children.emplace(it, std::string(seg),
+                                    std::make_unique<Node>());
+        next = it->second.get();
+      }
+      node = next;
+      pos = end + 1;
+    }
+    node->mount = mount.get();
+  }
+
+  // link every mount to its nearest ancestor mount
+  std::vector<std::pair<Node *, const HttpMount *>> stack{{root, nullptr}};
+  while (!stack.empty()) {
+    auto [node, parent] = stack.back();
+    stack.pop_back();
+    if (node->mount) {
+      const_cast<HttpMount *>(node->mount)->parent = parent;
+      parent = node->mount;
+    }
+    for (auto &[seg, child] : node->children)
+      stack.emplace_back(child.get(), parent);
+  }
+
+  root_.store(root, std::memory_order_release);
+}
+
+const HttpMount *HttpMountTable::find(std::string_view url) const {
+  const Node *node = root_.load(std::memory_order_acquire);
+  if (!node || url.empty() || url.front() != '/')
+    return nullptr;
+
+  const HttpMount *best = node->mount;
+  size_t pos = 1;
+  while (pos < url.size()) {
+    // only a complete segment followed by '/' can match a mount prefix
+    size_t end = url.find('/', pos);
+    if (end == url.npos)
+      break;
+    node = node->child(url.substr(pos, end - pos));
+    if (!node)
+      break;
+    if (node->mount)
+      best = node->mount;
+    pos = end + 1;
+  }
+  return best;
+}
@@ -0,0 +1,115 @@
+#include "../include/HttpNonceStore.h"
+#include "../../net/include/TimeStamp.h"
+#include "../../utility/include/EncodeUtil.h"
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace soc;
+using namespace soc::http;
+
+namespace {
+// per shard, the oldest used nonce is forgotten beyond this. Its next request
+// is then refused as stale and the client retries with a new nonce
+constexpr size_t kShardCapacity = 4096;
+// nonce = 12 hex digits of issue time, 8 random characters, 32 hex digits of
+// the HMAC over both
+constexpr size_t kStampLength = 20;
+constexpr size_t kNonceLength = kStampLength + 32;
+} // namespace
+
+HttpNonceStore::HttpNonceStore() {
+  if (::RAND_bytes(key_, sizeof(key_)) != 1) {
+    ::fprintf(stderr, "HttpNonceStore: RAND_bytes failed\n");
+    for (auto &c : key_)
+      c = ::rand();
+  }
+}
+
+HttpNonceStore::Shard &HttpNonceStore::shardOf(const std::string &nonce) {
+  return shards_[std::hash<std::string>{}(nonce) % kShards];
+}
+
+std::string HttpNonceStore::sign(std::string_view stamp) const {
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int n = 0;
+  ::HMAC(EVP_sha256(), key_, sizeof(key_),
+         reinterpret_cast<const unsigned char *>(stamp.data()), stamp.size(),
+         md, &n);
+  std::string hex(32, '\0');
+  for (size_t i = 0; i < 16; ++i)
+    ::snprintf(&hex[i * 2], 3, "%02x", md[i]);
+  return hex;
+}
+
+uint64_t HttpNonceStore::issuedAt(const std::string &nonce) const {
+  if (nonce.size() != kNonceLength)
+    return 0;
+  std::string_view stamp(nonce.data(), kStampLength);
+  std::string mac = sign(stamp);
+  // constant time, the tag is the only secret part
+  unsigned char diff = 0;
+  for (size_t i = 0; i < mac.size(); ++i)
+    diff |= mac[i] ^ nonce[kStampLength + i];
+  if (diff != 0)
+    return 0;
+  return ::strtoull(std::string(stamp.substr(0, 12)).c_str(), nullptr, 16);
+}
+
+void HttpNonceStore::expire(Shard &shard, uint64_t now) {
+  while (!shard.order.empty() &&
+         (shard.order.front().first <= now ||
+          shard.order.size() > kShardCapacity)) {
+    shard.counts.erase(shard.order.front().second);
+    shard.order.pop_front();
+  }
+}
+
+std::string HttpNonceStore::issue() {
+  char stamp[kStampLength + 1];
+  char random[8];
+  EncodeUtil::genRandromStr(random);
+  ::snprintf(stamp, sizeof(stamp), "%012llx%.8s",
+             (unsigned long long)net::TimeStamp::loopMonotonic(), random);
+  return stamp + sign(stamp);
+}
+
+bool HttpNonceStore::use(const std::string &nonce, unsigned long nc) {
+  uint64_t issued = issuedAt(nonce);
+  uint64_t now = net::TimeStamp::loopMonotonic();
+  if (issued == 0 || issued + kLifetime <= now)
+    return false;
+  // without counts there is nothing to tell a replay by
+  if (nc == 0)
+    return true;
+
+  Shard &shard = shardOf(nonce);
+  std::lock_guard<std::mutex> locker(shard.mutex);
+  expire(shard, now);
+  auto x = shard.counts.find(nonce);
+  if (x == shard.counts.end()) {
+    // a nonce not seen yet starts near count 1, otherwise it may have been
+    // forgotten and this be a replay
+    if (nc > kWindow)
+      return false;
+    x = shard.counts.emplace(nonce, Counts()).first;
+    shard.order.emplace_back(issued + kLifetime, nonce);
+  }
+
+  Counts &counts = x->second;
+  if (nc > counts.highest) {
+    unsigned long shift = nc - counts.highest;
+    counts.seen = shift >= kWindow ? 0 : counts.seen << shift;
+    counts.seen |= 1;
+    counts.highest = nc;
+    return true;
+  }
+  // a count that was seen before, or too old to tell, is a replay
+  unsigned long age = counts.highest - nc;
+  if (age >= kWindow || (counts.seen >> age) & 1)
+    return false;
+  counts.seen |= uint64_t(1) << age;
+  return true;
+}
@@ -1,11 +1,14 @@
 #include "../include/HttpRequest.h"
+#include "../include/HttpAccessLog.h"
 using namespace soc::http;
 
 HttpRequest::HttpRequest(net::TcpConnection *conn, HttpSessionServer *owner)
     : recver_(conn->getRecver()), owner_(owner),
-      remote_addr_(conn->getPeerAddr()), keepalive_(false), compressed_(false),
+      method_(HttpMethod::GET), version_(HttpVersion::HTTP_1_1),
+      remote_addr_(conn->getPeerAddr()), arrival_(HttpAccessLog::now()),
+      keepalive_(false), compressed_(false),
       has_multipart_(false), has_cookies_(false), auth_(nullptr),
-      session_(nullptr) {
+      body_remaining_(0) {
   reset();
 }
 
@@ -28,23 +31,13 @@ HttpRequest::getHeaderValue(const std::string &key) const {
 }
 
 std::string HttpRequest::getFullUrl() const noexcept {
-  static const bool on_https = GET_CONFIG(bool, "server", "enable_https");
-  static const bool has_host = EXIST_CONFIG("server", "server_hostname");
-  static const std::string schema = on_https ? "https" : "http";
-  static const int port = GET_CONFIG(int, "server", "listen_port");
-  std::string host;
-  if (has_host) {
-    host = GET_CONFIG(std::string, "server", "server_hostname");
-  } else {
-    host = GET_CONFIG(std::string, "server", "listen_ip");
-  }
-  return schema + ":" + "//" + host + ":" + std::to_string(port) +
+  return SERVER_CONFIG().base_url +
          EncodeUtil::urlDecode(req_url_.data(), req_url_.size());
 }
 
 HttpSession *HttpRequest::getSession() const {
   session_ = owner_->associateSession(const_cast<HttpRequest *>(this));
-  return session_;
+  return session_.get();
 }
 
 HttpRequest::RetCode HttpRequest::parseRequest() {
@@ -91,6 +84,7 @@ HttpRequest::RetCode HttpRequest::parseRequest() {
       parseCookie();
       parseMultiPartData();
       parseAuthorization();
+      openJsonStream();
 
       auto code = parseRequestContent();
       if (code == AGAIN_CONTENT)
@@ -180,6 +174,22 @@ HttpRequest::RetCode HttpRequest::parseRequestHeader() {
 }
 
 HttpRequest::RetCode HttpRequest::parseRequestContent() {
+  // application/json body parsed while it arrives, nothing is kept
+  if (json_parser_) {
+    size_t n = std::min(recver_->readable(), body_remaining_);
+    try {
+      json_parser_->feed(recver_->peek(), n);
+      if (n == body_remaining_)
+        json_parser_->finish();
+    } catch (const libjson::JsonError &) {
+      return ret_code_ = BAD_REQUEST;
+    }
+    recver_->retired(n);
+    body_remaining_ -= n;
+    return ret_code_ = body_remaining_ > 0 ? AGAIN_CONTENT
+                                           : REQUEST_CONTENT_DONE;
+  }
+
   std::string_view content(recver_->peek(), recver_->readable());
   post_data_.append(content.data(), content.size());
   // Content-Type
@@ -229,20 +239,30 @@ void HttpRequest::parseMultiPartData() {
   }
 }
 
+void HttpRequest::openJsonStream() {
+  if (method_ != HttpMethod::POST || has_multipart_)
+    return;
+  auto type = header_.get("Content-Type");
+  auto length = header_.get("Content-Length");
+  if (!type.has_value() || !length.has_value() ||
+      !std::string_view(type.value()).starts_with("application/json"))
+    return;
+  size_t n = std::strtoul(length.value().data(), nullptr, 10);
+  if (n == 0)
+    return;
+  json_handler_ = owner_->openJsonStream(this);
+  if (!json_handler_)
+    return;
+  json_parser_ = std::make_unique<libjson::JsonSaxParser>(json_handler_.get());
+  body_remaining_ = n;
+}
+
 void HttpRequest::parseAuthorization() {
   if (auto x = header_.get("Authorization"); x.has_value()) {
     std::string_view auth = x.value();
     if (auth.starts_with("Basic")) {
       auth.remove_prefix(6);
-
-      std::string user_pass = EncodeUtil::base64Decode(auth);
-      std::string_view user_pass_sv(user_pass.data(), user_pass.size());
-
-      size_t pos = user_pass.find_first_of(":");
-      std::string_view user = user_pass_sv.substr(0, pos);
-      std::string_view pass = user_pass_sv.substr(pos + 1);
-
-      auth_ = new HttpBasicAuth(user, pass);
+      auth_ = new HttpBasicAuth(auth);
 
     } else if (auth.starts_with("Digest")) {
       auth.remove_prefix(7);
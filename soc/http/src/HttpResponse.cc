@@ -1,5 +1,7 @@
 #include "../include/HttpResponse.h"
-#include "../../net/include/TimeStamp.h"
+#include "../include/HttpNonceStore.h"
+#include "../../utility/include/Metrics.h"
+#include <charconv>
 
 using namespace soc::http;
 
@@ -8,72 +10,56 @@ HttpResponseBuilder::HttpResponseBuilder(HttpRequest *request,
     : uri_(request->getUrl()), version_(request->getVersion()),
       method_(request->getMethod()), resp_file_(false),
       keepalive_(request->isKeepAlive()), compressed_(request->isCompressed()),
-      code_(HttpStatus::OK), conn_(conn) {
-  header_.add("Server", "socnet");
-  header_.add("Content-Type", "application/octet-stream");
-  header_.add("Date", soc::net::TimeStamp::getServerDate());
+      sendfile_(true), gzip_(true),
+      stale_(request->getAuth() && request->getAuth()->stale()),
+      code_(HttpStatus::OK), body_length_(0), conn_(conn) {
+  header_.set(HttpHeaderId::Server, "socnet");
+  header_.set(HttpHeaderId::ContentType, "application/octet-stream");
   tmp_buffer_.retiredAll();
 }
 
 HttpResponseBuilder &HttpResponseBuilder::setAuthType(HttpAuthType type) {
-  static const std::string realm = HttpPassStore::instance().getRealm();
+  const std::string &realm = HttpPassStore::instance().getRealm();
   code_ = HttpStatus::UNAUTHORIZED;
   char buffer[1024]{0};
   if (type == HttpAuthType::Basic) {
     ::sprintf(buffer, "Basic realm=\"%s\"", realm.data());
   } else if (type == HttpAuthType::Digest) {
-    char nonce[17]{0}, opaque[17]{0};
-    EncodeUtil::genRandromStr(nonce);
+    char opaque[17]{0};
     EncodeUtil::genRandromStr(opaque);
     ::sprintf(buffer,
               "Digest realm=\"%s\", qop=\"auth,auth-int\", nonce=\"%s\", "
-              "opaque=\"%s\"",
-              realm.data(), EncodeUtil::base64Encode(nonce).data(),
-              EncodeUtil::base64Encode(opaque).data());
+              "opaque=\"%s\"%s",
+              realm.data(), HttpNonceStore::instance().issue().data(),
+              EncodeUtil::base64Encode(opaque).data(),
+              stale_ ? ", stale=true" : "");
   }
-  header_.add("WWW-Authenticate", buffer);
-  header_.add("Content-Type", "text/plain; charset=utf-8");
+  header_.set(HttpHeaderId::WWWAuthenticate, buffer);
+  header_.set(HttpHeaderId::ContentType, "text/plain; charset=utf-8");
   return *this;
 }
 
 void HttpResponseBuilder::prepareHeader() {
-  switch (version_) {
-  case HttpVersion::HTTP_1_0:
-    conn_->getSender()->append("HTTP/1.0 ", 9);
-    break;
-  case HttpVersion::HTTP_1_1:
-    conn_->getSender()->append("HTTP/1.1 ", 9);
-    break;
-  case HttpVersion::HTTP_2_0:
-    conn_->getSender()->append("HTTP/2.0 ", 9);
-    break;
-  default:
-    break;
-  }
-
-  std::string code = std::to_string(code_) + " ";
-  conn_->getSender()->append(code.c_str(), code.size());
-
-  std::string_view message = Status_Code.at(code_);
-  conn_->getSender()->append(message.data(), message.size());
-  conn_->getSender()->append("\r\n", 2);
-
-  header_.store(conn_->getSender());
-  conn_->getSender()->append("\r\n", 2);
+  net::Buffer *sender = conn_->getSender();
+  sender->append(statusLine(version_, code_));
+  header_.store(sender);
+  sender->append("\r\n", 2);
 }
 
 void HttpResponseBuilder::makeHeaderPart(size_t content_length) {
   if (version_ == HttpVersion::HTTP_1_0) {
     if (keepalive_) {
-      header_.add("Connection", "keep-alive");
+      header_.set(HttpHeaderId::Connection, "keep-alive");
     } else {
-      header_.add("Connection", "close");
+      header_.set(HttpHeaderId::Connection, "close");
     }
   } else if (!keepalive_) {
-    header_.add("Connection", "close");
+    header_.set(HttpHeaderId::Connection, "close");
   }
   if (keepalive_) {
-    header_.add("Content-Length", std::to_string(content_length));
+    char length[24];
+    auto x = std::to_chars(length, length + sizeof(length), content_length);
+    header_.set(HttpHeaderId::ContentLength, std::string_view(length, x.ptr - length));
   }
 }
 
@@ -84,8 +70,10 @@ void HttpResponseBuilder::build() {
   // */*+text
   // */*+xml
 
-  if (auto x = header_.get("Content-Type"); x.has_value()) {
-    std::string_view type = x.value();
+  if (!gzip_) {
+    compressed_ = false;
+  } else if (auto x = header_.get(HttpHeaderId::ContentType); x) {
+    std::string_view type = *x;
     if (type.starts_with("text") || type.ends_with("xml") ||
         type.ends_with("javascript") || type.ends_with("json")) {
     } else {
@@ -104,11 +92,11 @@ void HttpResponseBuilder::build() {
     long size = st.st_size;
     char mtime[50]{0};
     ::strftime(mtime, 50, "%a, %d %b %Y %H:%M:%S GMT", ::gmtime(&st.st_mtime));
-    setHeader("Last-Modified", mtime);
+    setHeader(HttpHeaderId::LastModified, mtime);
 
     // sendfile()
     // not support dynamic gzip
-    if (conn_->getChannel()->supportSendFile()) {
+    if (sendfile_ && conn_->getChannel()->supportSendFile()) {
       conn_->getChannel()->createSendFileObject(infd, size);
       compressed_ = false;
       putinto_buf = false;
@@ -138,8 +126,14 @@ void HttpResponseBuilder::build() {
   std::vector<uint8_t> out;
   if (compressed_ && sv.second) {
     // sendfile() not support gzip compress
-    header_.add("Content-Encoding", "gzip");
+    header_.set(HttpHeaderId::ContentEncoding, "gzip");
     EncodeUtil::gzipCompress(std::string_view(sv.first, sv.second), out);
+    static const Metrics::Counter gzip_in = Metrics::instance().counter(
+        "socnet_gzip_input_bytes_total", "Response bytes before gzip");
+    static const Metrics::Counter gzip_out = Metrics::instance().counter(
+        "socnet_gzip_output_bytes_total", "Response bytes after gzip");
+    gzip_in.add(sv.second);
+    gzip_out.add(out.size());
     sv.second = out.size();
   }
 
@@ -148,6 +142,7 @@ void HttpResponseBuilder::build() {
   // HEAD method
   if (method_ == HttpMethod::HEAD)
     return;
+  body_length_ = sv.second;
 
   if (compressed_) {
     conn_->getSender()->append<uint8_t>(out.begin(), out.end());
@@ -159,9 +154,31 @@ void HttpResponseBuilder::build() {
   }
 }
 
+bool HttpResponseBuilder::buildHeader() {
+  // Without a Content-Length the body is delimited by chunked transfer
+  // coding, or by closing the connection for HTTP/1.0 clients
+  bool chunked = false;
+  if (!header_.contain(HttpHeaderId::ContentLength)) {
+    if (version_ == HttpVersion::HTTP_1_0)
+      keepalive_ = false;
+    else
+      chunked = true;
+  }
+  if (version_ == HttpVersion::HTTP_1_0) {
+    header_.set(HttpHeaderId::Connection, keepalive_ ? "keep-alive" : "close");
+  } else if (!keepalive_) {
+    header_.set(HttpHeaderId::Connection, "close");
+  }
+  if (chunked)
+    header_.set(HttpHeaderId::TransferEncoding, "chunked");
+  prepareHeader();
+  return chunked;
+}
+
 HttpResponse::HttpResponse(net::TcpConnection *conn)
     : builder_(new HttpResponseBuilder(
-          static_cast<HttpRequest *>(conn->getContext()), conn)) {}
+          static_cast<HttpRequest *>(conn->getContext()), conn)),
+      suspended_(false) {}
 
 void HttpResponse::sendAuth(HttpAuthType type) { builder_->setAuthType(type); }
 
@@ -175,3 +192,11 @@ void HttpResponse::send() {
   builder_->connection()->setKeepAlive(builder_->isKeepAlive());
   builder_->build();
 }
+
+bool HttpResponse::sendHeader() {
+  if (builder_->connection() == nullptr)
+    return false;
+  bool chunked = builder_->buildHeader();
+  builder_->connection()->setKeepAlive(builder_->isKeepAlive());
+  return chunked;
+}
@@ -0,0 +1,195 @@
+#include "../include/HttpResponseHeader.h"
+#include "../../net/include/TimeStamp.h"
+#include <array>
+#include <charconv>
+#include <string.h>
+#include <strings.h>
+
+using namespace soc::http;
+
+namespace {
+constexpr std::string_view kHeaderNames[] = {
+    "Server",        "Date",       "Content-Type",     "Content-Length",
+    "Content-Encoding", "Connection", "Last-Modified", "Location",
+    "Set-Cookie",    "WWW-Authenticate", "Transfer-Encoding", "Cache-Control"};
+
+constexpr int kMinCode = 100;
+constexpr int kMaxCode = 599;
+
+int versionIndex(HttpVersion version) noexcept {
+  switch (version) {
+  case HttpVersion::HTTP_1_0:
+    return 0;
+  case HttpVersion::HTTP_2_0:
+    return 2;
+  default:
+    return 1;
+  }
+}
+
+// "HTTP/1.x <code> <message>\r\n" for every code of Status_Code
+struct StatusLines {
+  static constexpr const char *kVersions[] = {"HTTP/1.0 ", "HTTP/1.1 ",
+                                              "HTTP/2.0 "};
+  std::array<std::string, 3 * (kMaxCode - kMinCode + 1)> lines;
+
+  StatusLines() {
+    for (int v = 0; v < 3; ++v) {
+      for (const auto &[code, message] : Status_Code) {
+        lines[index(v, code)] = std::string(kVersions[v]) +
+                                std::to_string(code) + " " + message + "\r\n";
+      }
+    }
+  }
+  static size_t index(int version, int code) noexcept {
+    return version * (kMaxCode - kMinCode + 1) + (code - kMinCode);
+  }
+};
+} // namespace
+
+HttpHeaderId HttpResponseHeader::lookup(std::string_view name) noexcept {
+  for (size_t i = 0; i < std::size(kHeaderNames); ++i) {
+    if (name.size() == kHeaderNames[i].size() &&
+        ::strncasecmp(name.data(), kHeaderNames[i].data(), name.size()) == 0)
+      return static_cast<HttpHeaderId>(i);
+  }
+  return HttpHeaderId::Other;
+}
+
+std::string_view HttpResponseHeader::name(HttpHeaderId id) noexcept {
+  if (id == HttpHeaderId::Other)
+    return {};
+  return kHeaderNames[static_cast<size_t>(id)];
+}
+
+HttpResponseHeader::Entry *
+HttpResponseHeader::find(HttpHeaderId id, std::string_view name) noexcept {
+  for (auto &entry : entries_) {
+    if (entry.id != id)
+      continue;
+    if (id != HttpHeaderId::Other ||
+        (entry.name.size() == name.size() &&
+         ::strncasecmp(entry.name.data(), name.data(), name.size()) == 0))
+      return &entry;
+  }
+  return nullptr;
+}
+
+void HttpResponseHeader::set(HttpHeaderId id, std::string_view value) {
+  if (id != HttpHeaderId::SetCookie) {
+    if (auto x = find(id, {}); x) {
+      x->value.assign(value.data(), value.size());
+      return;
+    }
+  }
+  entries_.push_back({id, {}, std::string(value.data(), value.size())});
+}
+
+void HttpResponseHeader::set(std::string_view name, std::string_view value) {
+  HttpHeaderId id = lookup(name);
+  if (id != HttpHeaderId::Other)
+    return set(id, value);
+  if (auto x = find(id, name); x) {
+    x->value.assign(value.data(), value.size());
+    return;
+  }
+  entries_.push_back({id, std::string(name.data(), name.size()),
+                      std::string(value.data(), value.size())});
+}
+
+void HttpResponseHeader::remove(HttpHeaderId id) {
+  std::erase_if(entries_, [id](const Entry &e) { return e.id == id; });
+}
+
+void HttpResponseHeader::remove(std::string_view name) {
+  HttpHeaderId id = lookup(name);
+  if (id != HttpHeaderId::Other)
+    return remove(id);
+  std::erase_if(entries_, [&](const Entry &e) {
+    return e.id == id && e.name.size() == name.size() &&
+           ::strncasecmp(e.name.data(), name.data(), name.size()) == 0;
+  });
+}
+
+const std::string *HttpResponseHeader::get(HttpHeaderId id) const noexcept {
+  for (const auto &entry : entries_)
+    if (entry.id == id)
+      return &entry.value;
+  return nullptr;
+}
+
+std::optional<std::string> HttpResponseHeader::get(std::string_view name) const {
+  HttpHeaderId id = lookup(name);
+  for (const auto &entry : entries_) {
+    if (entry.id != id)
+      continue;
+    if (id != HttpHeaderId::Other ||
+        (entry.name.size() == name.size() &&
+         ::strncasecmp(entry.name.data(), name.data(), name.size()) == 0))
+      return entry.value;
+  }
+  return std::nullopt;
+}
+
+void HttpResponseHeader::forEach(const Callback &callback) const {
+  for (const auto &entry : entries_)
+    callback(entry.id == HttpHeaderId::Other ? entry.name : name(entry.id),
+             entry.value);
+}
+
+void HttpResponseHeader::store(net::Buffer *sender) const {
+  if (!sender)
+    return;
+  std::string_view date;
+  size_t total = 0;
+  for (const auto &entry : entries_) {
+    size_t n = entry.id == HttpHeaderId::Other ? entry.name.size()
+                                               : name(entry.id).size();
+    total += n + entry.value.size() + 4;
+  }
+  if (!contain(HttpHeaderId::Date)) {
+    date = net::TimeStamp::getCachedServerDate();
+    total += date.size() + 8;
+  }
+
+  // Reserve once and copy every field directly into the send buffer
+  sender->ensureWritable(total);
+  char *p = sender->beginWrite();
+  auto put = [&p](std::string_view s) {
+    ::memcpy(p, s.data(), s.size());
+    p += s.size();
+  };
+  for (const auto &entry : entries_) {
+    put(entry.id == HttpHeaderId::Other ? std::string_view(entry.name)
+                                        : name(entry.id));
+    put(": ");
+    put(entry.value);
+    put("\r\n");
+  }
+  if (!date.empty()) {
+    put("Date: ");
+    put(date);
+    put("\r\n");
+  }
+  sender->hasWritten(total);
+}
+
+std::string_view soc::http::statusLine(HttpVersion version, int code) {
+  static const StatusLines table;
+  int v = versionIndex(version);
+  if (code >= kMinCode && code <= kMaxCode) {
+    const std::string &line = table.lines[StatusLines::index(v, code)];
+    if (!line.empty())
+      return line;
+  }
+
+  // Status codes without a reason phrase, e.g. "Status: 201" from php-fpm
+  thread_local char buffer[32];
+  char *p = buffer;
+  ::memcpy(p, StatusLines::kVersions[v], 9);
+  p += 9;
+  p = std::to_chars(p, buffer + 20, code).ptr;
+  ::memcpy(p, " \r\n", 3);
+  p += 3;
+  return std::string_view(buffer, p - buffer);
+}
@@ -0,0 +1,273 @@
+#include "../include/HttpRouter.h"
+#include <algorithm>
+#include <stdio.h>
+
+using namespace soc::http;
+
+HttpRouter::~HttpRouter() { delete root_.load(std::memory_order_acquire); }
+
+bool HttpRouter::add(const std::string &route, BaseService *service) {
+  if (frozen() || route.empty() || route.front() != '/' || !service)
+    return false;
+  for (auto &[r, s] : routes_) {
+    if (r == route) {
+      s = service;
+      return true;
+    }
+  }
+  routes_.emplace_back(route, service);
+  return true;
+}
+
+bool HttpRouter::remove(const std::string &route) {
+  if (frozen())
+    return false;
+  auto it = std::find_if(routes_.begin(), routes_.end(),
+                         [&](const auto &r) { return r.first == route; });
+  if (it == routes_.end())
+    return false;
+  routes_.erase(it);
+  return true;
+}
+
+bool HttpRouter::addPattern(const std::string &pattern, HttpService *service) {
+  if (frozen() || pattern.empty() || !service)
+    return false;
+  for (auto &[p, s] : patterns_) {
+    if (p == pattern) {
+      s = service;
+      return true;
+    }
+  }
+  patterns_.emplace_back(pattern, service);
+  return true;
+}
+
+bool HttpRouter::removePattern(const std::string &pattern) {
+  if (frozen())
+    return false;
+  auto it = std::find_if(patterns_.begin(), patterns_.end(),
+                         [&](const auto &p) { return p.first == pattern; });
+  if (it == patterns_.end())
+    return false;
+  patterns_.erase(it);
+  return true;
+}
+
+void HttpRouter::freeze() {
+  if (frozen())
+    return;
+
+  Node *root = new Node;
+  for (const auto &[route, service] : routes_) {
+    if (!insert(root, route, service))
+      ::fprintf(stderr, "invalid or conflicting route : [%s]\n",
+                route.c_str());
+  }
+
+  for (const auto &[pattern, service] : patterns_) {
+    Pattern p{std::regex(pattern, std::regex::ECMAScript | std::regex::optimize),
+              "", service};
+    if (pattern.front() == '^' && pattern.find('|') == std::string::npos) {
+      // ^/api/v1/(.*) => "/api/v1/"
+      static const std::string_view meta = "\\.^$|?*+()[]{}";
+      size_t n = 1;
+      while (n < pattern.size() && meta.find(pattern[n]) == meta.npos)
+        n++;
+      // a quantifier applies to the last literal character
+      if (n < pattern.size() && (pattern[n] == '?' || pattern[n] == '*' ||
+                                 pattern[n] == '{'))
+        n--;
+      p.anchor = pattern.substr(1, n - 1);
+    }
+    compiled_.emplace_back(std::move(p));
+  }
+
+  routes_.clear();
+  patterns_.clear();
+  root_.store(root, std::memory_order_release);
+}
+
+bool HttpRouter::insert(Node *node, std::string_view route,
+                        BaseService *service) {
+  while (true) {
+    if (route.empty()) {
+      node->service = service;
+      return true;
+    }
+
+    // wildcard: "*" or "{name:*}", only allowed at the end of a route
+    if (route == "*") {
+      if (!node->wildcard) {
+        node->wildcard = std::make_unique<Node>();
+        node->wildcard->type = ParamType::Wildcard;
+        node->wildcard->name = "*";
+      }
+      node->wildcard->service = service;
+      return true;
+    }
+
+    if (route.front() == '{') {
+      size_t end = route.find('}');
+      if (end == route.npos)
+        return false;
+      std::string_view spec = route.substr(1, end - 1);
+      route.remove_prefix(end + 1);
+
+      ParamType type = ParamType::String;
+      std::string_view name = spec;
+      if (size_t colon = spec.find(':'); colon != spec.npos) {
+        name = spec.substr(0, colon);
+        std::string_view t = spec.substr(colon + 1);
+        if (t == "int")
+          type = ParamType::Int;
+        else if (t == "*")
+          type = ParamType::Wildcard;
+        else if (t != "str")
+          return false;
+      }
+      if (name.empty())
+        return false;
+
+      if (type == ParamType::Wildcard) {
+        if (!route.empty())
+          return false;
+        if (!node->wildcard) {
+          node->wildcard = std::make_unique<Node>();
+          node->wildcard->type = type;
+          node->wildcard->name = name;
+        } else if (node->wildcard->name != name) {
+          return false;
+        }
+        node->wildcard->service = service;
+        return true;
+      }
+
+      // A parameter covers a whole path segment
+      if (!route.empty() && route.front() != '/')
+        return false;
+      if (!node->param) {
+        node->param = std::make_unique<Node>();
+        node->param->type = type;
+        node->param->name = name;
+      } else if (node->param->name != name || node->param->type != type) {
+        return false;
+      }
+      node = node->param.get();
+      continue;
+    }
+
+    // static part up to the next parameter or wildcard
+    size_t n = route.find_first_of("{*");
+    if (n == route.npos)
+      n = route.size();
+    else if (route[n] == '*' && n + 1 != route.size())
+      return false;
+    std::string_view literal = route.substr(0, n);
+
+    size_t i = node->indices.find(literal.front());
+    if (i == std::string::npos) {
+      auto child = std::make_unique<Node>();
+      child->prefix = literal;
+      node->indices.push_back(literal.front());
+      node->children.emplace_back(std::move(child));
+      node = node->children.back().get();
+      route.remove_prefix(literal.size());
+      continue;
+    }
+
+    Node *child = node->children[i].get();
+    size_t common = 0;
+    size_t max = std::min(child->prefix.size(), literal.size());
+    while (common < max && child->prefix[common] == literal[common])
+      common++;
+
+    if (common < child->prefix.size()) {
+      // split the edge: "/users" + "/uploads" => "/u" -> {"sers", "ploads"}
+      auto mid = std::make_unique<Node>();
+      mid->prefix = child->prefix.substr(0, common);
+      child->prefix.erase(0, common);
+      mid->indices.push_back(child->prefix.front());
+      mid->children.emplace_back(std::move(node->children[i]));
+      node->children[i] = std::move(mid);
+      child = node->children[i].get();
+    }
+    node = child;
+    route.remove_prefix(common);
+  }
+}
+
+bool HttpRouter::matchType(ParamType type, std::string_view segment) noexcept {
+  if (type != ParamType::Int)
+    return true;
+  return std::all_of(segment.begin(), segment.end(),
+                     [](char c) { return c >= '0' && c <= '9'; });
+}
+
+const HttpRouter::Node *HttpRouter::match(const Node *node,
+                                          std::string_view path,
+                                          HttpPathParams &params) const {
+  if (path.empty()) {
+    if (node->service)
+      return node;
+    if (node->wildcard && params.push(node->wildcard->name, path))
+      return node->wildcard.get();
+    return nullptr;
+  }
+
+  // 1. static edge, at most one child can start with the same byte
+  if (size_t i = node->indices.find(path.front()); i != std::string::npos) {
+    const Node *child = node->children[i].get();
+    if (path.starts_with(child->prefix)) {
+      if (auto x = match(child, path.substr(child->prefix.size()), params))
+        return x;
+    }
+  }
+
+  // 2. parameter, one path segment
+  if (node->param) {
+    size_t end = path.find('/');
+    std::string_view segment = path.substr(0, end);
+    if (!segment.empty() && matchType(node->param->type, segment) &&
+        params.push(node->param->name, segment)) {
+      if (auto x = match(node->param.get(), path.substr(segment.size()),
+                         params))
+        return x;
+      params.pop();
+    }
+  }
+
+  // 3. wildcard, the rest of the path
+  if (node->wildcard && params.push(node->wildcard->name, path))
+    return node->wildcard.get();
+  return nullptr;
+}
+
+BaseService *HttpRouter::find(std::string_view path,
+                              HttpPathParams &params) const {
+  const Node *root = root_.load(std::memory_order_acquire);
+  if (!root)
+    return nullptr;
+  params.clear();
+  if (auto x = match(root, path, params))
+    return x->service;
+  params.clear();
+  return nullptr;
+}
+
+HttpService *HttpRouter::findPattern(std::string_view path,
+                                     MatchGroup &match) const {
+  if (!frozen())
+    return nullptr;
+  std::match_results<std::string_view::const_iterator> m;
+  for (const auto &p : compiled_) {
+    if (!p.anchor.empty() && !path.starts_with(p.anchor))
+      continue;
+    if (std::regex_search(path.begin(), path.end(), m, p.regex)) {
+      for (size_t i = 1; i < m.size(); ++i)
+        match.emplace_back(m.str(i));
+      return p.service;
+    }
+  }
+  return nullptr;
+}
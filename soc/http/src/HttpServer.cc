@@ -1,28 +1,225 @@
 #include "../include/HttpServer.h"
+#include "../../net/include/ThreadPool.h"
 #include "../../modules/php-fastcgi/include/PhpFastCgi.h"
-#include <regex>
+#include "../../utility/include/Logger.h"
+#include "../../utility/include/Metrics.h"
+#include <charconv>
+#include <strings.h>
 
 using namespace soc::http;
 
-HttpServer::HttpServer() {
+namespace {
+int getPhpFpmConfig(const std::string &key, int value) {
+  return EXIST_CONFIG("php-fpm", key) ? GET_CONFIG(int, "php-fpm", key) : value;
+}
+
+// id of the session sweep in the session timer queue
+constexpr int kSessionSweepTimer = -1;
+
+int phpRequestTimeout() {
+  static const int timeout = getPhpFpmConfig("request_timeout", 30000);
+  return timeout;
+}
+
+// PHP output buffered for a slow client before php-fpm is paused, and request
+// body queued for php-fpm before the client is no longer read
+constexpr size_t kMaxPendingOutput = 256 * 1024;
+constexpr size_t kMaxPendingInput = 256 * 1024;
+
+std::string_view methodName(HttpMethod method) {
+  switch (method) {
+  case HttpMethod::POST:
+    return "POST";
+  case HttpMethod::HEAD:
+    return "HEAD";
+  default:
+    return "GET";
+  }
+}
+
+std::string_view protocolName(HttpVersion version) {
+  switch (version) {
+  case HttpVersion::HTTP_1_0:
+    return "HTTP/1.0";
+  case HttpVersion::HTTP_2_0:
+    return "HTTP/2.0";
+  default:
+    return "HTTP/1.1";
+  }
+}
+
+struct RequestMetrics {
+  // by status class, 1xx to 5xx
+  Metrics::Counter requests[5];
+  Metrics::Counter bytes;
+  Metrics::Histogram latency;
+  Metrics::Histogram upstream;
+
+  RequestMetrics() {
+    Metrics &metrics = Metrics::instance();
+    for (int i = 0; i < 5; ++i)
+      requests[i] =
+          metrics.counter("socnet_http_requests_total",
+                          "Finished requests by status class",
+                          "code=\"" + std::to_string(i + 1) + "xx\"");
+    bytes = metrics.counter("socnet_http_response_body_bytes_total",
+                            "Response body bytes sent");
+    latency = metrics.histogram("socnet_http_request_duration_seconds",
+                                "Time from arrival to the finished response");
+    upstream = metrics.histogram("socnet_fastcgi_duration_seconds",
+                                 "Time php-fpm took for a request");
+  }
+};
+
+const RequestMetrics &requestMetrics() {
+  static const RequestMetrics metrics;
+  return metrics;
+}
+
+class MetricsService : public HttpService {
+public:
+  void doGet(const HttpRequest &req, HttpResponse &resp) override {
+    resp.setContentType("text/plain; version=0.0.4");
+    resp.setBody(Metrics::instance().scrape());
+  }
+};
+} // namespace
+
+// A PHP request handled by php-fpm. Its client connection stays suspended
+// and attached to the task until the response is complete or the client goes
+// away. The request body is forwarded as it arrives, and once the CGI headers
+// are known the response body is relayed to the client as it is produced
+struct HttpServer::PhpTask {
+  std::mutex mutex;
+  // completed or cancelled
+  bool finished = false;
+  bool retried = false;
+  TcpConnection *conn = nullptr;
+  HttpRequest *req = nullptr;
+  const HttpMount *mount = nullptr;
+  // keeps the table of mount alive while php-fpm runs
+  std::shared_ptr<const HttpMountTable> mounts;
+  std::string path;
+  // the connection carrying the request and its FastCGI request id
+  FastCgiPool::Connection upstream;
+  int request_id = 0;
+
+  // request body still to be read from the client
+  size_t body_remaining = 0;
+  // waiting for the upstream to write the body queued so far
+  bool body_paused = false;
+
+  // CGI output until the end of its headers
+  Buffer head;
+  // the headers were sent, the body is relayed as it arrives
+  bool streaming = false;
+  bool chunked = false;
+  bool skip_body = false;
+  // body waiting for the send buffer of the connection to drain
+  Buffer pending;
+  // the send buffer holds unsent data
+  bool writing = false;
+  // the upstream was paused because the client cannot keep up
+  bool upstream_paused = false;
+  // for the access log: when the request was submitted to php-fpm and how
+  // long php-fpm took, microseconds
+  uint64_t upstream_start = 0;
+  uint32_t upstream_time = 0;
+  int status = 0;
+  uint64_t body_sent = 0;
+  // php-fpm finished, the task completes once everything is written
+  bool ended = false;
+};
+
+HttpServer::HttpServer() : session_sweep_(false) {
   server_ = std::make_unique<TcpServer>();
   initialize();
 }
 
 HttpServer::~HttpServer() {
-  sessions_.clear();
+  Metrics::instance().removeGauge(sessions_gauge_);
+  sessions_->clear();
   services_.clear();
   urlp_services_.clear();
 }
 
 void HttpServer::initialize() {
   ::srand(::time(nullptr));
-  setIdleTime(GET_CONFIG(int, "server", "idle_timeout"));
+  const ServerConfig &config = SERVER_CONFIG();
+  setIdleTime(config.idle_timeout);
+  setLogging(config);
+  if (EXIST_CONFIG("server", "access_log")) {
+    int segment = EXIST_CONFIG("server", "access_log_segment")
+                      ? GET_CONFIG(int, "server", "access_log_segment")
+                      : 64;
+    access_log_ = std::make_unique<HttpAccessLog>(
+        GET_CONFIG(std::string, "server", "access_log"),
+        (size_t)std::max(segment, 1) * 1024 * 1024);
+  }
+  if (EXIST_CONFIG("server", "trace_file")) {
+    int threshold = EXIST_CONFIG("server", "trace_threshold")
+                        ? GET_CONFIG(int, "server", "trace_threshold")
+                        : 100;
+    int sample = EXIST_CONFIG("server", "trace_sample")
+                     ? GET_CONFIG(int, "server", "trace_sample")
+                     : 1;
+    tracer_ = std::make_unique<HttpTracer>(
+        GET_CONFIG(std::string, "server", "trace_file"),
+        (uint32_t)std::max(threshold, 0) * 1000, std::max(sample, 1));
+    server_->setReadTiming(true);
+    server_->setWriteCompleteCallback(
+        std::bind(&HttpServer::onWriteComplete, this, std::placeholders::_1));
+  }
+  if (EXIST_CONFIG("server", "capture_file")) {
+    int limit = EXIST_CONFIG("server", "capture_limit")
+                    ? GET_CONFIG(int, "server", "capture_limit")
+                    : 1024;
+    server_->setCapture(GET_CONFIG(std::string, "server", "capture_file"),
+                        (size_t)std::max(limit, 0) * 1024 * 1024);
+  }
+  // least recently used sessions are evicted beyond session_capacity
+  sessions_ = std::make_unique<HttpSessionStore>(
+      EXIST_CONFIG("server", "session_capacity")
+          ? GET_CONFIG(int, "server", "session_capacity")
+          : 0);
+  sessions_gauge_ =
+      Metrics::instance().gauge("socnet_sessions", "Sessions in the store",
+                                [this] { return (double)sessions_->size(); });
+  // the pool is shared by every server
+  static const size_t pool_gauge = Metrics::instance().gauge(
+      "socnet_thread_pool_pending", "Tasks waiting for a pool thread",
+      [] { return (double)ThreadPool::instance().pending(); });
+  (void)pool_gauge;
+  if (EXIST_CONFIG("server", "metrics_path"))
+    addService<MetricsService>(
+        GET_CONFIG(std::string, "server", "metrics_path"));
 
-  default_pages_ =
-      GET_CONFIG(std::vector<std::string>, "server", "default_page");
+  if (EXIST_CONFIG("server", "session_snapshot")) {
+    session_snapshot_ = std::make_unique<HttpSessionSnapshot>(
+        GET_CONFIG(std::string, "server", "session_snapshot"));
+    session_snapshot_->open();
+  }
+
+  default_mount_.index_pages = config.default_page;
+  default_mount_.enable_sendfile = config.enable_sendfile;
 
-  if (GET_CONFIG(bool, "server", "enable_https")) {
+  if (config.enable_php) {
+    size_t pool_size = getPhpFpmConfig("pool_size", 16);
+    if (GET_CONFIG(bool, "php-fpm", "tcp_or_domain"))
+      php_pool_ = std::make_unique<FastCgiPool>(
+          GET_CONFIG(std::string, "php-fpm", "server_ip"),
+          GET_CONFIG(int, "php-fpm", "server_port"), pool_size);
+    else
+      php_pool_ = std::make_unique<FastCgiPool>(
+          GET_CONFIG(std::string, "php-fpm", "sock_path"), pool_size);
+    // connects are slow when php-fpm is, keep them off the callers of
+    // acquire() and release(), which hold a PhpTask lock
+    php_pool_->setExecutor([](const std::function<void()> &task) {
+      ThreadPool::instance().add(task);
+    });
+  }
+
+  if (config.enable_https) {
     setCertificate(GET_CONFIG(std::string, "https", "cert_file"),
                    GET_CONFIG(std::string, "https", "private_key_file"),
                    GET_CONFIG(std::string, "https", "password"));
@@ -30,6 +227,9 @@ void HttpServer::initialize() {
 
   server_->setMessageCallback(
       std::bind(&HttpServer::onMessage, this, std::placeholders::_1));
+  server_->setClosedConnectionCallback(
+      std::bind(&HttpServer::onClose, this, std::placeholders::_1));
+  server_->setReloadCallback(std::bind(&HttpServer::reload, this));
 
   setErrorService<DefaultErrorService>();
 }
@@ -39,9 +239,58 @@ BaseService *HttpServer::getErrorService() const {
 }
 
 void HttpServer::start() {
+  router_.freeze();
+  buildMounts();
   InetAddress address(GET_CONFIG(std::string, "server", "listen_ip"),
                       GET_CONFIG(int, "server", "listen_port"));
+  // a deploy stops the server with SIGTERM, which must still save the
+  // sessions
+  server_->setQuitOnSignal();
   server_->start(address);
+  // the next run picks the sessions up again
+  if (session_snapshot_)
+    session_snapshot_->save(*sessions_);
+}
+
+// Settings that need a restart: listen_ip, listen_port, enable_https with the
+// https section, enable_php with the php-fpm section and the session store
+void HttpServer::reload() {
+  if (!AppConfig::instance().reload())
+    return;
+  HttpPassStore::instance().reload();
+
+  const ServerConfig &config = SERVER_CONFIG();
+  setIdleTime(config.idle_timeout);
+  setLogging(config);
+  default_mount_.index_pages = config.default_page;
+  default_mount_.enable_sendfile = config.enable_sendfile;
+  if (buildMounts())
+    fprintf(stderr, "Reload config successfully\n");
+}
+
+void HttpServer::setLogging(const ServerConfig &config) {
+  Logger &logger = Logger::getLogger();
+  logger.setLevel(config.log_level);
+  // a reload reopens the file only when it moved, removing log_file keeps
+  // the current one
+  if (!config.log_file.empty() && config.log_file != log_file_ &&
+      logger.open(config.log_file, 64 * 1024 * 1024))
+    log_file_ = config.log_file;
+}
+
+bool HttpServer::buildMounts() {
+  auto table = std::make_shared<HttpMountTable>();
+  for (const auto &mount : mount_dirs_) {
+    // at startup a missing directory is skipped, a reload keeps the previous
+    // mounts instead
+    if (!table->add(mount.url, mount.dir,
+                    mount.options.value_or(default_mount_)) &&
+        mounts_.get())
+      return false;
+  }
+  table->freeze();
+  mounts_.publish(std::move(table));
+  return true;
 }
 
 void HttpServer::setIdleTime(int millsecond) {
@@ -56,40 +305,49 @@ void HttpServer::setCertificate(const std::string &cert_file,
   server_->setCertificate(cert_file, private_key_file, password);
 }
 
-HttpSession *HttpServer::createSession() {
+std::shared_ptr<HttpSession> HttpServer::createSession() {
   char id[16], session_id[27]{0};
   EncodeUtil::genRandromStr(id);
   ::snprintf(session_id, 27, "SESSIONID_%s", id);
   session_id[26] = '\0';
-  static const int interval = GET_CONFIG(int, "server", "session_lifetime");
-  HttpSession *session = new HttpSession(session_id, interval);
-  sessions_.add(session_id, std::shared_ptr<HttpSession>(session));
+  int interval = SERVER_CONFIG().session_lifetime;
+  auto session = std::make_shared<HttpSession>(session_id, interval);
+  sessions_->add(session);
+  scheduleSessionSweep();
   return session;
 }
 
 void HttpServer::quit() { server_->quit(); }
 
 void HttpServer::addMountDir(const std::string &url, const std::string &dir) {
-  std::string u = url;
-  if (u.back() != '/')
-    u += "/";
-  mount_dir_.add(u, std::filesystem::canonical(dir).string() + "/");
+  mount_dirs_.push_back({url, dir, std::nullopt});
+}
+
+void HttpServer::addMountDir(const std::string &url, const std::string &dir,
+                             const HttpMountOptions &options) {
+  mount_dirs_.push_back({url, dir, options});
 }
 
-bool HttpServer::onMessage(TcpConnection *conn) {
+TcpServer::MessageStatus HttpServer::onMessage(TcpConnection *conn) {
   HttpRequest *req = nullptr;
   if (conn->getContext() == nullptr) {
     req = new HttpRequest(conn, this);
     conn->setContext(static_cast<void *>(req));
+    if (tracer_)
+      req->trace_.at[HttpTrace::Arrival] = conn->getReadyTime();
   } else {
     req = static_cast<HttpRequest *>(conn->getContext());
   }
+  if (tracer_) {
+    req->trace_.at[HttpTrace::Ready] = conn->getReadyTime();
+    req->trace_.mark(HttpTrace::Start);
+  }
 
   auto code = req->parseRequest();
   if (conn->isDisconnected() || conn->getContext() == nullptr) {
     if (req)
       delete req;
-    return true;
+    return TcpServer::MessageStatus::Write;
   }
   HttpResponse resp(conn);
   if (code == HttpRequest::BAD_REQUEST) {
@@ -99,13 +357,17 @@ bool HttpServer::onMessage(TcpConnection *conn) {
     resp.setCode(HttpStatus::BAD_REQUEST).setHeader("Connection", "close");
     getErrorService()->service(*req, resp);
     resp.send();
+    accountRequest(*req, resp.getCode(), resp.builder_->getBodyLength(), 0);
+    traceRequest(*req, conn->getFd(), resp.getCode(), false);
 
     delete req;
-    return true;
+    return TcpServer::MessageStatus::Write;
   } else if (code != HttpRequest::REQUEST_CONTENT_DONE)
-    return false;
+    return TcpServer::MessageStatus::Read;
 
   req->reset();
+  if (tracer_)
+    req->trace_.mark(HttpTrace::Parsed);
 
   do {
     if (dispatchUrlPattern(*req, resp))
@@ -113,7 +375,19 @@ bool HttpServer::onMessage(TcpConnection *conn) {
     if (dispatchMountDir(*req, resp))
       break;
   } while (0);
+  if (tracer_)
+    req->trace_.mark(HttpTrace::Handled);
+
+  // The request now belongs to a PhpTask, which finishes it
+  if (resp.suspended_)
+    return TcpServer::MessageStatus::Suspend;
 
+  finishRequest(req, resp);
+  return TcpServer::MessageStatus::Write;
+}
+
+void HttpServer::finishRequest(HttpRequest *req, HttpResponse &resp,
+                               uint32_t upstream) {
   associateRequestSession(*req, resp);
 
   // client/server error code
@@ -121,54 +395,160 @@ bool HttpServer::onMessage(TcpConnection *conn) {
     getErrorService()->service(*req, resp);
 
   resp.send();
+  accountRequest(*req, resp.getCode(), resp.builder_->getBodyLength(),
+                 upstream);
+  if (tracer_) {
+    req->trace_.mark(HttpTrace::Built);
+    traceRequest(*req, resp.builder_->connection()->getFd(), resp.getCode(),
+                 false);
+  }
 
+  resp.builder_->connection()->setContext(nullptr);
   delete req;
+}
+
+void HttpServer::accountRequest(const HttpRequest &req, int status,
+                                uint64_t bytes, uint32_t upstream) {
+  uint64_t latency = HttpAccessLog::now() - req.getArrivalTime();
+  const RequestMetrics &metrics = requestMetrics();
+  if (status >= 100 && status < 600)
+    metrics.requests[status / 100 - 1].add();
+  metrics.bytes.add(bytes);
+  metrics.latency.observe(latency);
+  if (upstream > 0)
+    metrics.upstream.observe(upstream);
+
+  if (!access_log_)
+    return;
+  HttpAccessRecord record;
+  record.time = std::max<uint64_t>(
+      TimeStamp::loopNow().microsecond() - latency, 1);
+  record.bytes = bytes;
+  record.latency = std::min<uint64_t>(latency, UINT32_MAX);
+  record.upstream = upstream;
+  const sockaddr_in *peer =
+      (const sockaddr_in *)req.getInetAddress().getSockAddr();
+  record.addr = peer->sin_addr.s_addr;
+  record.port = req.getInetAddress().getPort();
+  record.status = status;
+  record.method = (uint8_t)req.getMethod();
+  record.version = (uint8_t)req.getVersion();
+  const std::string &url = req.getRawUrl();
+  record.path_len = std::min<size_t>(url.size(), UINT16_MAX);
+  size_t n = std::min(url.size(), HttpAccessRecord::kPathSize);
+  ::memcpy(record.path, url.data(), n);
+  ::memset(record.path + n, 0, HttpAccessRecord::kPathSize - n);
+  access_log_->write(record);
+}
+
+void HttpServer::traceRequest(const HttpRequest &req, int fd, int status,
+                              bool written) {
+  if (!tracer_)
+    return;
+  HttpTracer::Entry entry{req.trace_, req.getRawUrl(), req.getMethod(),
+                          status, fd};
+  if (written) {
+    entry.trace.mark(HttpTrace::Written);
+    tracer_->record(entry);
+  } else {
+    pending_traces_.add(fd, entry);
+  }
+}
+
+void HttpServer::onWriteComplete(TcpConnection *conn) {
+  auto entry = pending_traces_.get(conn->getFd());
+  if (!entry.has_value())
+    return;
+  pending_traces_.remove(conn->getFd());
+  entry->trace.mark(HttpTrace::Written);
+  tracer_->record(*entry);
+}
+
+void HttpServer::onClose(TcpConnection *conn) {
+  if (tracer_)
+    pending_traces_.remove(conn->getFd());
+  auto task = php_tasks_.get(conn->getFd());
+  if (!task.has_value())
+    return;
+
+  // The client went away or timed out while php-fpm was working, abort the
+  // FastCGI request. A connection that carries one request at a time is
+  // closed instead so that php-fpm sees the close
+  auto &x = task.value();
+  std::lock_guard<std::mutex> lock(x->mutex);
+  if (x->finished || x->conn != conn)
+    return;
+  x->finished = true;
+  php_tasks_.remove(conn->getFd());
+  if (x->upstream) {
+    if (x->upstream_paused)
+      x->upstream->resume();
+    if (x->upstream->abort(x->request_id))
+      armUpstream(x->upstream);
+    else
+      dropUpstream(x->upstream);
+    php_pool_->release(x->upstream);
+    x->upstream = nullptr;
+  }
   conn->setContext(nullptr);
-  return true;
+  delete x->req;
 }
 
-HttpSession *HttpServer::associateSession(HttpRequest *req) {
-  HttpSession *session = nullptr;
-  // had already exist HttpSession
+std::unique_ptr<libjson::JsonSaxHandler>
+HttpServer::openJsonStream(HttpRequest *req) {
+  // the same lookup as dispatchUrlPattern(), only HttpServices are routed
+  auto service = static_cast<HttpService *>(
+      router_.find(req->getUrl(), req->params_));
+  if (!service) {
+    HttpService::MatchGroup match;
+    service = router_.findPattern(req->getUrl(), match);
+  }
+  return service ? service->doJsonStream(*req) : nullptr;
+}
+
+std::shared_ptr<HttpSession> HttpServer::associateSession(HttpRequest *req) {
+  std::shared_ptr<HttpSession> session;
+  // had already exist HttpSession, an expired or invalidated one is gone
   if (auto x = req->getCookies().get("SESSIONID"); x.has_value()) {
-    if (auto s = sessions_.get(x.value()); s.has_value()) {
-      session = s.value().get();
-      // The old session has been set to an invalid state, so it is
-      // automatically deleted by the timer, and a null pointer object is
-      // returned
-      if (session && !session->isDestroy()) {
-        session->setStatus(HttpSession::Accessed);
-        // reset session timer
-        server_->getSessionTimer()->adjust(Timer(
-            EncodeUtil::murmurHash2(session->getId()),
-            TimeStamp::nowSecond(session->getMaxInactiveInterval()), nullptr));
-      } else {
-        session = nullptr;
+    session = sessions_->get(x.value());
+    // a session of the previous run is decoded when its client comes back
+    if (!session && session_snapshot_) {
+      session = session_snapshot_->take(x.value());
+      if (session) {
+        sessions_->add(session);
+        scheduleSessionSweep();
       }
     }
+    if (session)
+      session->setStatus(HttpSession::Accessed);
   }
   // create a new session
-  if (session == nullptr) {
+  if (session == nullptr)
     session = createSession();
-    server_->createSessionTimer(
-        TimeStamp::second(session->getMaxInactiveInterval()));
-    server_->getSessionTimer()->add(
-        Timer(EncodeUtil::murmurHash2(session->getId()),
-              TimeStamp::nowSecond(session->getMaxInactiveInterval()),
-              std::bind(&HttpServer::handleSessionTimeout, this, session)));
-  }
   return session;
 }
 
-void HttpServer::handleSessionTimeout(HttpSession *session) {
-  if (!session)
+// Expired sessions are dropped lazily when their shard is used, a periodic
+// sweep covers the shards nobody touches. It runs while sessions exist
+void HttpServer::scheduleSessionSweep() {
+  int interval = SERVER_CONFIG().session_lifetime;
+  if (session_sweep_.exchange(true))
     return;
-  sessions_.remove(session->getId());
+  server_->getSessionTimer()->add(
+      Timer(kSessionSweepTimer, TimeStamp::nowSecond(std::max(interval, 1)),
+            std::bind(&HttpServer::handleSessionSweep, this)));
+}
+
+void HttpServer::handleSessionSweep() {
+  sessions_->sweep();
+  session_sweep_ = false;
+  if (!sessions_->empty())
+    scheduleSessionSweep();
 }
 
 void HttpServer::associateRequestSession(const HttpRequest &req,
                                          HttpResponse &resp) {
-  HttpSession *session = req.session_;
+  HttpSession *session = req.session_.get();
   if (session && session->isNew()) {
     HttpCookie cookie;
     cookie.add("SESSIONID", session->getId());
@@ -178,66 +558,57 @@ void HttpServer::associateRequestSession(const HttpRequest &req,
 }
 
 bool HttpServer::dispatchMountDir(const HttpRequest &req, HttpResponse &resp) {
-  bool status = false;
-  if (mount_dir_.empty())
-    return status;
+  const HttpMountTable *mounts = mounts_.get();
+  if (mounts == nullptr || mounts->empty())
+    return false;
 
   const std::string_view req_url = req.getUrl();
-
-  mount_dir_.each([&](const auto &prefix, const auto &dir) {
-    if (req_url.starts_with(prefix)) {
-      if (dispatchFile(prefix, req_url, dir, req, resp))
-        return status = true;
-    }
-    return false;
-  });
-  if (!status)
-    resp.setCode(HttpStatus::NOT_FOUND);
-  return status;
+  const HttpMount *mount = mounts->find(req_url);
+  if (tracer_)
+    req.trace_.mark(HttpTrace::Routed);
+  // longest prefix first, then fall back to the shorter mounts
+  for (; mount; mount = mount->parent) {
+    if (dispatchFile(*mount, req_url, req, resp))
+      return true;
+  }
+  resp.setCode(HttpStatus::NOT_FOUND);
+  return false;
 }
 
 bool HttpServer::dispatchUrlPattern(const HttpRequest &req,
                                     HttpResponse &resp) {
-  bool status = false;
-  // basic url
-  if (auto x = services_.get(req.getUrl()); x.has_value()) {
-    x.value()->service(req, resp);
+  // static and parameterized routes
+  if (auto x = router_.find(req.getUrl(), req.params_); x != nullptr) {
+    if (tracer_)
+      req.trace_.mark(HttpTrace::Routed);
+    x->service(req, resp);
     return true;
-  } else {
-    // regex url-pattern
-    if (!urlp_services_.empty()) {
-      std::smatch m;
-      std::regex rgx;
-
-      urlp_services_.each([&](const auto &urlp, const auto &service) {
-        rgx = std::regex(urlp, std::regex::extended | std::regex::ECMAScript);
-        if (std::regex_search(req.getUrl(), m, rgx)) {
-          std::vector<std::string> match;
-          for (size_t i = 1; i < m.size(); ++i)
-            match.emplace_back(m.str(i));
-          service->service0(req, resp, match);
-          return status = true;
-        }
-        return false;
-      });
-    }
   }
-  return status;
+  // regex url-pattern
+  HttpService::MatchGroup match;
+  if (auto x = router_.findPattern(req.getUrl(), match); x != nullptr) {
+    if (tracer_)
+      req.trace_.mark(HttpTrace::Routed);
+    x->service0(req, resp, match);
+    return true;
+  }
+  return false;
 }
 
-bool HttpServer::dispatchFile(std::string_view prefix, std::string_view req_url,
-                              std::string path, const HttpRequest &req,
-                              HttpResponse &resp) {
+bool HttpServer::dispatchFile(const HttpMount &mount, std::string_view req_url,
+                              const HttpRequest &req, HttpResponse &resp) {
   // suffix
-  req_url.remove_prefix(prefix.size());
+  req_url.remove_prefix(mount.prefix.size());
   // absolute path
-  path.append(req_url.data(), req_url.size());
+  std::string path;
+  path.reserve(mount.root.size() + req_url.size());
+  path.append(mount.root).append(req_url.data(), req_url.size());
 
   bool find_status = false;
   // directory
   if (path.back() == '/') {
     // get default index page
-    find_status = getIndexPageFileName(path);
+    find_status = getIndexPageFileName(mount, path);
     if (!find_status) {
       resp.setCode(HttpStatus::FORBIDDEN);
       return true;
@@ -248,48 +619,61 @@ bool HttpServer::dispatchFile(std::string_view prefix, std::string_view req_url,
   if (!find_status && !FileUtil::exist(path))
     return false;
 
-  static const bool enable_php = GET_CONFIG(bool, "server", "enable_php");
-
   // PHP processor
   if (path.ends_with(".php")) {
-    if (enable_php)
-      dispatchPhpProcessor(path, req, resp);
+    // a reload may turn PHP off, but turning it on needs the php-fpm pool
+    if (php_pool_ && SERVER_CONFIG().enable_php)
+      dispatchPhpProcessor(mount, path, req, resp);
     else
       resp.setCode(HttpStatus::FORBIDDEN);
   } else {
     resp.setHeader("Content-Type", mappingMimeType(path)).setBodyFile(path);
+    resp.builder_->setSendFile(mount.options.enable_sendfile);
+    resp.builder_->setGzip(mount.options.enable_gzip);
   }
   return true;
 }
 
-void HttpServer::dispatchPhpProcessor(const std::string &path,
-                                      const HttpRequest &req,
-                                      HttpResponse &resp) {
-  PhpFastCgi fcgi;
-  static const bool tcp_or_domain =
-      GET_CONFIG(bool, "php-fpm", "tcp_or_domain");
-
-  if (tcp_or_domain) {
-    static const std::string ip =
-        GET_CONFIG(std::string, "php-fpm", "server_ip");
-    static const int port = GET_CONFIG(int, "php-fpm", "server_port");
-    if (!fcgi.connectPhpFpm(ip, port)) {
-      // error
-      resp.setCode(HttpStatus::INTERNAL_SERVER_ERROR);
-      return;
-    }
-  } else {
-    static const std::string path =
-        GET_CONFIG(std::string, "php-fpm", "sock_path");
-    if (!fcgi.connectPhpFpm(path)) {
-      // error
-      resp.setCode(HttpStatus::INTERNAL_SERVER_ERROR);
-      return;
-    }
-  }
+void HttpServer::sendPhpRequest(PhpFastCgi &fcgi, const PhpTask &task) {
+  static const std::string listen_ip =
+      GET_CONFIG(std::string, "server", "listen_ip");
+  static const std::string listen_port =
+      std::to_string(GET_CONFIG(int, "server", "listen_port"));
+  static const bool on_https = GET_CONFIG(bool, "server", "enable_https");
+  const std::string &server_name = SERVER_CONFIG().server_hostname;
+  const HttpMount &mount = *task.mount;
+  const std::string &path = task.path;
+  const HttpRequest &req = *task.req;
 
+  // Everything is collected in the connection's output buffer and sent with
+  // one write: BEGIN_REQUEST, the PARAMS stream and the STDIN stream
   fcgi.sendStartRequestRecord();
+
+  // CGI/1.1 environment, the root and prefix of a mount both end with '/'
+  std::string_view root(mount.root.data(), mount.root.size() - 1);
+  std::string script = mount.prefix;
+  script.append(path, mount.root.size());
+  fcgi.sendParams(FCGI_Params::GATEWAY_INTERFACE, "CGI/1.1");
+  fcgi.sendParams(FCGI_Params::SERVER_SOFTWARE, "socnet");
+  fcgi.sendParams(FCGI_Params::SERVER_PROTOCOL,
+                  protocolName(req.getVersion()));
+  fcgi.sendParams(FCGI_Params::SERVER_NAME, server_name);
+  fcgi.sendParams(FCGI_Params::SERVER_ADDR, listen_ip);
+  fcgi.sendParams(FCGI_Params::SERVER_PORT, listen_port);
+  fcgi.sendParams(FCGI_Params::REMOTE_ADDR, req.getInetAddress().getIp());
+  fcgi.sendParams(FCGI_Params::REMOTE_PORT,
+                  std::to_string(req.getInetAddress().getPort()));
+  fcgi.sendParams(FCGI_Params::REQUEST_METHOD, methodName(req.getMethod()));
+  fcgi.sendParams(FCGI_Params::REQUEST_URI, req.getRawUrl());
+  fcgi.sendParams(FCGI_Params::QUERY_STRING, req.getQueryString());
+  fcgi.sendParams(FCGI_Params::DOCUMENT_ROOT, root);
+  fcgi.sendParams(FCGI_Params::DOCUMENT_URI, script);
+  fcgi.sendParams(FCGI_Params::SCRIPT_NAME, script);
   fcgi.sendParams(FCGI_Params::SCRIPT_FILENAME, path);
+  // required by php-cgi built with cgi.force_redirect
+  fcgi.sendParams(FCGI_Params::REDIRECT_STATUS, "200");
+  if (on_https)
+    fcgi.sendParams("HTTPS", "on");
 
   if (req.getAuth() != nullptr) {
     if (req.getAuth()->getAuthType() == HttpAuthType::Basic) {
@@ -304,46 +688,449 @@ void HttpServer::dispatchPhpProcessor(const std::string &path,
     }
   }
 
-  if (req.hasQueryString()) {
-    fcgi.sendParams(FCGI_Params::QUERY_STRING, req.getQueryString());
+  // Request headers as HTTP_*, except the two that CGI passes without the
+  // prefix. Proxy would become HTTP_PROXY, which PHP HTTP clients take as
+  // their proxy (httpoxy), and a name with '_' could pose as one with '-'
+  bool has_length = false;
+  req.getHeader().forEach([&](const std::string &key,
+                               const std::string &value) {
+    if (::strcasecmp(key.data(), "Proxy") == 0 ||
+        key.find('_') != std::string::npos)
+      return;
+    if (::strcasecmp(key.data(), "Content-Type") == 0) {
+      fcgi.sendParams(FCGI_Params::CONTENT_TYPE, value);
+    } else if (::strcasecmp(key.data(), "Content-Length") == 0) {
+      fcgi.sendParams(FCGI_Params::CONTENT_LENGTH, value);
+      has_length = true;
+    } else {
+      fcgi.sendHeaderParams(key, value);
+    }
+  });
+  if (!has_length && req.getMethod() == HttpMethod::POST)
+    fcgi.sendParams(FCGI_Params::CONTENT_LENGTH,
+                    std::to_string(req.getPostData().size()));
+  fcgi.sendEndRequestRecord();
+
+  // The rest of the body is forwarded by forwardRequestBody()
+  std::string_view body;
+  if (req.getMethod() == HttpMethod::POST)
+    body = req.getPostData();
+  if (task.body_remaining > 0)
+    fcgi.sendStdin(body);
+  else
+    fcgi.sendPost(body);
+}
+
+void HttpServer::dispatchPhpProcessor(const HttpMount &mount,
+                                      const std::string &path,
+                                      const HttpRequest &req,
+                                      HttpResponse &resp) {
+  auto task = std::make_shared<PhpTask>();
+  task->conn = resp.builder_->connection();
+  task->req = const_cast<HttpRequest *>(&req);
+  task->mount = &mount;
+  // the table dispatchMountDir() found mount in, pinned by this thread
+  task->mounts = mounts_.pinned();
+  task->path = path;
+  // Only the part of the body read so far is in the request, php-fpm gets the
+  // rest while it arrives
+  if (req.getMethod() == HttpMethod::POST) {
+    if (auto x = req.getHeaderValue("Content-Length"); x.has_value()) {
+      size_t length = std::strtoul(x.value().data(), nullptr, 10);
+      if (length > req.getPostData().size())
+        task->body_remaining = length - req.getPostData().size();
+    }
+  }
+
+  // Hold the task until it is fully set up, so that neither a pool waiter
+  // nor onClose() can run half way
+  std::lock_guard<std::mutex> lock(task->mutex);
+  bool pending = false;
+  auto upstream = acquireUpstream(task, pending);
+  if (!upstream && !pending) {
+    resp.setCode(HttpStatus::SERVICE_UNAVAILABLE);
+    return;
+  }
+  php_tasks_.add(task->conn->getFd(), task);
+  server_->suspend(task->conn, phpRequestTimeout());
+  server_->attach(task->conn, std::bind(&HttpServer::onClientEvent, this, task,
+                                        std::placeholders::_1));
+  if (upstream)
+    startPhpTask(task, upstream);
+  resp.suspended_ = true;
+}
+
+FastCgiPool::Connection
+HttpServer::acquireUpstream(const std::shared_ptr<PhpTask> &task,
+                            bool &pending) {
+  // When every request slot is taken the task waits without holding a
+  // thread, the slot is handed over by whichever request releases one
+  return php_pool_->acquire(
+      [this, task](FastCgiPool::Connection upstream) {
+        ThreadPool::instance().add(
+            std::bind(&HttpServer::onUpstreamAcquired, this, task, upstream));
+      },
+      pending);
+}
+
+void HttpServer::onUpstreamAcquired(const std::shared_ptr<PhpTask> &task,
+                                    const FastCgiPool::Connection &upstream) {
+  std::lock_guard<std::mutex> lock(task->mutex);
+  if (task->finished) {
+    if (upstream)
+      php_pool_->release(upstream);
+    return;
+  }
+  if (!upstream)
+    finishPhpTask(task, HttpStatus::SERVICE_UNAVAILABLE, nullptr);
+  else
+    startPhpTask(task, upstream);
+}
+
+void HttpServer::startPhpTask(const std::shared_ptr<PhpTask> &task,
+                              const FastCgiPool::Connection &upstream) {
+  task->upstream = upstream;
+  task->upstream_start = HttpAccessLog::now();
+  task->request_id = upstream->submit(
+      [this, task](PhpFastCgi &fcgi) { sendPhpRequest(fcgi, *task); },
+      std::bind(&HttpServer::onPhpOutput, this, task, upstream,
+                std::placeholders::_1));
+  if (task->request_id == 0) {
+    // the connection failed after it was handed out
+    php_pool_->release(upstream);
+    task->upstream = nullptr;
+    if (!retryPhpTask(task))
+      finishPhpTask(task, HttpStatus::SERVICE_UNAVAILABLE, nullptr);
+    return;
+  }
+
+  // A connection is registered with the event loop by its first request and
+  // stays registered while it is pooled, so that a close by php-fpm is seen
+  if (upstream->markWatched())
+    server_->watch(upstream->getFd(), EPOLLIN | EPOLLOUT,
+                   std::bind(&HttpServer::onUpstreamEvent, this, upstream,
+                             std::placeholders::_1));
+  else
+    armUpstream(upstream);
+
+  // the rest of the request body is read from now on
+  if (task->body_remaining > 0)
+    armClient(task);
+}
+
+bool HttpServer::retryPhpTask(const std::shared_ptr<PhpTask> &task) {
+  if (task->retried)
+    return false;
+  task->retried = true;
+  bool pending = false;
+  auto upstream = acquireUpstream(task, pending);
+  if (upstream)
+    startPhpTask(task, upstream);
+  return upstream || pending;
+}
+
+void HttpServer::onUpstreamEvent(const FastCgiPool::Connection &upstream,
+                                 int) {
+  if (upstream->handleEvent())
+    armUpstream(upstream);
+  else
+    dropUpstream(upstream);
+}
+
+void HttpServer::armUpstream(const FastCgiPool::Connection &upstream) {
+  if (!upstream->good())
+    return;
+  int events = upstream->paused() ? 0 : (int)EPOLLIN;
+  if (upstream->hasPendingOutput())
+    events |= EPOLLOUT;
+  // a paused connection is re-armed by whoever resumes it
+  if (events != 0)
+    server_->rewatch(upstream->getFd(), events);
+}
+
+void HttpServer::dropUpstream(const FastCgiPool::Connection &upstream) {
+  server_->unwatch(upstream->getFd());
+  php_pool_->remove(upstream);
+}
+
+void HttpServer::onPhpOutput(const std::shared_ptr<PhpTask> &task,
+                              const FastCgiPool::Connection &upstream,
+                              FastCgiConnection::Response &response) {
+  std::unique_lock<std::mutex> lock(task->mutex);
+  if (task->finished || task->upstream != upstream)
+    return;
+  if (response.finished()) {
+    if (task->upstream_paused) {
+      task->upstream_paused = false;
+      upstream->resume();
+      armUpstream(upstream);
+    }
+    php_pool_->release(upstream);
+    task->upstream = nullptr;
+    task->request_id = 0;
+    task->upstream_time = HttpAccessLog::now() - task->upstream_start;
+  }
+
+  if (!task->streaming) {
+    if (task->head.readable() > 0) {
+      task->head.append(response.out.peek(), response.out.readable());
+      std::swap(task->head, response.out);
+      task->head.retiredAll();
+    }
+    Buffer &output = response.out;
+
+    if (response.finished()) {
+      if (!response.ended && output.readable() == 0) {
+        // A pooled connection may have been closed by php-fpm right before
+        // the request was written, retry once on another connection. Once
+        // php-fpm may have run the script only GET and HEAD are sent again
+        HttpMethod method = task->req->getMethod();
+        bool idempotent =
+            method == HttpMethod::GET || method == HttpMethod::HEAD;
+        if ((response.written && !idempotent) || !retryPhpTask(task))
+          finishPhpTask(task, HttpStatus::INTERNAL_SERVER_ERROR, nullptr);
+        return;
+      }
+      // The whole response is here, send it with a Content-Length
+      finishPhpTask(task, HttpStatus::OK, &response);
+      return;
+    }
+
+    std::string_view sv(output.peek(), output.readable());
+    if (sv.find("\r\n\r\n") == std::string_view::npos) {
+      // keep it until the CGI headers are complete
+      std::swap(task->head, output);
+      return;
+    }
+    startStreaming(task, response);
+  } else {
+    relayResponseBody(task, response.out.peek(), response.out.readable());
+  }
+
+  if (response.failed) {
+    // Too late for an error page, the client sees a truncated response
+    task->finished = true;
+    php_tasks_.remove(task->conn->getFd());
+    accountRequest(*task->req, task->status, task->body_sent,
+                   task->upstream_time);
+    traceRequest(*task->req, task->conn->getFd(), task->status, true);
+    task->conn->setContext(nullptr);
+    delete task->req;
+    lock.unlock();
+    server_->close(task->conn);
+    return;
+  }
+  if (response.ended) {
+    task->ended = true;
+    if (task->chunked && !task->skip_body)
+      task->pending.append("0\r\n\r\n", 5);
+  }
+  server_->touch(task->conn, phpRequestTimeout());
+  flushClient(task, lock);
+}
+
+void HttpServer::startStreaming(const std::shared_ptr<PhpTask> &task,
+                                FastCgiConnection::Response &response) {
+  HttpResponse resp(task->conn);
+  size_t index = applyPhpHeader(response, resp);
+  associateRequestSession(*task->req, resp);
+
+  // The status line and headers go to the send buffer, the body follows
+  task->chunked = resp.sendHeader();
+  task->status = resp.getCode();
+  task->skip_body = task->req->getMethod() == HttpMethod::HEAD;
+  task->streaming = true;
+  task->writing = true;
+  response.out.retired(index);
+  relayResponseBody(task, response.out.peek(), response.out.readable());
+}
+
+void HttpServer::relayResponseBody(const std::shared_ptr<PhpTask> &task,
+                                   const char *data, size_t len) {
+  if (len == 0 || task->skip_body)
+    return;
+  task->body_sent += len;
+  if (task->chunked) {
+    char size[20];
+    auto x = std::to_chars(size, size + 16, len, 16);
+    ::memcpy(x.ptr, "\r\n", 2);
+    task->pending.append(size, x.ptr + 2 - size);
+    task->pending.append(data, len);
+    task->pending.append("\r\n", 2);
+  } else {
+    task->pending.append(data, len);
+  }
+
+  // stop reading php-fpm until the client has caught up
+  if (task->pending.readable() > kMaxPendingOutput && !task->upstream_paused &&
+      task->upstream) {
+    task->upstream_paused = true;
+    task->upstream->pause();
   }
+}
 
-  if (req.getMethod() == HttpMethod::HEAD) {
-    fcgi.sendParams(FCGI_Params::REQUEST_METHOD, "HEAD");
-    fcgi.sendEndRequestRecord();
-  } else if (req.getMethod() == HttpMethod::GET) {
-    fcgi.sendParams(FCGI_Params::REQUEST_METHOD, "GET");
-    fcgi.sendEndRequestRecord();
-  } else if (req.getMethod() == HttpMethod::POST) {
-    fcgi.sendParams(FCGI_Params::REQUEST_METHOD, "POST");
-    if (auto type = req.getHeader().get("Content-Type"); type.has_value()) {
-      fcgi.sendParams(FCGI_Params::CONTENT_TYPE, type.value());
-      fcgi.sendParams(FCGI_Params::CONTENT_LENGTH,
-                      std::to_string(req.getPostData().size()));
+void HttpServer::onClientEvent(const std::shared_ptr<PhpTask> &task,
+                               int events) {
+  std::unique_lock<std::mutex> lock(task->mutex);
+  if (task->finished)
+    return;
+  if (events & EPOLLHUP) {
+    lock.unlock();
+    // onClose() cancels the task
+    server_->close(task->conn);
+    return;
+  }
+  if (readingRequestBody(*task)) {
+    const auto [n, again] = task->conn->readAgain();
+    if (n <= 0 && !again) {
+      lock.unlock();
+      server_->close(task->conn);
+      return;
     }
-    fcgi.sendEndRequestRecord();
-    fcgi.sendPost(req.getPostData());
+    forwardRequestBody(task);
   }
+  flushClient(task, lock);
+}
 
-  Buffer buffer;
-  auto ret = fcgi.readPhpFpm(&buffer);
-  req.php_message_ = ret.second;
+bool HttpServer::readingRequestBody(const PhpTask &task) {
+  return task.body_remaining > 0 && task.upstream && !task.body_paused;
+}
+
+void HttpServer::forwardRequestBody(const std::shared_ptr<PhpTask> &task) {
+  Buffer *recver = task->conn->getRecver();
+  size_t n = std::min(recver->readable(), task->body_remaining);
+  if (n == 0)
+    return;
 
-  std::string_view sv(buffer.peek(), buffer.readable());
+  // php-fpm has seen part of the body, a failed request cannot be retried
+  task->retried = true;
+  std::string_view data(recver->peek(), n);
+  bool last = n == task->body_remaining;
+  bool sent = task->upstream->send(task->request_id, [&](PhpFastCgi &fcgi) {
+    fcgi.sendStdin(data);
+    if (last)
+      fcgi.sendStdin({});
+  });
+  recver->retired(n);
+  // when php-fpm has already answered or the connection failed, the task
+  // finishes without the rest of the body
+  if (!sent)
+    return;
+  task->body_remaining -= n;
+  armUpstream(task->upstream);
+
+  // stop reading the client until php-fpm has caught up
+  if (task->upstream->pendingOutput() > kMaxPendingInput &&
+      task->upstream->onDrain(
+          std::bind(&HttpServer::onRequestBodyDrained, this, task)))
+    task->body_paused = true;
+}
+
+void HttpServer::onRequestBodyDrained(const std::shared_ptr<PhpTask> &task) {
+  std::lock_guard<std::mutex> lock(task->mutex);
+  if (task->finished)
+    return;
+  task->body_paused = false;
+  armClient(task);
+}
+
+void HttpServer::flushClient(const std::shared_ptr<PhpTask> &task,
+                             std::unique_lock<std::mutex> &lock) {
+  TcpConnection *conn = task->conn;
+  while (task->writing || task->pending.readable() > 0) {
+    if (!task->writing) {
+      // the send buffer is empty after a completed write, hand it the
+      // pending bytes without copying them
+      std::swap(*conn->getSender(), task->pending);
+      task->writing = true;
+    }
+    const auto [n, again, completed] = conn->writeAgain();
+    if (!completed) {
+      if (n < 0 && !again) {
+        lock.unlock();
+        server_->close(conn);
+        return;
+      }
+      break;
+    }
+    task->writing = false;
+  }
+
+  // the client caught up, let php-fpm continue
+  if (task->upstream_paused && task->pending.readable() == 0) {
+    task->upstream_paused = false;
+    task->upstream->resume();
+    armUpstream(task->upstream);
+  }
+
+  if (task->ended && !task->writing) {
+    // All of the response is written, the connection returns to the server
+    task->finished = true;
+    php_tasks_.remove(conn->getFd());
+    accountRequest(*task->req, task->status, task->body_sent,
+                   task->upstream_time);
+    traceRequest(*task->req, task->conn->getFd(), task->status, true);
+    // the rest of an unread request body cannot be skipped
+    if (task->body_remaining > 0)
+      conn->setKeepAlive(false);
+    conn->setContext(nullptr);
+    delete task->req;
+    server_->resume(conn);
+    return;
+  }
+  armClient(task);
+}
+
+void HttpServer::armClient(const std::shared_ptr<PhpTask> &task) {
+  int events = readingRequestBody(*task) ? (int)EPOLLIN : 0;
+  if (task->writing)
+    events |= EPOLLOUT;
+  server_->rearm(task->conn, events);
+}
+
+void HttpServer::finishPhpTask(const std::shared_ptr<PhpTask> &task, int code,
+                               FastCgiConnection::Response *response) {
+  task->finished = true;
+  php_tasks_.remove(task->conn->getFd());
+
+  HttpResponse resp(task->conn);
+  if (response)
+    applyPhpResponse(*response, *task->req, resp);
+  else
+    resp.setCode(code);
+  // the rest of an unread request body cannot be skipped
+  if (task->body_remaining > 0)
+    resp.builder_->setKeepAlive(false);
+  finishRequest(task->req, resp, task->upstream_time);
+  server_->resume(task->conn);
+}
+
+size_t HttpServer::applyPhpHeader(FastCgiConnection::Response &response,
+                                  HttpResponse &resp) {
+  std::string_view sv(response.out.peek(), response.out.readable());
   HttpHeader header;
 
-  int index = header.parse(sv);
-  resp.setHeader(header);
+  size_t index = header.parse(sv);
   if (auto x = header.get("Status"); x.has_value()) {
     std::string_view status = x.value();
     std::string_view codesv = status.substr(0, status.find_first_of(" "));
     int code = std::atoi(std::string(codesv.data(), codesv.size()).data());
     resp.setCode(code);
+    header.remove("Status");
   }
+  resp.setHeader(header);
+  return index;
+}
+
+void HttpServer::applyPhpResponse(FastCgiConnection::Response &response,
+                                  const HttpRequest &req, HttpResponse &resp) {
+  req.php_message_ = response.message;
 
-  if (!ret.first && resp.getCode() != 200)
+  size_t index = applyPhpHeader(response, resp);
+  if (!response.succeeded() && resp.getCode() != 200)
     return;
 
+  std::string_view sv(response.out.peek(), response.out.readable());
   sv.remove_prefix(index);
   resp.setBody(sv);
 }
@@ -370,8 +1157,9 @@ std::string HttpServer::mappingMimeType(const std::string_view &url) {
   return type;
 }
 
-bool HttpServer::getIndexPageFileName(std::string &dir) {
-  for (const auto &index_page : default_pages_) {
+bool HttpServer::getIndexPageFileName(const HttpMount &mount,
+                                      std::string &dir) {
+  for (const auto &index_page : mount.options.index_pages) {
     if (FileUtil::exist(dir + index_page)) {
       dir += index_page;
       return true;
@@ -0,0 +1,365 @@
+#include "../include/HttpSessionSnapshot.h"
+#include "../../net/include/TimeStamp.h"
+#include "../../utility/include/EncodeUtil.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <typeinfo>
+#include <unistd.h>
+#include <unordered_set>
+
+using namespace soc;
+using namespace soc::http;
+
+namespace {
+constexpr char kMagic[8] = {'S', 'O', 'C', 'S', 'E', 'S', 'S', '\0'};
+constexpr uint32_t kVersion = 1;
+// a table entry whose session was taken, probing continues past it
+constexpr uint64_t kTaken = UINT64_MAX;
+
+enum AttrType : uint8_t {
+  kString = 1,
+  kBool,
+  kInt,
+  kLong,
+  kLongLong,
+  kUnsigned,
+  kDouble,
+  kFloat
+};
+
+template <class T> void put(std::string &out, T value) {
+  out.append((const char *)&value, sizeof(value));
+}
+
+// Bounds-checked reads from the mapping, records are not aligned
+template <class T> bool get(const char *&p, const char *end, T &value) {
+  if ((size_t)(end - p) < sizeof(T))
+    return false;
+  ::memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+bool get(const char *&p, const char *end, size_t len, std::string_view &sv) {
+  if ((size_t)(end - p) < len)
+    return false;
+  sv = std::string_view(p, len);
+  p += len;
+  return true;
+}
+
+template <class T> bool encodeAttr(std::string &out, const std::any &value,
+                                   uint8_t type, std::string_view key) {
+  if (value.type() != typeid(T))
+    return false;
+  T v = std::any_cast<T>(value);
+  put<uint8_t>(out, type);
+  put<uint16_t>(out, key.size());
+  out.append(key);
+  put<uint32_t>(out, sizeof(T));
+  put<T>(out, v);
+  return true;
+}
+
+template <class T> std::any decodeAttr(std::string_view value) {
+  if (value.size() != sizeof(T))
+    return std::any();
+  T v;
+  ::memcpy(&v, value.data(), sizeof(T));
+  return v;
+}
+} // namespace
+
+struct HttpSessionSnapshot::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t slots;
+  uint64_t count;
+};
+
+// A decoded view of one record, pointing into the mapping
+struct HttpSessionSnapshot::Record {
+  // wall clock milliseconds
+  uint64_t expires;
+  int32_t interval;
+  std::string_view id;
+  uint16_t attrs;
+  const char *attr_begin;
+  // the whole record including its length prefix
+  std::string_view raw;
+};
+
+HttpSessionSnapshot::HttpSessionSnapshot(const std::string &path)
+    : path_(path), data_(nullptr), size_(0) {}
+
+HttpSessionSnapshot::~HttpSessionSnapshot() {
+  if (data_)
+    ::munmap(data_, size_);
+}
+
+const HttpSessionSnapshot::Header *HttpSessionSnapshot::header() const {
+  return (const Header *)data_;
+}
+
+uint64_t *HttpSessionSnapshot::slots() const {
+  return (uint64_t *)(data_ + sizeof(Header));
+}
+
+bool HttpSessionSnapshot::open() {
+  int fd = ::open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (::fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Header)) {
+    ::close(fd);
+    return false;
+  }
+  void *p = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED)
+    return false;
+
+  const Header *h = (const Header *)p;
+  uint32_t n = h->slots;
+  if (::memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 ||
+      h->version != kVersion || n == 0 || (n & (n - 1)) != 0 ||
+      sizeof(Header) + (size_t)n * sizeof(uint64_t) > (size_t)st.st_size) {
+    fprintf(stderr, "Ignore invalid session snapshot: %s\n", path_.c_str());
+    ::munmap(p, st.st_size);
+    return false;
+  }
+  std::lock_guard<std::mutex> locker(mutex_);
+  data_ = (char *)p;
+  size_ = st.st_size;
+  return true;
+}
+
+bool HttpSessionSnapshot::decode(uint64_t offset, Record &record) const {
+  if (offset >= size_)
+    return false;
+  const char *begin = data_ + offset;
+  const char *p = begin;
+  const char *end = data_ + size_;
+  uint32_t len;
+  if (!get(p, end, len) || (size_t)(end - p) < len)
+    return false;
+  end = p + len;
+  uint16_t idlen;
+  if (!get(p, end, record.expires) || !get(p, end, record.interval) ||
+      !get(p, end, idlen) || !get(p, end, idlen, record.id) ||
+      !get(p, end, record.attrs))
+    return false;
+  record.attr_begin = p;
+  record.raw = std::string_view(begin, end - begin);
+  return true;
+}
+
+std::shared_ptr<HttpSession>
+HttpSessionSnapshot::restore(const Record &record) const {
+  auto session = std::make_shared<HttpSession>(std::string(record.id),
+                                               record.interval);
+  const char *p = record.attr_begin;
+  const char *end = record.raw.data() + record.raw.size();
+  for (uint16_t i = 0; i < record.attrs; ++i) {
+    uint8_t type;
+    uint16_t keylen;
+    uint32_t vallen;
+    std::string_view key, value;
+    if (!get(p, end, type) || !get(p, end, keylen) ||
+        !get(p, end, keylen, key) || !get(p, end, vallen) ||
+        !get(p, end, vallen, value))
+      break;
+
+    std::any v;
+    switch (type) {
+    case kString:
+      v = std::string(value);
+      break;
+    case kBool:
+      v = decodeAttr<bool>(value);
+      break;
+    case kInt:
+      v = decodeAttr<int>(value);
+      break;
+    case kLong:
+      v = decodeAttr<long>(value);
+      break;
+    case kLongLong:
+      v = decodeAttr<long long>(value);
+      break;
+    case kUnsigned:
+      v = decodeAttr<unsigned>(value);
+      break;
+    case kDouble:
+      v = decodeAttr<double>(value);
+      break;
+    case kFloat:
+      v = decodeAttr<float>(value);
+      break;
+    default:
+      break;
+    }
+    if (v.has_value())
+      session->add(std::string(key), v);
+  }
+  // the client already has the cookie
+  session->setStatus(HttpSession::Accessed);
+  return session;
+}
+
+std::shared_ptr<HttpSession>
+HttpSessionSnapshot::take(const std::string &id) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  if (data_ == nullptr)
+    return nullptr;
+
+  uint32_t n = header()->slots;
+  uint64_t *table = slots();
+  uint32_t i = EncodeUtil::murmurHash2(id) & (n - 1);
+  for (uint32_t probes = 0; probes < n && table[i] != 0;
+       ++probes, i = (i + 1) & (n - 1)) {
+    Record record;
+    if (table[i] == kTaken || !decode(table[i], record) || record.id != id)
+      continue;
+    table[i] = kTaken;
+    if (record.expires <= net::TimeStamp::now().millsecond())
+      return nullptr;
+    return restore(record);
+  }
+  return nullptr;
+}
+
+void HttpSessionSnapshot::encode(std::string &out, const HttpSession &session,
+                                 uint64_t expires) {
+  size_t begin = out.size();
+  put<uint32_t>(out, 0);
+  put<uint64_t>(out, expires);
+  put<int32_t>(out, session.getMaxInactiveInterval());
+  const std::string &id = session.getId();
+  put<uint16_t>(out, id.size());
+  out.append(id);
+
+  size_t count_at = out.size();
+  uint16_t count = 0;
+  put<uint16_t>(out, 0);
+  session.forEach([&](const std::string &key, const std::any &value) {
+    if (value.type() == typeid(std::string)) {
+      const auto &s = std::any_cast<const std::string &>(value);
+      put<uint8_t>(out, kString);
+      put<uint16_t>(out, key.size());
+      out.append(key);
+      put<uint32_t>(out, s.size());
+      out.append(s);
+    } else if (!encodeAttr<bool>(out, value, kBool, key) &&
+               !encodeAttr<int>(out, value, kInt, key) &&
+               !encodeAttr<long>(out, value, kLong, key) &&
+               !encodeAttr<long long>(out, value, kLongLong, key) &&
+               !encodeAttr<unsigned>(out, value, kUnsigned, key) &&
+               !encodeAttr<double>(out, value, kDouble, key) &&
+               !encodeAttr<float>(out, value, kFloat, key)) {
+      // other types cannot be restored
+      return;
+    }
+    ++count;
+  });
+  ::memcpy(&out[count_at], &count, sizeof(count));
+  uint32_t len = out.size() - begin - sizeof(uint32_t);
+  ::memcpy(&out[begin], &len, sizeof(len));
+}
+
+bool HttpSessionSnapshot::save(const HttpSessionStore &store) {
+  uint64_t now = net::TimeStamp::now().millsecond();
+  std::string records;
+  // session ids with their offsets in records
+  std::vector<std::pair<std::string, uint64_t>> index;
+  std::unordered_set<std::string> live;
+
+  store.forEach([&](const std::shared_ptr<HttpSession> &session,
+                    uint64_t remaining) {
+    index.emplace_back(session->getId(), records.size());
+    live.insert(session->getId());
+    encode(records, *session, now + remaining);
+  });
+
+  std::lock_guard<std::mutex> locker(mutex_);
+  // sessions whose clients did not come back since the last restart
+  if (data_) {
+    uint32_t n = header()->slots;
+    uint64_t *table = slots();
+    for (uint32_t i = 0; i < n; ++i) {
+      Record record;
+      if (table[i] == 0 || table[i] == kTaken || !decode(table[i], record) ||
+          record.expires <= now || live.count(std::string(record.id)))
+        continue;
+      index.emplace_back(std::string(record.id), records.size());
+      records.append(record.raw);
+    }
+  }
+
+  uint32_t n = 16;
+  while (n < index.size() * 2)
+    n <<= 1;
+  std::vector<uint64_t> table(n, 0);
+  uint64_t base = sizeof(Header) + (uint64_t)n * sizeof(uint64_t);
+  for (const auto &[id, offset] : index) {
+    uint32_t i = EncodeUtil::murmurHash2(id) & (n - 1);
+    while (table[i] != 0)
+      i = (i + 1) & (n - 1);
+    table[i] = base + offset;
+  }
+
+  Header h;
+  ::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.slots = n;
+  h.count = index.size();
+
+  // written next to the old file and renamed over it
+  std::string tmp = path_ + ".tmp";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "Write session snapshot failed: %s\n", ::strerror(errno));
+    return false;
+  }
+  bool ok = true;
+  for (auto [p, len] : {std::pair<const char *, size_t>((const char *)&h,
+                                                        sizeof(h)),
+                        {(const char *)table.data(), n * sizeof(uint64_t)},
+                        {records.data(), records.size()}}) {
+    while (ok && len > 0) {
+      ssize_t w = ::write(fd, p, len);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w <= 0) {
+        ok = false;
+        break;
+      }
+      p += w;
+      len -= w;
+    }
+  }
+  // on disk before the rename, so that a crash cannot leave a partial file
+  // in place of the previous snapshot
+  if (ok && ::fsync(fd) < 0)
+    ok = false;
+  ::close(fd);
+  if (!ok || ::rename(tmp.c_str(), path_.c_str()) < 0) {
+    fprintf(stderr, "Write session snapshot failed: %s\n", ::strerror(errno));
+    ::unlink(tmp.c_str());
+    return false;
+  }
+  // and the rename itself
+  size_t slash = path_.rfind('/');
+  std::string dir = slash == std::string::npos ? "." : path_.substr(0, slash);
+  if (dir.empty())
+    dir = "/";
+  int dirfd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirfd >= 0) {
+    ::fsync(dirfd);
+    ::close(dirfd);
+  }
+  return true;
+}
@@ -0,0 +1,121 @@
+#include "../include/HttpSessionStore.h"
+#include "../../net/include/TimeStamp.h"
+
+using namespace soc::http;
+using soc::net::TimeStamp;
+
+namespace {
+// expired sessions dropped by a single get() or add(), the rest are left to
+// later calls and sweep()
+constexpr size_t kExpirePerCall = 8;
+} // namespace
+
+HttpSessionStore::HttpSessionStore(size_t capacity)
+    : shard_capacity_(capacity ? (capacity + kShards - 1) / kShards : 0) {}
+
+HttpSessionStore::Shard &HttpSessionStore::shardOf(const std::string &id) {
+  return shards_[std::hash<std::string>{}(id) % kShards];
+}
+
+uint64_t HttpSessionStore::deadlineOf(const HttpSession &session,
+                                      uint64_t now) {
+  return now + (uint64_t)session.getMaxInactiveInterval() * 1000;
+}
+
+std::shared_ptr<HttpSession> HttpSessionStore::get(const std::string &id) {
+  Shard &shard = shardOf(id);
+  uint64_t now = TimeStamp::loopMonotonic();
+  std::lock_guard<std::mutex> locker(shard.mutex);
+  expire(shard, now, kExpirePerCall);
+
+  auto x = shard.index.find(id);
+  if (x == shard.index.end())
+    return nullptr;
+  auto it = x->second;
+  if (it->deadline <= now || it->session->isDestroy()) {
+    erase(shard, it);
+    return nullptr;
+  }
+  it->deadline = deadlineOf(*it->session, now);
+  shard.lru.splice(shard.lru.begin(), shard.lru, it);
+  return it->session;
+}
+
+void HttpSessionStore::add(const std::shared_ptr<HttpSession> &session) {
+  const std::string &id = session->getId();
+  Shard &shard = shardOf(id);
+  uint64_t now = TimeStamp::loopMonotonic();
+  std::lock_guard<std::mutex> locker(shard.mutex);
+  expire(shard, now, kExpirePerCall);
+
+  if (auto x = shard.index.find(id); x != shard.index.end())
+    erase(shard, x->second);
+  // a full shard evicts its least recently used session
+  if (shard_capacity_ > 0 && shard.lru.size() >= shard_capacity_)
+    erase(shard, std::prev(shard.lru.end()));
+  shard.lru.push_front({id, session, deadlineOf(*session, now)});
+  shard.index[id] = shard.lru.begin();
+}
+
+void HttpSessionStore::remove(const std::string &id) {
+  Shard &shard = shardOf(id);
+  std::lock_guard<std::mutex> locker(shard.mutex);
+  if (auto x = shard.index.find(id); x != shard.index.end())
+    erase(shard, x->second);
+}
+
+size_t HttpSessionStore::expire(Shard &shard, uint64_t now, size_t limit) {
+  size_t n = 0;
+  while (n < limit && !shard.lru.empty() && shard.lru.back().deadline <= now) {
+    erase(shard, std::prev(shard.lru.end()));
+    ++n;
+  }
+  return n;
+}
+
+void HttpSessionStore::erase(Shard &shard, std::list<Node>::iterator it) {
+  // requests still using the session keep it alive through their reference
+  it->session->invalidate();
+  shard.index.erase(it->id);
+  shard.lru.erase(it);
+}
+
+size_t HttpSessionStore::sweep() {
+  uint64_t now = TimeStamp::loopMonotonic();
+  size_t n = 0;
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    n += expire(shard, now, SIZE_MAX);
+  }
+  return n;
+}
+
+void HttpSessionStore::forEach(
+    const std::function<void(const std::shared_ptr<HttpSession> &, uint64_t)>
+        &callback) const {
+  uint64_t now = TimeStamp::loopMonotonic();
+  for (const auto &shard : shards_) {
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    for (const auto &node : shard.lru) {
+      if (node.deadline > now && !node.session->isDestroy())
+        callback(node.session, node.deadline - now);
+    }
+  }
+}
+
+size_t HttpSessionStore::size() const {
+  size_t n = 0;
+  for (const auto &shard : shards_) {
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    n += shard.lru.size();
+  }
+  return n;
+}
+
+void HttpSessionStore::clear() {
+  for (auto &shard : shards_) {
+    std::lock_guard<std::mutex> locker(shard.mutex);
+    shard.index.clear();
+    shard.lru.clear();
+  }
+}
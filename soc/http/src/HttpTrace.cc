@@ -0,0 +1,120 @@
+#include "../include/HttpTrace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace soc::http;
+
+namespace {
+// the phase ending at each boundary
+constexpr const char *kPhaseNames[HttpTrace::kPhases] = {
+    "", "receive", "queue", "parse", "route", "handler", "response", "write"};
+
+const char *methodName(HttpMethod method) {
+  switch (method) {
+  case HttpMethod::POST:
+    return "POST";
+  case HttpMethod::HEAD:
+    return "HEAD";
+  default:
+    return "GET";
+  }
+}
+
+void appendEscaped(std::string &out, std::string_view s) {
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c < 0x20) {
+      char buf[8];
+      ::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+}
+
+void appendEvent(std::string &out, std::string_view name, uint64_t ts,
+                 uint64_t dur, int fd) {
+  char buf[128];
+  out += "{\"name\":\"";
+  appendEscaped(out, name);
+  ::snprintf(buf, sizeof(buf),
+             "\",\"cat\":\"http\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,"
+             "\"pid\":%d,\"tid\":%d",
+             (unsigned long long)ts, (unsigned long long)dur, (int)::getpid(),
+             fd);
+  out += buf;
+}
+} // namespace
+
+HttpTracer::HttpTracer(const std::string &path, uint32_t threshold_us,
+                       uint32_t sample)
+    : fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                 0644)),
+      threshold_(threshold_us), sample_(sample ? sample : 1), slow_(0) {
+  if (fd_ < 0) {
+    fprintf(stderr, "Open trace file failed: %s\n", path.c_str());
+    return;
+  }
+  if (::write(fd_, "[\n", 2) != 2)
+    fprintf(stderr, "Write trace file failed: %s\n", path.c_str());
+}
+
+HttpTracer::~HttpTracer() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+void HttpTracer::record(const Entry &entry) {
+  const uint64_t *at = entry.trace.at;
+  int first = 0;
+  while (first < HttpTrace::kPhases && at[first] == 0)
+    ++first;
+  int last = HttpTrace::kPhases - 1;
+  while (last > first && at[last] == 0)
+    --last;
+  if (fd_ < 0 || first >= last || at[last] < at[first] ||
+      at[last] - at[first] < threshold_)
+    return;
+  if (slow_.fetch_add(1, std::memory_order_relaxed) % sample_ != 0)
+    return;
+
+  std::string out;
+  std::string name = methodName(entry.method);
+  name += ' ';
+  name += entry.url;
+  appendEvent(out, name, at[first], at[last] - at[first], entry.fd);
+  char buf[64];
+  ::snprintf(buf, sizeof(buf), ",\"args\":{\"status\":%d}},\n", entry.status);
+  out += buf;
+
+  // boundaries passed out of order are left out, and so is the receive
+  // phase of a request that came in a single read
+  uint64_t begin = at[first];
+  for (int i = first + 1; i <= last; ++i) {
+    if (at[i] == 0 || at[i] < begin ||
+        (i == HttpTrace::Ready && at[i] == begin))
+      continue;
+    appendEvent(out, kPhaseNames[i], begin, at[i] - begin, entry.fd);
+    out += "},\n";
+    begin = at[i];
+  }
+
+  std::lock_guard<std::mutex> locker(mutex_);
+  const char *p = out.data();
+  size_t len = out.size();
+  while (len > 0) {
+    ssize_t n = ::write(fd_, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    p += n;
+    len -= n;
+  }
+}
@@ -19,6 +19,7 @@ namespace libjson {
 class JsonArray : public JsonValue {
 public:
   friend class JsonFormatter;
+  friend class JsonParser;
 
   JsonArray() : JsonValue(JsonType::Array) {}
   ~JsonArray() {}
@@ -0,0 +1,193 @@
+#ifndef LIBJSON_JSONDOCUMENT_H
+#define LIBJSON_JSONDOCUMENT_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string_view>
+#include <utility>
+
+#include "JsonObject.h"
+#include "JsonScanner.h"
+
+namespace libjson {
+
+// Bump allocator behind a JsonDocument, the blocks are only freed together
+class JsonArena {
+public:
+  JsonArena() {}
+  JsonArena(const JsonArena &) = delete;
+  JsonArena &operator=(const JsonArena &) = delete;
+  JsonArena(JsonArena &&other) noexcept { swap(other); }
+  JsonArena &operator=(JsonArena &&other) noexcept {
+    clear();
+    swap(other);
+    return *this;
+  }
+  ~JsonArena() { clear(); }
+
+  // Returns 8 byte aligned memory
+  void *allocate(size_t size) {
+    size = (size + 7) & ~size_t(7);
+    if ((size_t)(__limit - __cur) < size)
+      return allocateBlock(size);
+    void *p = __cur;
+    __cur += size;
+    return p;
+  }
+  void clear();
+
+  // Bytes held from malloc
+  size_t capacity() const noexcept { return __capacity; }
+
+private:
+  struct Block {
+    Block *next;
+  };
+
+  void *allocateBlock(size_t size);
+  void swap(JsonArena &other) noexcept {
+    std::swap(__blocks, other.__blocks);
+    std::swap(__cur, other.__cur);
+    std::swap(__limit, other.__limit);
+    std::swap(__capacity, other.__capacity);
+  }
+
+  Block *__blocks = nullptr;
+  char *__cur = nullptr;
+  char *__limit = nullptr;
+  size_t __capacity = 0;
+};
+
+// A value of a JsonDocument in 16 bytes. Strings point into the parsed text,
+// or into the arena when they had escapes to decode. Objects keep their key
+// and value nodes in turn, arrays their elements, both in one arena block
+class JsonNode {
+public:
+  JsonType type() const noexcept { return (JsonType)__type; }
+  bool isInteger() const noexcept { return __flags & kInteger; }
+
+  // Members of an object, elements of an array or bytes of a string
+  size_t size() const noexcept {
+    switch (type()) {
+    case JsonType::Object:
+    case JsonType::Array:
+    case JsonType::String:
+      return __size;
+    default:
+      return 0;
+    }
+  }
+  bool empty() const noexcept { return size() == 0; }
+
+  // Element of an array, nullptr when out of range
+  const JsonNode *get(int index) const {
+    if (type() != JsonType::Array || index < 0 || (size_t)index >= __size)
+      return nullptr;
+    return __items + index;
+  }
+  // Key and value of an object member, both nullptr when out of range
+  std::pair<const JsonNode *, const JsonNode *> member(int index) const {
+    if (type() != JsonType::Object || index < 0 || (size_t)index >= __size)
+      return {nullptr, nullptr};
+    return {__items + 2 * index, __items + 2 * index + 1};
+  }
+  const JsonNode *find(std::string_view key) const {
+    if (type() != JsonType::Object)
+      return nullptr;
+    for (size_t i = 0; i < __size; i++) {
+      if (__items[2 * i].str() == key)
+        return __items + 2 * i + 1;
+    }
+    return nullptr;
+  }
+
+  // The decoded text of a string, empty for other types
+  std::string_view str() const noexcept {
+    if (type() != JsonType::String)
+      return std::string_view();
+    return std::string_view(__string, __size);
+  }
+  // Same conversions as JsonValue::value, T is std::string, int, double or
+  // bool
+  template <class T> T value() const;
+
+  // Return unformatted json text
+  std::string toString() const {
+    std::string s;
+    write(s);
+    return s;
+  }
+  // Copies the value into JsonObject, JsonArray and the other JsonValue
+  // classes, for JsonFormatter and older code
+  std::shared_ptr<JsonValue> toJsonValue() const;
+
+private:
+  friend class JsonDocumentBuilder;
+
+  enum Flag : uint8_t { kInteger = 1, kDecoded = 2 };
+
+  void write(std::string &s) const;
+
+  uint8_t __type;
+  uint8_t __flags;
+  uint32_t __size;
+  union {
+    double __number;
+    bool __boolean;
+    const char *__string;
+    const JsonNode *__items;
+  };
+};
+static_assert(sizeof(JsonNode) == 16);
+
+template <> inline std::string JsonNode::value<std::string>() const {
+  return std::string(str());
+}
+template <> inline double JsonNode::value<double>() const {
+  return type() == JsonType::Number ? __number : 0.0;
+}
+template <> inline int JsonNode::value<int>() const {
+  return type() == JsonType::Number ? (int)__number : 0;
+}
+template <> inline bool JsonNode::value<bool>() const {
+  return type() == JsonType::Boolean ? __boolean : false;
+}
+
+// A parsed document whose nodes are allocated from one arena and freed
+// together with it, instead of one shared_ptr per value. Syntax errors throw
+// JsonSyntaxError, like JsonParser
+class JsonDocument {
+public:
+  JsonDocument() {}
+  explicit JsonDocument(std::string_view text) { parse(text); }
+  JsonDocument(JsonDocument &&other) noexcept
+      : __arena(std::move(other.__arena)),
+        __root(std::exchange(other.__root, nullptr)) {}
+  JsonDocument &operator=(JsonDocument &&other) noexcept {
+    __arena = std::move(other.__arena);
+    __root = std::exchange(other.__root, nullptr);
+    return *this;
+  }
+
+  // Parses a copy of text kept in the arena. The nodes of an earlier parse
+  // are released first
+  const JsonNode *parse(std::string_view text);
+  // Like parse without the copy, the strings point into text, which must
+  // outlive the document
+  const JsonNode *parseInPlace(std::string_view text);
+
+  // nullptr for an empty document
+  const JsonNode *root() const noexcept { return __root; }
+  bool isObject() const { return __root && __root->type() == JsonType::Object; }
+  bool isArray() const { return __root && __root->type() == JsonType::Array; }
+
+  size_t memory() const noexcept { return __arena.capacity(); }
+
+private:
+  JsonArena __arena;
+  const JsonNode *__root = nullptr;
+};
+
+} // namespace libjson
+#endif
@@ -17,18 +17,11 @@ class JsonLexer {
 public:
   friend class JsonParser;
 
-  JsonLexer(const std::string &text, bool escape = true) try
-      : escape(escape), reader(text) {
-  } catch (std::exception &e) {
-    fprintf(stderr, "%s\n", e.what());
-    exit(-1);
-  }
-  JsonLexer(std::ifstream &ifs, bool escape = true) try
-      : escape(escape), reader(ifs) {
-  } catch (std::exception &e) {
-    fprintf(stderr, "%s\n", e.what());
-    exit(-1);
-  }
+  // An empty document throws JsonError
+  JsonLexer(const std::string &text, bool escape = true)
+      : escape(escape), reader(text) {}
+  JsonLexer(std::ifstream &ifs, bool escape = true)
+      : escape(escape), reader(ifs) {}
 
   ~JsonLexer() {}
 
@@ -14,6 +14,7 @@ public:
       std::pair<std::shared_ptr<JsonString>, std::shared_ptr<JsonValue>>;
 
   friend class JsonFormatter;
+  friend class JsonParser;
 
   JsonObject() : JsonValue(JsonType::Object) {}
 
@@ -0,0 +1,121 @@
+#ifndef LIBJSON_JSONSAXPARSER_H
+#define LIBJSON_JSONSAXPARSER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "JsonScanner.h"
+
+namespace libjson {
+
+// Receives the events of a JsonSaxParser. Strings arrive decoded and the
+// views are only valid during the call. Throwing a JsonError stops the parse
+class JsonSaxHandler {
+public:
+  virtual ~JsonSaxHandler() {}
+
+  virtual void onStartObject() {}
+  virtual void onEndObject() {}
+  virtual void onStartArray() {}
+  virtual void onEndArray() {}
+  virtual void onKey(std::string_view key) {}
+  virtual void onString(std::string_view value) {}
+  virtual void onNumber(double value, bool integer) {}
+  virtual void onBoolean(bool value) {}
+  virtual void onNull() {}
+};
+
+// Push parser for a document that arrives in pieces: feed() takes every chunk
+// as it is read and reports the values completed in it, finish() marks the
+// end of the document. Apart from one entry per open container, only a
+// literal split between two chunks is kept, up to max_literal bytes. Syntax
+// errors throw JsonSyntaxError with the position in the whole document, the
+// grammar is the one of JsonParser
+class JsonSaxParser : protected JsonScanner {
+public:
+  explicit JsonSaxParser(JsonSaxHandler *handler,
+                         size_t max_literal = 1024 * 1024)
+      : __handler(handler), __max_literal(max_literal) {}
+
+  void feed(const char *data, size_t size);
+  void feed(std::string_view data) { feed(data.data(), data.size()); }
+  void finish();
+
+  // Number of open objects and arrays
+  int depth() const noexcept { return (int)__stack.size(); }
+  // Whether a whole value has been read
+  bool done() const noexcept { return __expect == Expect::Done; }
+
+private:
+  // What may come next
+  enum class Expect : uint8_t {
+    Value,
+    ValueOrClose,
+    ValueAfterComma,
+    ValueAfterColon,
+    KeyOrClose,
+    KeyAfterComma,
+    Colon,
+    CommaOrClose,
+    Done
+  };
+  // The literal being read, possibly over several chunks
+  enum class Literal : uint8_t {
+    None,
+    String,
+    Number,
+    Identifier,
+    CommentStart,
+    LineComment,
+    BlockComment
+  };
+  struct Container {
+    char type;
+    int line;
+    int col;
+  };
+
+  const char *beginLiteral(Literal literal, const char *p, const char *end);
+  const char *scanLiteral(const char *begin, const char *p, const char *end);
+  void endLiteral(std::string_view text);
+  void beginValue(char c);
+  void endValue() {
+    __expect = __stack.empty() ? Expect::Done : Expect::CommaOrClose;
+  }
+  void push(char c);
+  void pop(char c);
+  void advance(const char *begin, const char *end);
+
+  [[noreturn]] void unexpected(char c) const;
+  [[noreturn]] void fail(int line, int col, const std::string &msg) const {
+    throw JsonSyntaxError(line, col, msg);
+  }
+
+private:
+  JsonSaxHandler *__handler;
+  size_t __max_literal;
+  std::vector<Container> __stack;
+  Expect __expect = Expect::Value;
+
+  Literal __literal = Literal::None;
+  // the string literal is an object key
+  bool __key = false;
+  // the last character of the string literal was an escaping backslash
+  bool __escape = false;
+  // the last character of the block comment was '*'
+  bool __star = false;
+  // the part of the literal from earlier chunks
+  std::string __token;
+  int __literal_line = 1;
+  int __literal_col = 1;
+
+  // position of the next character
+  int __at_line = 1;
+  int __at_col = 1;
+};
+
+} // namespace libjson
+#endif
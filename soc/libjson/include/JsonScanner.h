@@ -0,0 +1,67 @@
+#ifndef LIBJSON_JSONSCANNER_H
+#define LIBJSON_JSONSCANNER_H
+
+#include <string>
+#include <string_view>
+
+#include "JsonError.h"
+#include "JsonUtil.h"
+#include "JsonValue.h"
+
+namespace libjson {
+
+// Reads the json grammar from a character range: whitespace and comments,
+// separators and literals. JsonParser and JsonDocument build their values on
+// top of it. Syntax errors throw JsonSyntaxError with the line and column
+// (both from 1) of the offending character
+class JsonScanner {
+public:
+  // Deeper documents are rejected instead of overflowing the stack
+  static constexpr int kMaxDepth = 512;
+
+protected:
+  // line and col are the position of begin, for a range that starts in the
+  // middle of a document
+  void reset(const char *begin, const char *end, int line = 1, int col = 1) {
+    __begin = __p = begin;
+    __end = end;
+    __line = line;
+    __col = col;
+  }
+
+  // Skips whitespace and comments, returns the next character or -1 at the
+  // end of the document
+  int skip();
+  // Fails when something other than whitespace follows the document
+  void finish();
+
+  // At '{' or '[': consumes it and returns false when the container is
+  // empty, the closing character is consumed too
+  bool open(int depth, char close);
+  // At the start of an object member: returns the key and consumes the ':'
+  std::string_view key(const char *begin, bool &escaped);
+  // After a member or an element: consumes the ',' and returns true, or
+  // consumes the closing character and returns false
+  bool next(const char *begin, const char *value_begin, char close);
+
+  // Returns the text between the quotes, escaped is set when it contains
+  // a backslash. The escapes are checked but not decoded
+  std::string_view scanString(bool &escaped);
+  double scanNumber(bool &integer);
+  // true, false or null
+  JsonType scanIdentifier(bool &value);
+
+  [[noreturn]] void error(const char *at, const std::string &msg) const;
+  std::string describe(const char *at) const;
+  std::string excerpt(const char *begin, const char *end) const;
+
+protected:
+  const char *__begin = nullptr;
+  const char *__p = nullptr;
+  const char *__end = nullptr;
+  int __line = 1;
+  int __col = 1;
+};
+
+} // namespace libjson
+#endif
@@ -11,6 +11,10 @@ public:
       : JsonValue(JsonType::String), isEscaped(isEscaped) {
     __tupleValuePackage = std::make_tuple(value, 0, 0.0, false);
   }
+  JsonString(std::string &&value, bool isEscaped = true)
+      : JsonValue(JsonType::String), isEscaped(isEscaped) {
+    __tupleValuePackage = std::make_tuple(std::move(value), 0, 0.0, false);
+  }
   std::string toString() { return "\"" + value<std::string>() + "\""; }
 
   std::string toString(bool escape) {
@@ -0,0 +1,278 @@
+#include "../include/JsonDocument.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+namespace {
+// Blocks start small for small documents and double up to kMaxBlockSize,
+// larger requests get a block of their own
+constexpr size_t kMinBlockSize = 4096;
+constexpr size_t kMaxBlockSize = 1024 * 1024;
+} // namespace
+
+namespace libjson {
+
+void *JsonArena::allocateBlock(size_t size) {
+  size_t block_size =
+      std::min(std::max(__capacity, kMinBlockSize), kMaxBlockSize);
+  bool own = size > block_size / 2;
+  if (own)
+    block_size = size;
+
+  Block *block = (Block *)::malloc(sizeof(Block) + block_size);
+  if (!block)
+    throw std::bad_alloc();
+  __capacity += sizeof(Block) + block_size;
+  char *data = (char *)(block + 1);
+
+  if (own && __blocks) {
+    // keep bumping the current block
+    block->next = __blocks->next;
+    __blocks->next = block;
+    return data;
+  }
+  block->next = __blocks;
+  __blocks = block;
+  __cur = data + size;
+  __limit = data + block_size;
+  return data;
+}
+
+void JsonArena::clear() {
+  while (__blocks) {
+    Block *next = __blocks->next;
+    ::free(__blocks);
+    __blocks = next;
+  }
+  __cur = __limit = nullptr;
+  __capacity = 0;
+}
+
+// Fills JsonNodes from the scanner. The children of the open containers
+// wait on one stack and are copied into the arena when the container closes,
+// so the extra memory is bounded by the widest path through the document
+class JsonDocumentBuilder : protected JsonScanner {
+public:
+  explicit JsonDocumentBuilder(JsonArena &arena) : __arena(arena) {}
+
+  const JsonNode *build(std::string_view text) {
+    reset(text.data(), text.data() + text.size());
+    if (skip() < 0)
+      return nullptr;
+    JsonNode root;
+    parseValue(root, 0);
+    finish();
+    JsonNode *node = (JsonNode *)__arena.allocate(sizeof(JsonNode));
+    *node = root;
+    return node;
+  }
+
+private:
+  void parseValue(JsonNode &node, int depth);
+  void parseObject(JsonNode &node, int depth);
+  void parseArray(JsonNode &node, int depth);
+  void setString(JsonNode &node, std::string_view s, bool escaped);
+  void setItems(JsonNode &node, size_t mark, size_t size);
+
+  JsonArena &__arena;
+  std::vector<JsonNode> __stack;
+};
+
+void JsonDocumentBuilder::parseValue(JsonNode &node, int depth) {
+  node.__flags = 0;
+  int c = skip();
+  switch (c) {
+  case '{':
+    return parseObject(node, depth + 1);
+  case '[':
+    return parseArray(node, depth + 1);
+  case '"': {
+    bool escaped;
+    std::string_view s = scanString(escaped);
+    return setString(node, s, escaped);
+  }
+  case 't':
+  case 'f':
+  case 'n':
+    node.__type = (uint8_t)scanIdentifier(node.__boolean);
+    node.__size = 0;
+    return;
+  default:
+    break;
+  }
+  if (isnumber(c) || c == '-' || c == '+') {
+    bool integer;
+    node.__type = (uint8_t)JsonType::Number;
+    node.__number = scanNumber(integer);
+    node.__flags = integer ? JsonNode::kInteger : 0;
+    node.__size = 0;
+    return;
+  }
+  error(__p, "invalid token " + describe(__p));
+}
+
+void JsonDocumentBuilder::parseObject(JsonNode &node, int depth) {
+  const char *begin = __p;
+  size_t mark = __stack.size();
+  node.__type = (uint8_t)JsonType::Object;
+  if (open(depth, '}')) {
+    JsonNode child;
+    for (;;) {
+      bool escaped;
+      std::string_view k = key(begin, escaped);
+      setString(child, k, escaped);
+      __stack.push_back(child);
+      const char *value_begin = __p;
+      parseValue(child, depth);
+      __stack.push_back(child);
+      if (!next(begin, value_begin, '}'))
+        break;
+    }
+  }
+  setItems(node, mark, (__stack.size() - mark) / 2);
+}
+
+void JsonDocumentBuilder::parseArray(JsonNode &node, int depth) {
+  const char *begin = __p;
+  size_t mark = __stack.size();
+  node.__type = (uint8_t)JsonType::Array;
+  if (open(depth, ']')) {
+    JsonNode child;
+    for (;;) {
+      if (skip() < 0)
+        error(begin, "array [ missing ] character");
+      const char *value_begin = __p;
+      parseValue(child, depth);
+      __stack.push_back(child);
+      if (!next(begin, value_begin, ']'))
+        break;
+    }
+  }
+  setItems(node, mark, __stack.size() - mark);
+}
+
+void JsonDocumentBuilder::setString(JsonNode &node, std::string_view s,
+                                    bool escaped) {
+  node.__type = (uint8_t)JsonType::String;
+  node.__flags = 0;
+  if (escaped) {
+    std::string decoded = escape_string(std::string(s));
+    char *p = (char *)__arena.allocate(decoded.size());
+    ::memcpy(p, decoded.data(), decoded.size());
+    s = std::string_view(p, decoded.size());
+    node.__flags = JsonNode::kDecoded;
+  }
+  if (s.size() > UINT32_MAX)
+    error(__p, "string too long");
+  node.__string = s.data();
+  node.__size = s.size();
+}
+
+void JsonDocumentBuilder::setItems(JsonNode &node, size_t mark, size_t size) {
+  size_t n = __stack.size() - mark;
+  if (size > UINT32_MAX)
+    error(__p, "too many values");
+  node.__flags = 0;
+  node.__size = size;
+  node.__items = nullptr;
+  if (n > 0) {
+    JsonNode *items = (JsonNode *)__arena.allocate(n * sizeof(JsonNode));
+    ::memcpy(items, __stack.data() + mark, n * sizeof(JsonNode));
+    node.__items = items;
+  }
+  __stack.resize(mark);
+}
+
+void JsonNode::write(std::string &s) const {
+  switch (type()) {
+  case JsonType::Object:
+    s += '{';
+    for (size_t i = 0; i < __size; i++) {
+      if (i > 0)
+        s += ',';
+      __items[2 * i].write(s);
+      s += ':';
+      __items[2 * i + 1].write(s);
+    }
+    s += '}';
+    break;
+  case JsonType::Array:
+    s += '[';
+    for (size_t i = 0; i < __size; i++) {
+      if (i > 0)
+        s += ',';
+      __items[i].write(s);
+    }
+    s += ']';
+    break;
+  case JsonType::String:
+    s += '"';
+    // undecoded strings are still valid json text
+    if (__flags & kDecoded)
+      s += unescape_string(std::string(str()));
+    else
+      s += str();
+    s += '"';
+    break;
+  case JsonType::Number:
+    s += isInteger() ? toStr<int>((int)__number) : toStr<double>(__number);
+    break;
+  case JsonType::Boolean:
+    s += __boolean ? "true" : "false";
+    break;
+  case JsonType::Null:
+    s += "null";
+    break;
+  }
+}
+
+std::shared_ptr<JsonValue> JsonNode::toJsonValue() const {
+  switch (type()) {
+  case JsonType::Object: {
+    auto object = std::make_shared<JsonObject>();
+    for (size_t i = 0; i < __size; i++)
+      object->add(std::make_shared<JsonString>(
+                      __items[2 * i].value<std::string>(), true),
+                  __items[2 * i + 1].toJsonValue());
+    return object;
+  }
+  case JsonType::Array: {
+    auto array = std::make_shared<JsonArray>();
+    for (size_t i = 0; i < __size; i++)
+      array->add(__items[i].toJsonValue());
+    return array;
+  }
+  case JsonType::String:
+    return std::make_shared<JsonString>(value<std::string>(), true);
+  case JsonType::Number:
+    return std::make_shared<JsonNumber>(__number, isInteger());
+  case JsonType::Boolean:
+    return std::make_shared<JsonBoolean>(__boolean);
+  default:
+    return std::make_shared<JsonNull>();
+  }
+}
+
+const JsonNode *JsonDocument::parse(std::string_view text) {
+  __root = nullptr;
+  __arena.clear();
+  char *copy = (char *)__arena.allocate(text.size());
+  if (!text.empty())
+    ::memcpy(copy, text.data(), text.size());
+  JsonDocumentBuilder builder(__arena);
+  __root = builder.build(std::string_view(copy, text.size()));
+  return __root;
+}
+
+const JsonNode *JsonDocument::parseInPlace(std::string_view text) {
+  __root = nullptr;
+  __arena.clear();
+  JsonDocumentBuilder builder(__arena);
+  __root = builder.build(text);
+  return __root;
+}
+
+} // namespace libjson
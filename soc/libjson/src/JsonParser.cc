@@ -2,121 +2,102 @@
 
 using namespace libjson;
 
-void JsonParser::parseJsonObject(std::shared_ptr<JsonObject> &object) {
-  while (__tokenIndex < __tokenLength) {
-    auto key = lexer.token_list[__tokenIndex++];
-    // }
-    if (key->tag() == Tag::JSON_OBJECT_END) {
-      handle_after_object_array_closure_exception(key.get());
-      break;
-    }
-    // ,
-    if (key->tag() == Tag::JSON_SEP) {
-      handle_after_separators_exception();
-      continue;
-    }
-    handle_key_not_string_exception(key.get());
+JsonParser::result_type JsonParser::parse() {
+  __object_ptr = nullptr;
+  __array_ptr = nullptr;
+  __value_ptr = nullptr;
+  reset(__text.data(), __text.data() + __text.size());
 
-    std::shared_ptr<JsonString> key_ptr =
-        std::make_shared<JsonString>(key->value<std::string>(), lexer.escape);
+  int c = skip();
+  if (c < 0)
+    return std::make_tuple(__object_ptr, __array_ptr, __value_ptr);
 
-    handle_object_missing_separator_exception(key.get());
+  std::shared_ptr<JsonObject> object;
+  std::shared_ptr<JsonArray> array;
+  std::shared_ptr<JsonValue> value;
+  if (c == '{')
+    object = parseJsonObject(1);
+  else if (c == '[')
+    array = parseJsonArray(1);
+  else
+    value = parseValue(0);
+  finish();
 
-    // skip :
-    __tokenIndex++;
+  __object_ptr = std::move(object);
+  __array_ptr = std::move(array);
+  __value_ptr = std::move(value);
+  return std::make_tuple(__object_ptr, __array_ptr, __value_ptr);
+}
 
-    handle_object_missing_value();
+std::shared_ptr<JsonValue> JsonParser::parseValue(int depth) {
+  int c = skip();
+  switch (c) {
+  case '{':
+    return parseJsonObject(depth + 1);
+  case '[':
+    return parseJsonArray(depth + 1);
+  case '"': {
+    bool escaped;
+    std::string_view s = scanString(escaped);
+    return makeString(s, escaped);
+  }
+  case 't':
+  case 'f':
+  case 'n': {
+    bool value;
+    if (scanIdentifier(value) == JsonType::Null)
+      return std::make_shared<JsonNull>();
+    return std::make_shared<JsonBoolean>(value);
+  }
+  default:
+    break;
+  }
+  if (isnumber(c) || c == '-' || c == '+') {
+    bool integer;
+    double value = scanNumber(integer);
+    return std::make_shared<JsonNumber>(value, integer);
+  }
+  error(__p, "invalid token " + describe(__p));
+}
 
-    auto value = lexer.token_list[__tokenIndex++];
-    handle_missing_separator_exception(value.get());
+std::shared_ptr<JsonObject> JsonParser::parseJsonObject(int depth) {
+  const char *begin = __p;
+  auto object = std::make_shared<JsonObject>();
+  if (!open(depth, '}'))
+    return object;
 
-    std::shared_ptr<JsonValue> value_ptr = nullptr;
-    switch (value->tag()) {
-    case Tag::JSON_OBJECT_BEGIN: { // {
-      handle_after_object_array_exception(value.get());
-      std::shared_ptr<JsonObject> object_ptr = std::make_shared<JsonObject>();
-      parseJsonObject(object_ptr);
-      value_ptr = object_ptr;
-    } break;
-    case Tag::JSON_ARRAY_BEGIN: { // [
-      handle_after_object_array_exception(value.get());
-      std::shared_ptr<JsonArray> array_ptr = std::make_shared<JsonArray>();
-      parseJsonArray(array_ptr);
-      value_ptr = array_ptr;
-    } break;
-    case Tag::JSON_NUMBER:
-      value_ptr = std::make_shared<JsonNumber>(value->value<int>(), true);
-      break;
-    case Tag::JSON_FLOAT:
-      value_ptr = std::make_shared<JsonNumber>(value->value<double>(), false);
-      break;
-    case Tag::JSON_STRING:
-      value_ptr = std::make_shared<JsonString>(value->value<std::string>(),
-                                               lexer.escape);
-      break;
-    case Tag::JSON_NULL:
-      value_ptr = std::make_shared<JsonNull>();
-      break;
-    case Tag::JSON_TRUE:
-    case Tag::JSON_FALSE:
-      value_ptr = std::make_shared<JsonBoolean>(value->value<bool>());
-      break;
-    default:
-      break;
-    }
-    object->add(key_ptr, value_ptr);
+  for (;;) {
+    bool escaped;
+    std::string_view k = key(begin, escaped);
+    auto key_ptr = makeString(k, escaped);
+    const char *value_begin = __p;
+    object->__kvObjects.emplace_back(std::move(key_ptr), parseValue(depth));
+    if (!next(begin, value_begin, '}'))
+      return object;
   }
 }
 
-void JsonParser::parseJsonArray(std::shared_ptr<JsonArray> &array) {
-  while (__tokenIndex < __tokenLength) {
-    auto value = lexer.token_list[__tokenIndex++];
-    // ]
-    if (value->tag() == Tag::JSON_ARRAY_END) {
-      handle_after_object_array_closure_exception(value.get());
-      break;
-    }
-    // ,
-    if (value->tag() == Tag::JSON_SEP) {
-      handle_after_separators_exception();
-      continue;
-    }
-    handle_missing_separator_exception(value.get());
+std::shared_ptr<JsonArray> JsonParser::parseJsonArray(int depth) {
+  const char *begin = __p;
+  auto array = std::make_shared<JsonArray>();
+  if (!open(depth, ']'))
+    return array;
 
-    std::shared_ptr<JsonValue> value_ptr = nullptr;
-    switch (value->tag()) {
-    case Tag::JSON_OBJECT_BEGIN: { // {
-      handle_after_object_array_exception(value.get());
-      std::shared_ptr<JsonObject> object_ptr = std::make_shared<JsonObject>();
-      parseJsonObject(object_ptr);
-      value_ptr = object_ptr;
-    } break;
-    case Tag::JSON_ARRAY_BEGIN: { // [
-      handle_after_object_array_exception(value.get());
-      std::shared_ptr<JsonArray> array_ptr = std::make_shared<JsonArray>();
-      parseJsonArray(array_ptr);
-      value_ptr = array_ptr;
-    } break;
-    case Tag::JSON_NUMBER:
-      value_ptr = std::make_shared<JsonNumber>(value->value<int>(), true);
-      break;
-    case Tag::JSON_FLOAT:
-      value_ptr = std::make_shared<JsonNumber>(value->value<double>(), false);
-      break;
-    case Tag::JSON_STRING:
-      value_ptr = std::make_shared<JsonString>(value->value<std::string>(),
-                                               lexer.escape);
-      break;
-    case Tag::JSON_NULL:
-      value_ptr = std::make_shared<JsonNull>();
-      break;
-    case Tag::JSON_TRUE:
-    case Tag::JSON_FALSE:
-      value_ptr = std::make_shared<JsonBoolean>(value->value<bool>());
-      break;
-    default:
-      break;
-    }
-    array->add(value_ptr);
+  for (;;) {
+    if (skip() < 0)
+      error(begin, "array [ missing ] character");
+    const char *value_begin = __p;
+    array->__lstValue.emplace_back(parseValue(depth));
+    if (!next(begin, value_begin, ']'))
+      return array;
   }
-}
\ No newline at end of file
+}
+
+std::shared_ptr<JsonString> JsonParser::makeString(std::string_view s,
+                                                   bool escaped) {
+  // Strings without a backslash are copied as they are
+  std::string value(s);
+  if (escaped && __escape)
+    value = escape_string(value);
+  return std::make_shared<JsonString>(std::move(value), __escape);
+}
@@ -0,0 +1,349 @@
+#include "../include/JsonSaxParser.h"
+#include <string.h>
+
+using namespace libjson;
+
+namespace {
+inline bool isnumberchar(char c) {
+  return isnumber(c) || c == '-' || c == '+' || c == '.' || isexponent(c);
+}
+} // namespace
+
+void JsonSaxParser::feed(const char *data, size_t size) {
+  const char *p = data;
+  const char *end = data + size;
+  if (__literal != Literal::None)
+    p = scanLiteral(nullptr, p, end);
+
+  while (p < end) {
+    char c = *p;
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '\v':
+    case '\f':
+    case '\r':
+      break;
+    case '\n':
+      ++__at_line;
+      __at_col = 1;
+      ++p;
+      continue;
+    case '{':
+    case '[':
+      push(c);
+      break;
+    case '}':
+    case ']':
+      pop(c);
+      break;
+    case ',':
+      if (__expect != Expect::CommaOrClose)
+        unexpected(c);
+      __expect = __stack.back().type == '{' ? Expect::KeyAfterComma
+                                            : Expect::ValueAfterComma;
+      break;
+    case ':':
+      if (__expect != Expect::Colon)
+        unexpected(c);
+      __expect = Expect::ValueAfterColon;
+      break;
+    case '/':
+      p = beginLiteral(Literal::CommentStart, p, end);
+      continue;
+    case '"':
+      __key = __expect == Expect::KeyOrClose ||
+              __expect == Expect::KeyAfterComma;
+      if (!__key)
+        beginValue(c);
+      p = beginLiteral(Literal::String, p, end);
+      continue;
+    default:
+      if (isnumber(c) || c == '-' || c == '+') {
+        beginValue(c);
+        p = beginLiteral(Literal::Number, p, end);
+        continue;
+      }
+      if (isletter(c)) {
+        beginValue(c);
+        p = beginLiteral(Literal::Identifier, p, end);
+        continue;
+      }
+      fail(__at_line, __at_col, "invalid token '" + std::string(1, c) + "'");
+    }
+    ++__at_col;
+    ++p;
+  }
+}
+
+void JsonSaxParser::finish() {
+  switch (__literal) {
+  case Literal::None:
+  case Literal::LineComment:
+    break;
+  case Literal::String:
+    fail(__literal_line, __literal_col, "string missing end character \"");
+  case Literal::CommentStart:
+    fail(__literal_line, __literal_col, "invalid comment // /* */");
+  case Literal::BlockComment:
+    fail(__literal_line, __literal_col, "comment /* missing */");
+  default:
+    // numbers and identifiers end with the document
+    endLiteral(__token);
+    break;
+  }
+  __literal = Literal::None;
+
+  if (!__stack.empty()) {
+    const Container &open = __stack.back();
+    fail(open.line, open.col,
+         open.type == '{' ? "object { missing } character"
+                          : "array [ missing ] character");
+  }
+}
+
+const char *JsonSaxParser::beginLiteral(Literal literal, const char *p,
+                                        const char *end) {
+  __literal = literal;
+  __literal_line = __at_line;
+  __literal_col = __at_col;
+  __escape = false;
+  __star = false;
+  __token.clear();
+  return scanLiteral(p, p, end);
+}
+
+// Reads the literal up to its end or the end of the chunk, begin is where it
+// starts when that is in this chunk. A complete literal is reported, the
+// part of an incomplete one is kept for the next chunk
+const char *JsonSaxParser::scanLiteral(const char *begin, const char *p,
+                                       const char *end) {
+  const char *start = begin ? begin : p;
+  const char *q = p;
+  bool complete = false;
+
+  switch (__literal) {
+  case Literal::String: {
+    if (begin)
+      q = begin + 1;
+    const char *quote = nullptr;
+    while (q < end) {
+      if (__escape) {
+        __escape = false;
+        ++q;
+        continue;
+      }
+      if (quote < q) {
+        quote = (const char *)::memchr(q, '"', end - q);
+        if (!quote)
+          quote = end;
+      }
+      const char *bs = (const char *)::memchr(q, '\\', quote - q);
+      if (bs) {
+        q = bs + 1;
+        __escape = true;
+        continue;
+      }
+      q = quote;
+      if (q < end) {
+        ++q;
+        complete = true;
+      }
+      break;
+    }
+  } break;
+  case Literal::Number:
+    while (q < end && isnumberchar(*q))
+      ++q;
+    complete = q < end;
+    break;
+  case Literal::Identifier:
+    while (q < end && isletter(*q))
+      ++q;
+    complete = q < end;
+    break;
+  default: {
+    // comments are skipped, not kept
+    if (begin)
+      q = begin + 1;
+    if (__literal == Literal::CommentStart && q < end) {
+      if (*q == '/')
+        __literal = Literal::LineComment;
+      else if (*q == '*')
+        __literal = Literal::BlockComment;
+      else
+        fail(__literal_line, __literal_col, "invalid comment // /* */");
+      ++q;
+    }
+    if (__literal == Literal::LineComment) {
+      // the newline is left to feed()
+      const char *eol = (const char *)::memchr(q, '\n', end - q);
+      q = eol ? eol : end;
+      complete = eol != nullptr;
+    } else if (__literal == Literal::BlockComment) {
+      while (q < end) {
+        char c = *q++;
+        if (__star && c == '/') {
+          complete = true;
+          break;
+        }
+        __star = c == '*';
+      }
+    }
+    advance(start, q);
+    if (complete)
+      __literal = Literal::None;
+    return q;
+  }
+  }
+
+  advance(start, q);
+  if (!complete) {
+    __token.append(start, q - start);
+    if (__token.size() > __max_literal)
+      fail(__literal_line, __literal_col,
+           "literal longer than " + std::to_string(__max_literal) + " bytes");
+    return q;
+  }
+  if (begin) {
+    endLiteral(std::string_view(begin, q - begin));
+  } else {
+    __token.append(p, q - p);
+    endLiteral(__token);
+  }
+  return q;
+}
+
+void JsonSaxParser::endLiteral(std::string_view text) {
+  Literal literal = __literal;
+  __literal = Literal::None;
+  reset(text.data(), text.data() + text.size(), __literal_line,
+        __literal_col);
+
+  switch (literal) {
+  case Literal::String: {
+    bool escaped;
+    std::string_view s = scanString(escaped);
+    std::string decoded;
+    if (escaped) {
+      decoded = escape_string(std::string(s));
+      s = decoded;
+    }
+    if (__key) {
+      __expect = Expect::Colon;
+      __handler->onKey(s);
+    } else {
+      endValue();
+      __handler->onString(s);
+    }
+  } break;
+  case Literal::Number: {
+    bool integer;
+    double value = scanNumber(integer);
+    if (__p != __end)
+      error(__p, "invalid token " + describe(__p));
+    endValue();
+    __handler->onNumber(value, integer);
+  } break;
+  default: {
+    bool value;
+    JsonType type = scanIdentifier(value);
+    if (__p != __end)
+      error(__p, "invalid token " + describe(__p));
+    endValue();
+    if (type == JsonType::Null)
+      __handler->onNull();
+    else
+      __handler->onBoolean(value);
+  } break;
+  }
+  __token.clear();
+}
+
+void JsonSaxParser::beginValue(char c) {
+  switch (__expect) {
+  case Expect::Value:
+  case Expect::ValueOrClose:
+  case Expect::ValueAfterComma:
+  case Expect::ValueAfterColon:
+    break;
+  default:
+    unexpected(c);
+  }
+}
+
+void JsonSaxParser::push(char c) {
+  beginValue(c);
+  if ((int)__stack.size() >= kMaxDepth)
+    fail(__at_line, __at_col, "nesting too deep");
+  __stack.push_back({c, __at_line, __at_col});
+  if (c == '{') {
+    __expect = Expect::KeyOrClose;
+    __handler->onStartObject();
+  } else {
+    __expect = Expect::ValueOrClose;
+    __handler->onStartArray();
+  }
+}
+
+void JsonSaxParser::pop(char c) {
+  char type = c == '}' ? '{' : '[';
+  Expect empty = c == '}' ? Expect::KeyOrClose : Expect::ValueOrClose;
+  if (__expect != empty && !(__expect == Expect::CommaOrClose &&
+                             __stack.back().type == type))
+    unexpected(c);
+  __stack.pop_back();
+  endValue();
+  if (c == '}')
+    __handler->onEndObject();
+  else
+    __handler->onEndArray();
+}
+
+void JsonSaxParser::advance(const char *begin, const char *end) {
+  const char *nl = (const char *)::memchr(begin, '\n', end - begin);
+  if (!nl) {
+    __at_col += end - begin;
+    return;
+  }
+  while (nl) {
+    ++__at_line;
+    begin = nl + 1;
+    nl = (const char *)::memchr(begin, '\n', end - begin);
+  }
+  __at_col = end - begin + 1;
+}
+
+void JsonSaxParser::unexpected(char c) const {
+  std::string s = "'" + std::string(1, c) + "'";
+  bool separator = c == ',' || c == ':' || c == '}' || c == ']';
+  switch (__expect) {
+  case Expect::KeyOrClose:
+  case Expect::ValueOrClose:
+    if (separator)
+      fail(__at_line, __at_col,
+           "after [ or { invalid character occurried " + s);
+    break;
+  case Expect::KeyAfterComma:
+  case Expect::ValueAfterComma:
+    if (separator)
+      fail(__at_line, __at_col,
+           "after ',' some invalid characters occurried " + s);
+    break;
+  case Expect::ValueAfterColon:
+    fail(__at_line, __at_col, "object missing a value before " + s);
+  case Expect::Colon:
+    fail(__at_line, __at_col, "missing : separator before " + s);
+  case Expect::CommaOrClose:
+    if (c == '}' || c == ']')
+      fail(__at_line, __at_col,
+           __stack.back().type == '{' ? "object { missing } character"
+                                      : "array [ missing ] character");
+    fail(__at_line, __at_col, "missing end character ,/]/} before " + s);
+  default:
+    break;
+  }
+  if (__expect == Expect::KeyOrClose || __expect == Expect::KeyAfterComma)
+    fail(__at_line, __at_col, "object key is not string type " + s);
+  fail(__at_line, __at_col, "invalid token " + s);
+}
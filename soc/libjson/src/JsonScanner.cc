@@ -0,0 +1,260 @@
+#include "../include/JsonScanner.h"
+#include <charconv>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace libjson;
+
+namespace {
+// Longest integer literal accumulated without overflowing int64_t
+constexpr long kMaxIntegerDigits = 18;
+
+inline bool isseparator(int c) {
+  return c == ',' || c == ':' || c == '}' || c == ']';
+}
+} // namespace
+
+int JsonScanner::skip() {
+  while (__p < __end) {
+    switch (*__p) {
+    case ' ':
+    case '\t':
+    case '\v':
+    case '\f':
+    case '\r':
+    case '\n':
+      ++__p;
+      break;
+    // Comment // ... /* ... */
+    case '/': {
+      const char *begin = __p;
+      if (__p + 1 < __end && __p[1] == '/') {
+        const char *eol = (const char *)::memchr(__p, '\n', __end - __p);
+        __p = eol ? eol + 1 : __end;
+      } else if (__p + 1 < __end && __p[1] == '*') {
+        __p += 2;
+        while (__p + 1 < __end && !(__p[0] == '*' && __p[1] == '/'))
+          ++__p;
+        if (__p + 1 >= __end)
+          error(begin, "comment /* missing */");
+        __p += 2;
+      } else {
+        error(begin, "invalid comment // /* */");
+      }
+    } break;
+    default:
+      return (unsigned char)*__p;
+    }
+  }
+  return -1;
+}
+
+void JsonScanner::finish() {
+  if (skip() >= 0)
+    error(__p, "invalid token " + describe(__p));
+}
+
+bool JsonScanner::open(int depth, char close) {
+  if (depth > kMaxDepth)
+    error(__p, "nesting too deep");
+  ++__p;
+  int c = skip();
+  if (c == close) {
+    ++__p;
+    return false;
+  }
+  if (isseparator(c))
+    error(__p, "after [ or { invalid character occurried " + describe(__p));
+  return true;
+}
+
+std::string_view JsonScanner::key(const char *begin, bool &escaped) {
+  int c = skip();
+  if (c < 0)
+    error(begin, "object { missing } character");
+  if (c != '"')
+    error(__p, "object key is not string type " + describe(__p));
+  const char *key_begin = __p;
+  std::string_view key = scanString(escaped);
+  const char *key_end = __p;
+
+  c = skip();
+  if (c < 0)
+    error(begin, "object { missing } character");
+  if (c != ':')
+    error(__p, "between " + excerpt(key_begin, key_end) + " and " +
+                   describe(__p) + " missing : separator");
+  ++__p;
+  c = skip();
+  if (c < 0 || isseparator(c))
+    error(__p, "object missing a value before " + describe(__p));
+  return key;
+}
+
+bool JsonScanner::next(const char *begin, const char *value_begin,
+                       char close) {
+  const char *value_end = __p;
+  int c = skip();
+  if (c == ',') {
+    ++__p;
+    c = skip();
+    if (isseparator(c))
+      error(__p,
+            "after ',' some invalid characters occurried " + describe(__p));
+    return true;
+  }
+  if (c == close) {
+    ++__p;
+    return false;
+  }
+  if (c < 0 || c == '}' || c == ']')
+    error(c < 0 ? begin : __p, close == '}' ? "object { missing } character"
+                                            : "array [ missing ] character");
+  if (value_end[-1] == '}' || value_end[-1] == ']')
+    error(__p, "error syntax: ]/} " + describe(__p));
+  error(__p, "between " + excerpt(value_begin, value_end) + " and " +
+                 describe(__p) + " missing end character ,/]/}. ");
+}
+
+std::string_view JsonScanner::scanString(bool &escaped) {
+  const char *begin = __p++;
+  const char *quote = nullptr;
+  escaped = false;
+
+  // Find the closing quote, checking the escapes on the way
+  for (;;) {
+    if (quote < __p) {
+      quote = (const char *)::memchr(__p, '"', __end - __p);
+      if (!quote)
+        error(begin, "string missing end character \"");
+    }
+    const char *bs = (const char *)::memchr(__p, '\\', quote - __p);
+    if (!bs) {
+      __p = quote;
+      break;
+    }
+    escaped = true;
+    __p = bs + 1;
+    // a backslash is always followed by another character before quote
+    if (!is_valid_next_escape_character(*__p))
+      error(bs, "invalid escape character '" + std::string(1, *__p) + "'");
+    char c = *__p++;
+    if (c == 'u') {
+      for (int i = 0; i < 4; i++, __p++)
+        if (__p == __end || !ishex(*__p))
+          error(bs, "need 4 hexadecimal digits after \\u");
+    } else if (c == 'x') {
+      if (__p == __end || !ishex(*__p))
+        error(bs, "need hexadecimal digits after \\x");
+    }
+  }
+
+  std::string_view value(begin + 1, __p - begin - 1);
+  ++__p;
+  return value;
+}
+
+double JsonScanner::scanNumber(bool &integer) {
+  const char *begin = __p;
+  const char *q = __p;
+  bool negative = *q == '-';
+  if (*q == '-' || *q == '+')
+    ++q;
+  if (q == __end || !isnumber(*q))
+    error(begin, "invalid number " + describe(begin));
+  if (*q == '0' && q + 1 < __end && isnumber(q[1]))
+    error(begin, "leading zeros in decimal integer literals are not "
+                 "permitted");
+
+  const char *digits = q;
+  int64_t n = 0;
+  while (q < __end && isnumber(*q)) {
+    if (q - digits < kMaxIntegerDigits)
+      n = n * 10 + (*q - '0');
+    ++q;
+  }
+  integer = true;
+  // If there is a decimal point or exponent E,
+  // then it is treated as a floating point
+  if (q < __end && *q == '.') {
+    integer = false;
+    if (++q == __end || !isnumber(*q))
+      error(begin, "invalid float number");
+    while (q < __end && isnumber(*q))
+      ++q;
+  }
+  if (q < __end && isexponent(*q)) {
+    integer = false;
+    if (++q < __end && (*q == '+' || *q == '-'))
+      ++q;
+    if (q == __end || !isnumber(*q))
+      error(begin, "invalid float number");
+    while (q < __end && isnumber(*q))
+      ++q;
+  }
+  __p = q;
+
+  if (integer && q - digits <= kMaxIntegerDigits)
+    return negative ? -(double)n : (double)n;
+  // the text may not be NUL terminated, strtod only sees a copy when the
+  // value is out of range
+  double value;
+  const char *first = *begin == '+' ? begin + 1 : begin;
+  if (std::from_chars(first, q, value).ec != std::errc())
+    value = ::strtod(std::string(first, q).c_str(), nullptr);
+  return value;
+}
+
+JsonType JsonScanner::scanIdentifier(bool &value) {
+  size_t left = __end - __p;
+  switch (*__p) {
+  case 't':
+    if (left < 4 || ::memcmp(__p, "true", 4) != 0)
+      error(__p, "not [true] identifier");
+    __p += 4;
+    value = true;
+    return JsonType::Boolean;
+  case 'f':
+    if (left < 5 || ::memcmp(__p, "false", 5) != 0)
+      error(__p, "not [false] identifier");
+    __p += 5;
+    value = false;
+    return JsonType::Boolean;
+  default:
+    if (left < 4 || ::memcmp(__p, "null", 4) != 0)
+      error(__p, "not [null] identifier");
+    __p += 4;
+    value = false;
+    return JsonType::Null;
+  }
+}
+
+void JsonScanner::error(const char *at, const std::string &msg) const {
+  // Lines are only counted on the error path
+  int line = __line;
+  const char *line_begin = __begin;
+  for (const char *q = __begin; q < at; ++q) {
+    if (*q == '\n') {
+      ++line;
+      line_begin = q + 1;
+    }
+  }
+  int col = at - line_begin + 1;
+  throw JsonSyntaxError(line, line == __line ? col + __col - 1 : col, msg);
+}
+
+std::string JsonScanner::describe(const char *at) const {
+  if (at >= __end)
+    return "end of document";
+  const char *end = at;
+  while (end < __end && end - at < 16 && *end != '\n' && *end != '\r')
+    ++end;
+  return excerpt(at, end == at ? at + 1 : end);
+}
+
+std::string JsonScanner::excerpt(const char *begin, const char *end) const {
+  if (end - begin > 32)
+    return "'" + std::string(begin, 32) + "...'";
+  return "'" + std::string(begin, end) + "'";
+}
@@ -0,0 +1,124 @@
+#ifndef SOC_MODULE_FASTCGICONNECTION_H
+#define SOC_MODULE_FASTCGICONNECTION_H
+
+#include "PhpFastCgi.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace soc {
+
+// One non-blocking upstream socket carrying FastCGI requests.
+// Requests get their own request id and their records are queued in a shared
+// output buffer, response records are demultiplexed by id. A connection to an
+// upstream without FCGI_MPXS_CONNS carries a single request at a time.
+// Response output is handed over as it arrives, the callbacks of a connection
+// run one at a time and in the order the records were received
+class FastCgiConnection {
+public:
+  // Output of one request received since the previous callback
+  struct Response {
+    net::Buffer out;
+    std::string message = "OK";
+    bool has_error = false;
+    // FCGI_END_REQUEST was received
+    bool ended = false;
+    // and its protocol status was FCGI_REQUEST_COMPLETE
+    bool complete = false;
+    // the connection failed before FCGI_END_REQUEST
+    bool failed = false;
+    // some of the request's records had been written to the socket when it
+    // failed, php-fpm may have run the script
+    bool written = false;
+
+    // the last callback of the request
+    bool finished() const noexcept { return ended || failed; }
+    // false when php-fpm wrote to FCGI_STDERR or the request did not complete
+    bool succeeded() const noexcept { return complete && !has_error; }
+  };
+
+  using Encoder = std::function<void(PhpFastCgi &)>;
+  using Callback = std::function<void(Response &)>;
+  using Task = std::function<void()>;
+
+  FastCgiConnection(int fd, bool multiplexed);
+  ~FastCgiConnection();
+
+  // Allocate a request id, let encoder queue the records of the request and
+  // start writing them. callback runs whenever output arrives and a last time
+  // when the request ended or the connection failed. Returns 0 when the
+  // connection cannot take the request
+  int submit(const Encoder &encoder, const Callback &callback);
+  // Queue more records of a submitted request, e.g. its request body
+  bool send(int id, const Encoder &encoder);
+  // Forget a request whose client went away. The upstream is told with
+  // FCGI_ABORT_REQUEST; false means the connection is not multiplexed and
+  // must be closed instead
+  bool abort(int id);
+
+  // Flush queued records and parse the available response records, the
+  // callbacks run after the connection is unlocked. A single call reads a
+  // bounded amount, re-arming the fd picks up the rest. Returns false when
+  // the connection failed
+  bool handleEvent();
+
+  // Stop reading responses until every pause() is matched by a resume(),
+  // used when a client cannot keep up. There is no flow control per request
+  // in FastCGI, a paused multiplexed connection holds back all its requests
+  void pause();
+  void resume();
+  bool paused() const;
+  // Run task once every queued record has been written. Returns false and
+  // drops task when nothing is queued
+  bool onDrain(const Task &task);
+
+  int getFd() const noexcept { return fd_; }
+  bool multiplexed() const noexcept { return multiplexed_; }
+  bool good() const;
+  bool hasPendingOutput() const;
+  size_t pendingOutput() const;
+  size_t active() const;
+
+  // true only for the first caller, who registers the fd with the event loop
+  bool markWatched() { return !watched_.exchange(true); }
+
+private:
+  struct Request {
+    Callback callback;
+    Response response;
+    // written_ when the first record of the request was queued
+    uint64_t start = 0;
+  };
+
+  int allocateId();
+  int flush();
+  int read();
+  void fail();
+  // Run the queued callbacks unless another thread is already doing so
+  void deliver(std::unique_lock<std::mutex> &lock);
+
+private:
+  int fd_;
+  bool multiplexed_;
+  bool good_;
+  int next_id_;
+  std::atomic<bool> watched_;
+  int paused_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<int, Request> requests_;
+  std::vector<Task> drain_tasks_;
+  std::deque<Task> deliveries_;
+  bool delivering_;
+  net::Buffer output_;
+  net::Buffer input_;
+  // bytes written to the socket so far
+  uint64_t written_;
+};
+
+} // namespace soc
+
+#endif
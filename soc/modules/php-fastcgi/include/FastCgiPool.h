@@ -0,0 +1,85 @@
+#ifndef SOC_MODULE_FASTCGIPOOL_H
+#define SOC_MODULE_FASTCGIPOOL_H
+
+#include "FastCgiConnection.h"
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace soc {
+
+// Persistent FCGI_KEEP_CONN connections to one php-fpm upstream.
+// The pool size is the configured upper bound, lowered to FCGI_MAX_CONNS once
+// the upstream has answered FCGI_GET_VALUES. When the upstream also reports
+// FCGI_MPXS_CONNS, every connection carries several requests and at most
+// FCGI_MAX_REQS requests are in flight in total; otherwise a connection
+// carries one request at a time. New connections are opened by the executor,
+// never by acquire() or release(), whose callers may hold locks
+class FastCgiPool {
+public:
+  using Connection = std::shared_ptr<FastCgiConnection>;
+  using Waiter = std::function<void(Connection)>;
+  using Executor = std::function<void(const std::function<void()> &)>;
+
+  // TCP upstream
+  FastCgiPool(const std::string &ip, uint16_t port, size_t max_conns);
+  // Unix domain socket upstream
+  FastCgiPool(const std::string &sockpath, size_t max_conns);
+
+  // Runs the connects and the FCGI_GET_VALUES probe, they are run in place
+  // without one
+  void setExecutor(const Executor &executor) { executor_ = executor; }
+
+  // Reserve a request slot on a connection. Never waits: when every slot is
+  // taken or a connection has to be opened first, waiter is queued and
+  // pending is set. It is later called with a connection on the thread that
+  // freed a slot or opened the connection, or with nullptr when the upstream
+  // cannot be reached
+  Connection acquire(const Waiter &waiter, bool &pending);
+  // Return the slot reserved by acquire()
+  void release(const Connection &conn);
+  // Forget a failed connection, it is closed once nobody references it
+  void remove(const Connection &conn);
+
+  size_t capacity() const;
+  bool multiplexed() const;
+
+private:
+  struct Entry {
+    Connection conn;
+    size_t inflight;
+  };
+
+  int connectUpstream() const;
+  // On the executor: connect, then hand the new slots to the waiters
+  void open();
+  void startOpen();
+  // open is set when the caller has to startOpen() once the lock is released
+  Connection tryAcquire(bool &pending, bool &open);
+  bool probe();
+  void wakeWaiter(std::unique_lock<std::mutex> &lock);
+  static bool alive(int fd);
+
+private:
+  bool tcp_;
+  std::string ip_;
+  uint16_t port_;
+  std::string sockpath_;
+
+  mutable std::mutex mutex_;
+  std::vector<Entry> conns_;
+  std::deque<Waiter> waiters_;
+  // connections being opened
+  size_t opening_;
+  size_t inflight_;
+  size_t max_conns_;
+  size_t max_reqs_;
+  bool mpxs_;
+  bool probed_;
+  Executor executor_;
+};
+
+} // namespace soc
+
+#endif
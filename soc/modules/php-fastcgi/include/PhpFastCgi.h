@@ -3,12 +3,9 @@
 
 #include "../../../net/include/Buffer.h"
 #include "FastCgi.h"
-#include <arpa/inet.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <sys/un.h>
-#include <unistd.h>
-#include <unordered_map>
+#include <string>
+#include <string_view>
 
 namespace soc {
 
@@ -29,40 +26,60 @@ enum class FCGI_Params {
 
   PHP_AUTH_USER,
   PHP_AUTH_PW,
-  PHP_AUTH_DIGEST
+  PHP_AUTH_DIGEST,
+
+  SCRIPT_NAME,
+  REQUEST_URI,
+  DOCUMENT_URI,
+  DOCUMENT_ROOT,
+  SERVER_ADDR,
+  SERVER_PROTOCOL,
+  SERVER_SOFTWARE,
+  GATEWAY_INTERFACE,
+  REMOTE_PORT,
+  REDIRECT_STATUS
 };
 
 namespace net {
 class Buffer;
 }
 
+// Encoder of the records of one FastCGI responder request. Records are
+// appended to an output buffer, usually the one of a FastCgiConnection that
+// may carry other requests as well, so a whole request goes out in a single
+// write. Parameters are collected into one name-value stream and sent as few
+// PARAMS records as possible, every record is padded to 8 bytes
 class PhpFastCgi {
 public:
-  explicit PhpFastCgi(int reqid = 1);
-  ~PhpFastCgi();
-
-  bool connectPhpFpm(const std::string &ip, uint16_t port);
-  bool connectPhpFpm(const std::string &sockpath);
+  PhpFastCgi(net::Buffer *output, int reqid, bool keepconn);
 
   FCGI_Header makeHeader(int type, int request, int contentlen, int paddinglen);
   FCGI_BeginRequestBody makeBeginRequestBody(int role, int keepconn);
-  void makeNameValueBody(const std::string &name, const std::string &value,
-                         unsigned char *body, int *bodylen);
   void sendStartRequestRecord();
-  void sendParams(FCGI_Params name, const std::string &value);
+  void sendParams(FCGI_Params name, std::string_view value);
+  void sendParams(std::string_view name, std::string_view value);
+  // A request header as HTTP_<NAME>, e.g. Accept-Language: HTTP_ACCEPT_LANGUAGE
+  void sendHeaderParams(std::string_view header, std::string_view value);
+  // Flush the collected parameters and end the PARAMS stream
   void sendEndRequestRecord();
+  void sendAbortRequestRecord();
 
+  // STDIN records for a piece of the request body, empty data ends the body
+  void sendStdin(std::string_view data);
   void sendPost(const std::string_view &postdata);
 
-  std::pair<bool, std::string> readPhpFpm(net::Buffer *buffer);
-
-  int getFd() const { return sockfd_; }
   int getRequestId() const { return requestId_; }
 
 private:
-  std::unordered_map<FCGI_Params, std::string> params_;
-  int sockfd_;
+  void appendLength(size_t len);
+  void appendRecord(int type, const char *content, size_t contentlen);
+
+private:
+  // name-value pairs not sent yet
+  std::string params_;
+  net::Buffer *output_;
   int requestId_;
+  bool keepconn_;
 };
 
 } // namespace soc
@@ -0,0 +1,274 @@
+#include "../include/FastCgiConnection.h"
+#include <errno.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace soc;
+
+namespace {
+// 每次事件最多读取的字节数，超过后先把输出交给请求，由事件循环再次触发读取
+constexpr size_t kMaxReadPerEvent = 256 * 1024;
+} // namespace
+
+FastCgiConnection::FastCgiConnection(int fd, bool multiplexed)
+    : fd_(fd), multiplexed_(multiplexed), good_(true), next_id_(1),
+      watched_(false), paused_(0), delivering_(false), written_(0) {}
+
+FastCgiConnection::~FastCgiConnection() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+bool FastCgiConnection::good() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return good_;
+}
+
+bool FastCgiConnection::hasPendingOutput() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return output_.readable() > 0;
+}
+
+size_t FastCgiConnection::pendingOutput() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return output_.readable();
+}
+
+size_t FastCgiConnection::active() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return requests_.size();
+}
+
+int FastCgiConnection::allocateId() {
+  if (!multiplexed_)
+    return requests_.empty() ? 1 : 0;
+  // request ids are 16 bits and 0 is reserved for management records
+  for (int i = 0; i < 0xffff; ++i) {
+    int id = next_id_;
+    next_id_ = next_id_ == 0xffff ? 1 : next_id_ + 1;
+    if (requests_.count(id) == 0)
+      return id;
+  }
+  return 0;
+}
+
+int FastCgiConnection::submit(const Encoder &encoder,
+                              const Callback &callback) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!good_)
+    return 0;
+  int id = allocateId();
+  if (id == 0)
+    return 0;
+
+  requests_[id].callback = callback;
+  requests_[id].start = written_ + output_.readable();
+  PhpFastCgi fcgi(&output_, id, true);
+  encoder(fcgi);
+  if (flush() < 0)
+    good_ = false;
+  return id;
+}
+
+bool FastCgiConnection::send(int id, const Encoder &encoder) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!good_ || requests_.count(id) == 0)
+    return false;
+  PhpFastCgi fcgi(&output_, id, true);
+  encoder(fcgi);
+  if (flush() < 0)
+    good_ = false;
+  return good_;
+}
+
+bool FastCgiConnection::abort(int id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = requests_.find(id);
+  if (it == requests_.end())
+    return true;
+  if (!multiplexed_) {
+    requests_.erase(it);
+    good_ = false;
+    return false;
+  }
+  // the id stays in use until php-fpm answers with FCGI_END_REQUEST
+  it->second.callback = nullptr;
+  PhpFastCgi(&output_, id, true).sendAbortRequestRecord();
+  if (flush() < 0)
+    good_ = false;
+  return true;
+}
+
+bool FastCgiConnection::handleEvent() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool ok = good_;
+  if (ok) {
+    int n = flush();
+    ok = n >= 0 && read() >= 0;
+    if (ok && n > 0) {
+      for (auto &task : drain_tasks_)
+        deliveries_.push_back(std::move(task));
+      drain_tasks_.clear();
+    }
+  }
+  if (!ok)
+    fail();
+  deliver(lock);
+  return ok;
+}
+
+void FastCgiConnection::pause() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++paused_;
+}
+
+void FastCgiConnection::resume() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (paused_ > 0)
+    --paused_;
+}
+
+bool FastCgiConnection::paused() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return paused_ > 0;
+}
+
+bool FastCgiConnection::onDrain(const Task &task) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!good_ || output_.readable() == 0)
+    return false;
+  drain_tasks_.push_back(task);
+  return true;
+}
+
+void FastCgiConnection::fail() {
+  // every request in flight fails with what it has received so far
+  good_ = false;
+  for (auto &[id, request] : requests_) {
+    if (!request.callback)
+      continue;
+    request.response.failed = true;
+    request.response.written = written_ > request.start;
+    deliveries_.push_back([callback = std::move(request.callback),
+                           response = std::move(request.response)]() mutable {
+      callback(response);
+    });
+  }
+  requests_.clear();
+  drain_tasks_.clear();
+}
+
+void FastCgiConnection::deliver(std::unique_lock<std::mutex> &lock) {
+  if (delivering_)
+    return;
+  delivering_ = true;
+  while (!deliveries_.empty()) {
+    Task task = std::move(deliveries_.front());
+    deliveries_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+  delivering_ = false;
+}
+
+// 1: all queued records were written, 0: EAGAIN, -1: error
+int FastCgiConnection::flush() {
+  while (output_.readable() > 0) {
+    ssize_t n = ::write(fd_, output_.peek(), output_.readable());
+    if (n > 0) {
+      output_.retired(n);
+      written_ += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return 0;
+    } else {
+      return -1;
+    }
+  }
+  return 1;
+}
+
+// 0: EAGAIN, paused or enough read for now, -1: error or EOF
+int FastCgiConnection::read() {
+  // requests that received output, handed over after this round of reading
+  std::vector<int> touched;
+  size_t received = 0;
+  int ret = 0;
+  while (true) {
+    // 解析所有完整的记录
+    while (input_.readable() >= FCGI_HEADER_LEN) {
+      const FCGI_Header *header = (const FCGI_Header *)input_.peek();
+      size_t contentLen = (header->contentLengthB1 << 8) + header->contentLengthB0;
+      size_t recordLen = FCGI_HEADER_LEN + contentLen + header->paddingLength;
+      if (input_.readable() < recordLen)
+        break;
+
+      const char *content = input_.peek() + FCGI_HEADER_LEN;
+      int requestId = (header->requestIdB1 << 8) + header->requestIdB0;
+      // 跳过不属于任何请求的记录
+      if (auto it = requests_.find(requestId); it != requests_.end()) {
+        Response &response = it->second.response;
+        if (header->type == FCGI_STDOUT) {
+          // PHP-FPM正常返回输出
+          response.out.append(content, contentLen);
+          if (touched.empty() || touched.back() != requestId)
+            touched.push_back(requestId);
+        } else if (header->type == FCGI_STDERR) {
+          // PHP-FPM返回异常错误
+          if (!response.has_error)
+            response.message.clear();
+          response.has_error = true;
+          response.message.append(content, contentLen);
+        } else if (header->type == FCGI_END_REQUEST) {
+          const FCGI_EndRequestBody *end = (const FCGI_EndRequestBody *)content;
+          response.ended = true;
+          response.complete = contentLen >= sizeof(FCGI_EndRequestBody) &&
+                              end->protocolStatus == FCGI_REQUEST_COMPLETE;
+          if (it->second.callback)
+            deliveries_.push_back(
+                [callback = std::move(it->second.callback),
+                 response = std::move(response)]() mutable {
+                  callback(response);
+                });
+          requests_.erase(it);
+        }
+      }
+      input_.retired(recordLen);
+    }
+
+    if (paused_ > 0 || received >= kMaxReadPerEvent)
+      break;
+    input_.ensureWritable(kBufferSize);
+    ssize_t n = ::read(fd_, input_.beginWrite(), input_.writable());
+    if (n > 0) {
+      input_.hasWritten(n);
+      received += n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      ret = -1;
+      break;
+    }
+  }
+
+  // 将新收到的输出交给请求，不拷贝数据
+  for (int id : touched) {
+    auto it = requests_.find(id);
+    if (it == requests_.end() || !it->second.callback ||
+        it->second.response.out.readable() == 0)
+      continue;
+    Response partial;
+    std::swap(partial.out, it->second.response.out);
+    partial.message = it->second.response.message;
+    partial.has_error = it->second.response.has_error;
+    deliveries_.push_back([callback = it->second.callback,
+                           response = std::move(partial)]() mutable {
+      callback(response);
+    });
+  }
+  return ret;
+}
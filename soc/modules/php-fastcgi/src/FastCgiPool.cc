@@ -0,0 +1,324 @@
+#include "../include/FastCgiPool.h"
+#include "../include/FastCgi.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string_view>
+#include <unistd.h>
+
+using namespace soc;
+
+namespace {
+// Read one FastCGI name-value length, 1 or 4 bytes
+bool readLength(const unsigned char *&p, const unsigned char *end,
+                size_t &len) {
+  if (p >= end)
+    return false;
+  if (*p < 0x80) {
+    len = *p++;
+    return true;
+  }
+  if (end - p < 4)
+    return false;
+  len = ((p[0] & 0x7f) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+  p += 4;
+  return true;
+}
+
+// requests per multiplexed connection when FCGI_MAX_REQS is unknown
+constexpr size_t kMaxRequestsPerConnection = 64;
+// an upstream that takes longer to accept counts as unreachable
+constexpr int kConnectTimeout = 1000;
+
+// Connect a non-blocking socket, waiting at most kConnectTimeout
+bool connectSocket(int fd, const struct sockaddr *addr, socklen_t len) {
+  if (::connect(fd, addr, len) == 0)
+    return true;
+  if (errno != EINPROGRESS && errno != EAGAIN)
+    return false;
+  struct pollfd pfd = {fd, POLLOUT, 0};
+  int n;
+  do {
+    n = ::poll(&pfd, 1, kConnectTimeout);
+  } while (n < 0 && errno == EINTR);
+  if (n == 0) {
+    errno = ETIMEDOUT;
+    return false;
+  }
+  int err = 0;
+  socklen_t errlen = sizeof(err);
+  if (n < 0 || ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0)
+    return false;
+  errno = err;
+  return err == 0;
+}
+} // namespace
+
+FastCgiPool::FastCgiPool(const std::string &ip, uint16_t port,
+                         size_t max_conns)
+    : tcp_(true), ip_(ip), port_(port), opening_(0), inflight_(0),
+      max_conns_(max_conns ? max_conns : 1), max_reqs_(0), mpxs_(false),
+      probed_(false) {}
+
+FastCgiPool::FastCgiPool(const std::string &sockpath, size_t max_conns)
+    : tcp_(false), port_(0), sockpath_(sockpath), opening_(0), inflight_(0),
+      max_conns_(max_conns ? max_conns : 1), max_reqs_(0), mpxs_(false),
+      probed_(false) {}
+
+// Returns a non-blocking socket
+int FastCgiPool::connectUpstream() const {
+  int fd = -1;
+  bool connected;
+  if (tcp_) {
+    fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    struct sockaddr_in si;
+    ::memset(&si, 0, sizeof(si));
+    si.sin_addr.s_addr = ::inet_addr(ip_.c_str());
+    si.sin_family = AF_INET;
+    si.sin_port = ::htons(port_);
+    connected = connectSocket(fd, (struct sockaddr *)&si, sizeof(si));
+  } else {
+    fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    struct sockaddr_un un;
+    ::memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    ::strncpy(un.sun_path, sockpath_.data(), sizeof(un.sun_path) - 1);
+    connected = connectSocket(fd, (struct sockaddr *)&un, sizeof(un));
+  }
+  if (!connected) {
+    fprintf(stderr, "Connect php-fpm server failed: %s\n", ::strerror(errno));
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Ask the upstream for FCGI_MAX_CONNS, FCGI_MAX_REQS and FCGI_MPXS_CONNS on a
+// throwaway connection, php-fpm closes the connection after answering a
+// management record. Returns false when the upstream cannot be reached
+bool FastCgiPool::probe() {
+  int fd = connectUpstream();
+  if (fd < 0)
+    return false;
+
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  struct timeval tv = {1, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  unsigned char record[64];
+  unsigned char *p = record + FCGI_HEADER_LEN;
+  for (const char *name : {FCGI_MAX_CONNS, FCGI_MAX_REQS, FCGI_MPXS_CONNS}) {
+    size_t n = ::strlen(name);
+    *p++ = (unsigned char)n;
+    *p++ = 0;
+    ::memcpy(p, name, n);
+    p += n;
+  }
+  size_t contentlen = p - record - FCGI_HEADER_LEN;
+  FCGI_Header *header = (FCGI_Header *)record;
+  ::memset(header, 0, FCGI_HEADER_LEN);
+  header->version = FCGI_VERSION_1;
+  header->type = FCGI_GET_VALUES;
+  header->contentLengthB1 = (unsigned char)((contentlen >> 8) & 0xff);
+  header->contentLengthB0 = (unsigned char)(contentlen & 0xff);
+
+  size_t max_conns = 0, max_reqs = 0, mpxs = 0;
+  bool answered = false;
+  if (::write(fd, record, p - record) == p - record) {
+    FCGI_Header result;
+    unsigned char content[FCGI_MAX_LENGTH + 255];
+    if (::recv(fd, &result, FCGI_HEADER_LEN, MSG_WAITALL) == FCGI_HEADER_LEN &&
+        result.type == FCGI_GET_VALUES_RESULT) {
+      size_t len = (result.contentLengthB1 << 8) + result.contentLengthB0 +
+                   result.paddingLength;
+      if (len == 0 || ::recv(fd, content, len, MSG_WAITALL) == (ssize_t)len) {
+        answered = true;
+        const unsigned char *q = content;
+        const unsigned char *end =
+            content + (result.contentLengthB1 << 8) + result.contentLengthB0;
+        size_t nlen, vlen;
+        while (readLength(q, end, nlen) && readLength(q, end, vlen) &&
+               (size_t)(end - q) >= nlen + vlen) {
+          std::string_view name((const char *)q, nlen);
+          size_t value = ::atoi(std::string((const char *)q + nlen, vlen).data());
+          if (name == FCGI_MAX_CONNS)
+            max_conns = value;
+          else if (name == FCGI_MAX_REQS)
+            max_reqs = value;
+          else if (name == FCGI_MPXS_CONNS)
+            mpxs = value;
+          q += nlen + vlen;
+        }
+      }
+    }
+  }
+  ::close(fd);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // an upstream that ignores FCGI_GET_VALUES keeps the configured size
+  probed_ = true;
+  if (!answered)
+    return true;
+  if (max_conns > 0 && max_conns < max_conns_)
+    max_conns_ = max_conns;
+  max_reqs_ = max_reqs;
+  mpxs_ = mpxs == 1;
+  return true;
+}
+
+bool FastCgiPool::alive(int fd) {
+  // an idle connection has nothing to read, EOF or stray data means that
+  // php-fpm closed it or the previous request was not fully consumed
+  char c;
+  ssize_t n = ::recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+void FastCgiPool::open() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool need_probe = !probed_;
+  lock.unlock();
+  // the probe connects first, do not wait for an unreachable upstream twice
+  int fd = need_probe && !probe() ? -1 : connectUpstream();
+  lock.lock();
+  --opening_;
+
+  if (fd >= 0) {
+    conns_.push_back({std::make_shared<FastCgiConnection>(fd, mpxs_), 0});
+  } else if (conns_.empty() && opening_ == 0) {
+    // nothing will free a slot, fail the waiters
+    std::deque<Waiter> waiters;
+    waiters.swap(waiters_);
+    lock.unlock();
+    for (auto &waiter : waiters)
+      waiter(nullptr);
+    return;
+  }
+  wakeWaiter(lock);
+}
+
+FastCgiPool::Connection FastCgiPool::tryAcquire(bool &pending, bool &open) {
+  pending = false;
+  open = false;
+  // failed connections are dropped once their last request is gone
+  std::erase_if(conns_, [](const Entry &e) {
+    return e.inflight == 0 && !e.conn->good();
+  });
+
+  if (max_reqs_ > 0 && inflight_ >= max_reqs_) {
+    pending = true;
+    return nullptr;
+  }
+
+  size_t per_conn = 1;
+  if (mpxs_)
+    per_conn = max_reqs_ > 0 ? std::max<size_t>(1, max_reqs_ / max_conns_)
+                             : kMaxRequestsPerConnection;
+
+  // the least loaded connection with a free slot
+  Entry *best = nullptr;
+  for (auto &e : conns_) {
+    if (e.inflight >= per_conn || !e.conn->good())
+      continue;
+    // a closed idle connection is dropped by the event loop soon
+    if (e.inflight == 0 && !alive(e.conn->getFd()))
+      continue;
+    if (!best || e.inflight < best->inflight)
+      best = &e;
+  }
+  if (best) {
+    ++best->inflight;
+    ++inflight_;
+    return best->conn;
+  }
+
+  // the caller waits for the new connection, or for a slot freed before
+  pending = true;
+  if (conns_.size() + opening_ < max_conns_) {
+    ++opening_;
+    open = true;
+  }
+  return nullptr;
+}
+
+void FastCgiPool::startOpen() {
+  if (executor_)
+    executor_([this] { open(); });
+  else
+    open();
+}
+
+FastCgiPool::Connection FastCgiPool::acquire(const Waiter &waiter,
+                                             bool &pending) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool open;
+  Connection conn = tryAcquire(pending, open);
+  if (pending)
+    waiters_.push_back(waiter);
+  lock.unlock();
+  if (open)
+    startOpen();
+  return conn;
+}
+
+void FastCgiPool::release(const Connection &conn) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto &e : conns_) {
+    if (e.conn == conn) {
+      --e.inflight;
+      --inflight_;
+      break;
+    }
+  }
+  wakeWaiter(lock);
+}
+
+void FastCgiPool::remove(const Connection &conn) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto it = conns_.begin(); it != conns_.end(); ++it) {
+    if (it->conn == conn) {
+      inflight_ -= it->inflight;
+      conns_.erase(it);
+      break;
+    }
+  }
+  wakeWaiter(lock);
+}
+
+void FastCgiPool::wakeWaiter(std::unique_lock<std::mutex> &lock) {
+  while (!waiters_.empty()) {
+    Waiter waiter = std::move(waiters_.front());
+    waiters_.pop_front();
+    bool pending, open;
+    Connection conn = tryAcquire(pending, open);
+    if (pending) {
+      waiters_.push_front(std::move(waiter));
+      if (open) {
+        lock.unlock();
+        startOpen();
+        lock.lock();
+      }
+      return;
+    }
+    lock.unlock();
+    waiter(conn);
+    lock.lock();
+  }
+}
+
+size_t FastCgiPool::capacity() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return max_conns_;
+}
+
+bool FastCgiPool::multiplexed() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return mpxs_;
+}
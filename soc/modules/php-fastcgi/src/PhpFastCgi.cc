@@ -1,53 +1,26 @@
 #include "../include/PhpFastCgi.h"
+#include <algorithm>
+#include <ctype.h>
 
 using namespace soc;
 
-PhpFastCgi::PhpFastCgi(int reqid) : requestId_(reqid) {
-  params_ = {{FCGI_Params::REQUEST_METHOD, "REQUEST_METHOD"},
-             {FCGI_Params::QUERY_STRING, "QUERY_STRING"},
-             {FCGI_Params::CONTENT_LENGTH, "CONTENT_LENGTH"},
-             {FCGI_Params::CONTENT_TYPE, "CONTENT_TYPE"},
-             {FCGI_Params::SCRIPT_FILENAME, "SCRIPT_FILENAME"},
-             {FCGI_Params::SERVER_NAME, "SERVER_NAME"},
-             {FCGI_Params::SERVER_PORT, "SERVER_PORT"},
-             {FCGI_Params::REMOTE_HOST, "REMOTE_ADDR"},
-             {FCGI_Params::USER_AGENT, "USER_AGENT"},
-             {FCGI_Params::PHP_AUTH_USER, "PHP_AUTH_USER"},
-             {FCGI_Params::PHP_AUTH_PW, "PHP_AUTH_PW"},
-             {FCGI_Params::PHP_AUTH_DIGEST, "PHP_AUTH_DIGEST"}};
-}
-
-PhpFastCgi::~PhpFastCgi() { ::close(sockfd_); }
-
-bool PhpFastCgi::connectPhpFpm(const std::string &ip, uint16_t port) {
-  sockfd_ = ::socket(AF_INET, SOCK_STREAM, 0);
-
-  struct sockaddr_in si;
-  ::memset(&si, 0, sizeof(si));
-  si.sin_addr.s_addr = ::inet_addr(ip.c_str());
-  si.sin_family = AF_INET;
-  si.sin_port = ::htons(port);
-
-  if (-1 == ::connect(sockfd_, (struct sockaddr *)&si, sizeof(si))) {
-    fprintf(stderr, "Connect php-fpm server failed: %s\n", ::strerror(errno));
-    return false;
-  }
-  return true;
-}
-
-bool PhpFastCgi::connectPhpFpm(const std::string &sockpath) {
-  sockfd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
-  struct sockaddr_un un;
-  ::memset(&un, 0, sizeof(un));
-  un.sun_family = AF_UNIX;
-
-  ::strncpy(un.sun_path, sockpath.data(), sockpath.size());
-
-  if (-1 == ::connect(sockfd_, (struct sockaddr *)&un, sizeof(un))) {
-    fprintf(stderr, "Connect php-fpm server failed: %s\n", ::strerror(errno));
-    return false;
-  }
-  return true;
+namespace {
+// indexed by FCGI_Params
+constexpr std::string_view kParamNames[] = {
+    "REQUEST_METHOD", "QUERY_STRING", "CONTENT_LENGTH", "CONTENT_TYPE",
+    "SCRIPT_FILENAME", "SERVER_NAME", "SERVER_PORT", "REMOTE_ADDR",
+    "REMOTE_HOST", "HTTP_AUTHORIZATION", "HTTP_USER_AGENT", "PHP_AUTH_USER",
+    "PHP_AUTH_PW", "PHP_AUTH_DIGEST", "SCRIPT_NAME", "REQUEST_URI",
+    "DOCUMENT_URI", "DOCUMENT_ROOT", "SERVER_ADDR", "SERVER_PROTOCOL",
+    "SERVER_SOFTWARE", "GATEWAY_INTERFACE", "REMOTE_PORT", "REDIRECT_STATUS"};
+
+// the largest record content that needs no padding
+constexpr size_t kMaxContentLength = FCGI_MAX_LENGTH & ~7;
+} // namespace
+
+PhpFastCgi::PhpFastCgi(net::Buffer *output, int reqid, bool keepconn)
+    : output_(output), requestId_(reqid), keepconn_(keepconn) {
+  params_.reserve(kBufferSize);
 }
 
 FCGI_Header PhpFastCgi::makeHeader(int type, int request, int contentlen,
@@ -79,150 +52,95 @@ FCGI_BeginRequestBody PhpFastCgi::makeBeginRequestBody(int role, int keepconn) {
   return body;
 }
 
-void PhpFastCgi::makeNameValueBody(const std::string &name,
-                                   const std::string &value,
-                                   unsigned char *body, int *bodylen) {
-  /* 记录 body 的开始位置 */
-  unsigned char *startBodyBuffPtr = body;
-  size_t nlen = name.size();
-  size_t vlen = value.size();
-  /* 如果 nameLen 小于128字节 */
-  if (nlen < 128) {
-    *body++ = (unsigned char)nlen; // nameLen用1个字节保存
-  } else {
-    /* nameLen 用 4 个字节保存 */
-    *body++ = (unsigned char)((nlen >> 24) | 0x80);
-    *body++ = (unsigned char)(nlen >> 16);
-    *body++ = (unsigned char)(nlen >> 8);
-    *body++ = (unsigned char)nlen;
-  }
-
-  /* valueLen 小于 128 就用一个字节保存 */
-  if (vlen < 128) {
-    *body++ = (unsigned char)vlen;
-  } else {
-    /* valueLen 用 4 个字节保存 */
-    *body++ = (unsigned char)((vlen >> 24) | 0x80);
-    *body++ = (unsigned char)(vlen >> 16);
-    *body++ = (unsigned char)(vlen >> 8);
-    *body++ = (unsigned char)vlen;
-  }
-
-  /* 将 name 中的字节逐一加入body中的buffer中 */
-  for (int i = 0; i < nlen; i++) {
-    *body++ = name[i];
-  }
-
-  /* 将 value 中的值逐一加入body中的buffer中 */
-  for (int i = 0; i < vlen; i++) {
-    *body++ = value[i];
-  }
-
-  /* 计算出 body 的长度 */
-  *bodylen = body - startBodyBuffPtr;
-}
-
 void PhpFastCgi::sendStartRequestRecord() {
   FCGI_BeginRequestRecord beginRecord;
   beginRecord.header =
       makeHeader(FCGI_BEGIN_REQUEST, requestId_, sizeof(beginRecord.body), 0);
-  beginRecord.body = makeBeginRequestBody(FCGI_RESPONDER, 0);
+  beginRecord.body = makeBeginRequestBody(FCGI_RESPONDER, keepconn_);
 
-  ::write(sockfd_, (char *)&beginRecord, sizeof(beginRecord));
+  output_->append((const char *)&beginRecord, sizeof(beginRecord));
 }
 
-void PhpFastCgi::sendPost(const std::string_view &postdata) {
-  size_t size = postdata.size();
-
-  FCGI_Header startHeader = makeHeader(FCGI_STDIN, requestId_, size, 0);
-  ::write(sockfd_, &startHeader, FCGI_HEADER_LEN);
+void PhpFastCgi::appendRecord(int type, const char *content,
+                              size_t contentlen) {
+  /* 填充到8字节对齐 */
+  size_t paddinglen = (8 - (contentlen & 7)) & 7;
+  FCGI_Header header = makeHeader(type, requestId_, contentlen, paddinglen);
+
+  /* header、内容和填充字节一次写入输出缓冲区 */
+  output_->ensureWritable(FCGI_HEADER_LEN + contentlen + paddinglen);
+  char *p = output_->beginWrite();
+  ::memcpy(p, &header, FCGI_HEADER_LEN);
+  if (contentlen > 0)
+    ::memcpy(p + FCGI_HEADER_LEN, content, contentlen);
+  ::memset(p + FCGI_HEADER_LEN + contentlen, 0, paddinglen);
+  output_->hasWritten(FCGI_HEADER_LEN + contentlen + paddinglen);
+}
 
-  // POST data
-  int rn = size;
-  int n = -1;
-  while ((n = ::write(sockfd_, postdata.data() + size - rn, rn)) > 0) {
-    rn -= n;
+void PhpFastCgi::sendStdin(std::string_view data) {
+  // 空的 STDIN 记录表示请求体结束
+  if (data.empty()) {
+    appendRecord(FCGI_STDIN, nullptr, 0);
+    return;
+  }
+  // split into records of at most FCGI_MAX_LENGTH bytes
+  for (size_t offset = 0; offset < data.size();) {
+    size_t n = std::min(data.size() - offset, kMaxContentLength);
+    appendRecord(FCGI_STDIN, data.data() + offset, n);
+    offset += n;
   }
-
-  FCGI_Header endHeader = makeHeader(FCGI_STDIN, requestId_, 0, 0);
-  ::write(sockfd_, &endHeader, FCGI_HEADER_LEN);
 }
 
-void PhpFastCgi::sendParams(FCGI_Params param, const std::string &value) {
-  int rc;
-  unsigned char bodyBuff[kBufferSize];
-  ::bzero(bodyBuff, sizeof(bodyBuff));
-
-  /* 保存 body 的长度 */
-  int bodyLen;
-
-  /* 生成 PARAMS 参数内容的 body */
-  makeNameValueBody(params_[param], value, bodyBuff, &bodyLen);
+void PhpFastCgi::sendPost(const std::string_view &postdata) {
+  if (!postdata.empty())
+    sendStdin(postdata);
+  sendStdin({});
+}
 
-  FCGI_Header nameValueHeader = makeHeader(FCGI_PARAMS, requestId_, bodyLen, 0);
+void PhpFastCgi::appendLength(size_t len) {
+  /* 长度小于128字节用1个字节保存，否则用4个字节保存 */
+  if (len < 128) {
+    params_.push_back((char)len);
+  } else {
+    params_.push_back((char)((len >> 24) | 0x80));
+    params_.push_back((char)(len >> 16));
+    params_.push_back((char)(len >> 8));
+    params_.push_back((char)len);
+  }
+}
 
-  int nameValueRecordLen = bodyLen + FCGI_HEADER_LEN;
-  char nameValueRecord[nameValueRecordLen];
+void PhpFastCgi::sendParams(FCGI_Params param, std::string_view value) {
+  sendParams(kParamNames[static_cast<size_t>(param)], value);
+}
 
-  /* 将header和body拷贝到一块buffer中只需调用一次write */
-  ::memcpy(nameValueRecord, (char *)&nameValueHeader, FCGI_HEADER_LEN);
-  ::memcpy(nameValueRecord + FCGI_HEADER_LEN, bodyBuff, bodyLen);
+void PhpFastCgi::sendParams(std::string_view name, std::string_view value) {
+  appendLength(name.size());
+  appendLength(value.size());
+  params_.append(name);
+  params_.append(value);
+}
 
-  ::write(sockfd_, nameValueRecord, nameValueRecordLen);
+void PhpFastCgi::sendHeaderParams(std::string_view header,
+                                  std::string_view value) {
+  appendLength(header.size() + 5);
+  appendLength(value.size());
+  params_.append("HTTP_");
+  for (char c : header)
+    params_.push_back(c == '-' ? '_' : (char)::toupper((unsigned char)c));
+  params_.append(value);
 }
 
-void PhpFastCgi::sendEndRequestRecord() {
-  FCGI_Header endHeader = makeHeader(FCGI_PARAMS, requestId_, 0, 0);
-  ::write(sockfd_, (char *)&endHeader, FCGI_HEADER_LEN);
+void PhpFastCgi::sendAbortRequestRecord() {
+  appendRecord(FCGI_ABORT_REQUEST, nullptr, 0);
 }
 
-std::pair<bool, std::string> PhpFastCgi::readPhpFpm(net::Buffer *buffer) {
-  FCGI_Header responderHeader;
-  char content[kBufferSize]{0};
-  int contentLen;
-  char tmp[8]; //用来暂存padding字节的
-  int ret;
-
-  bool status = true;
-  std::string message = "OK";
-  // 读取Header
-  while (::read(sockfd_, &responderHeader, FCGI_HEADER_LEN) > 0) {
-    // PHP-FPM正常返回输出
-    if (responderHeader.type == FCGI_STDOUT) {
-      //获取内容长度
-      contentLen = (responderHeader.contentLengthB1 << 8) +
-                   (responderHeader.contentLengthB0);
-
-      int nbuf = contentLen / kBufferSize;
-      int remain = contentLen % kBufferSize;
-      while (nbuf) {
-        ret = ::read(sockfd_, content, kBufferSize);
-        buffer->append(content, ret);
-        nbuf--;
-      }
-      ret = ::read(sockfd_, content, remain);
-      buffer->append(content, ret);
-
-      //跳过填充部分
-      if (responderHeader.paddingLength > 0) {
-        ret = ::read(sockfd_, tmp, responderHeader.paddingLength);
-      }
-    } else if (responderHeader.type == FCGI_STDERR) {
-      // PHP-FPM返回异常错误
-      contentLen = (responderHeader.contentLengthB1 << 8) +
-                   (responderHeader.contentLengthB0);
-
-      ret = ::read(sockfd_, content, contentLen);
-      status = false;
-      message = std::string(content, ret);
-      //跳过填充部分
-      if (responderHeader.paddingLength > 0) {
-        ret = ::read(sockfd_, tmp, responderHeader.paddingLength);
-      }
-    } else if (responderHeader.type == FCGI_END_REQUEST) {
-      FCGI_EndRequestBody endRequest;
-      ret = ::read(sockfd_, &endRequest, sizeof(endRequest));
-    }
+void PhpFastCgi::sendEndRequestRecord() {
+  /* 名值对可以跨越多个 PARAMS 记录 */
+  for (size_t offset = 0; offset < params_.size();) {
+    size_t n = std::min(params_.size() - offset, kMaxContentLength);
+    appendRecord(FCGI_PARAMS, params_.data() + offset, n);
+    offset += n;
   }
-  return std::make_pair(status, message);
-}
\ No newline at end of file
+  params_.clear();
+  appendRecord(FCGI_PARAMS, nullptr, 0);
+}
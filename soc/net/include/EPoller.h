@@ -31,7 +31,8 @@ public:
   void removeEvent(int fd);
   void removeAndCloseEvent(int fd);
 
-  bool poll();
+  // Wait at most timeout_ms, -1 waits until an event arrives
+  bool poll(int timeout_ms = -1);
 
   void setReadCallback(const ReadCallback &callback) { read_cb_ = callback; }
   void setWriteCallback(const WriteCallback &callback) { write_cb_ = callback; }
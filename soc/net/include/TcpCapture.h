@@ -0,0 +1,76 @@
+#ifndef SOC_NET_TCPCAPTURE_H
+#define SOC_NET_TCPCAPTURE_H
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace soc {
+namespace net {
+
+// Starts the capture file, the records follow
+struct TcpCaptureHeader {
+  static constexpr char kMagic[8] = {'S', 'O', 'C', 'C', 'A', 'P', '\0', '\0'};
+  static constexpr uint32_t kVersion = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  // wall clock microseconds when the capture started
+  uint64_t created;
+  char reserved[8];
+};
+static_assert(sizeof(TcpCaptureHeader) == 32);
+
+// One event of a connection, Data records are followed by size bytes
+struct TcpCaptureRecord {
+  enum Type : uint8_t { Open = 1, Data = 2, Close = 3 };
+
+  // CLOCK_MONOTONIC microseconds since the capture started
+  uint64_t time;
+  // the connection fd, reused after a Close
+  uint32_t conn;
+  uint32_t size;
+  uint8_t type;
+  uint8_t reserved[7];
+};
+static_assert(sizeof(TcpCaptureRecord) == 24);
+
+// Records the bytes read from every connection with their arrival times, so
+// bench/socnet-replay can send the same traffic again. Records are buffered
+// and written by whichever thread fills the buffer or finds it older than a
+// second. Recording stops once the file reaches max_bytes
+class TcpCapture {
+public:
+  TcpCapture(const std::string &path, size_t max_bytes);
+  ~TcpCapture();
+
+  bool isOpen() const noexcept { return fd_ >= 0; }
+
+  void open(int conn) { record(TcpCaptureRecord::Open, conn, nullptr, 0); }
+  void data(int conn, const char *data, size_t size) {
+    record(TcpCaptureRecord::Data, conn, data, size);
+  }
+  void close(int conn) { record(TcpCaptureRecord::Close, conn, nullptr, 0); }
+  void flush();
+
+private:
+  void record(uint8_t type, int conn, const char *data, size_t size);
+  void flushLocked();
+
+private:
+  int fd_;
+  size_t max_bytes_;
+  size_t written_;
+  uint64_t start_;
+  uint64_t last_flush_;
+  bool full_;
+  std::string buffer_;
+  std::mutex mutex_;
+};
+
+} // namespace net
+} // namespace soc
+
+#endif
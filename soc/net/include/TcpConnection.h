@@ -3,6 +3,7 @@
 
 #include "../include/ServerSocket.h"
 #include "Channel.h"
+#include "TcpCapture.h"
 #include <memory>
 
 namespace soc {
@@ -52,6 +53,14 @@ public:
   void *getContext() const noexcept { return context_; }
   void setContext(void *context) { context_ = context; }
 
+  // CLOCK_MONOTONIC microseconds when the event loop queued the last read,
+  // stamped only while TcpServer::setReadTiming() is on
+  uint64_t getReadyTime() const noexcept { return ready_; }
+  void setReadyTime(uint64_t us) { ready_ = us; }
+
+  // Record the bytes read from now on, nullptr stops it
+  void setCapture(TcpCapture *capture) { capture_ = capture; }
+
   Buffer *getSender() { return channel_->getSender(); }
   Buffer *getRecver() { return channel_->getRecver(); }
 
@@ -60,6 +69,8 @@ private:
   bool disconnected_;
   bool keep_alive_;
   void *context_;
+  uint64_t ready_;
+  TcpCapture *capture_;
   std::shared_ptr<Channel> channel_;
 };
 } // namespace net
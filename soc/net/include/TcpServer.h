@@ -2,9 +2,12 @@
 #define SOC_NET_TCPSERVER_H
 
 #include "../../utility/include/AppConfig.h"
+#include "../../utility/include/Metrics.h"
 #include "EPoller.h"
 #include "ServerSsl.h"
 #include "TcpConnection.h"
+#include "TimerWheel.h"
+#include <mutex>
 #include <signal.h>
 
 namespace soc {
@@ -12,9 +15,15 @@ namespace net {
 
 class TcpServer {
 public:
+  // What onRead does with the connection after the message callback returns
+  enum class MessageStatus { Read, Write, Suspend };
+
   using NewConnectionCallback = std::function<void(TcpConnection *)>;
-  using MessageCallback = std::function<bool(TcpConnection *)>;
+  using MessageCallback = std::function<MessageStatus(TcpConnection *)>;
   using ClosedConnectionCallback = std::function<void(TcpConnection *)>;
+  using WriteCompleteCallback = std::function<void(TcpConnection *)>;
+  using WatchCallback = std::function<void(int)>;
+  using ReloadCallback = std::function<void()>;
 
   TcpServer();
   ~TcpServer();
@@ -28,6 +37,11 @@ public:
   void wakeUp();
 
   void setIdleTime(int millsecond) { idle_timeout_ = millsecond; }
+  // Run cb on the event loop thread when the process receives SIGHUP
+  void setReloadCallback(const ReloadCallback &cb);
+  // Leave start() on SIGTERM or SIGINT, unless the program handles them
+  // itself
+  void setQuitOnSignal();
 
   void setNewConnectionCallback(const NewConnectionCallback &cb) {
     new_conn_cb_ = cb;
@@ -36,14 +50,42 @@ public:
   void setClosedConnectionCallback(const ClosedConnectionCallback &cb) {
     closed_cb_ = cb;
   }
+  // Called on the thread pool when the send buffer of a connection drained
+  void setWriteCompleteCallback(const WriteCompleteCallback &cb) {
+    write_complete_cb_ = cb;
+  }
+  // Stamp connections with the time their reads are queued, for tracing
+  void setReadTiming(bool on) { read_timing_ = on; }
+  // Record the traffic of the connections accepted from now on into path,
+  // until it holds max_bytes (0 without a limit)
+  bool setCapture(const std::string &path, size_t max_bytes);
 
   void setCertificate(const std::string &cert_file,
                       const std::string &privatekey_file,
                       const std::string &password);
 
-  void createSessionTimer(const TimeStamp &);
+  // Park a connection whose response is produced elsewhere. Only a peer close
+  // is reported while suspended, and the connection is closed if resume() is
+  // not called within timeout_ms
+  void suspend(TcpConnection *conn, int timeout_ms);
+  // Start writing the response of a suspended connection
+  void resume(TcpConnection *conn);
+  // Hand the events of a suspended connection to cb, which reads and writes
+  // the connection itself and re-arms it with rearm(). resume() and a close
+  // return the connection to the server
+  void attach(TcpConnection *conn, const WatchCallback &cb);
+  void rearm(TcpConnection *conn, int events);
+  // Push the close deadline of a suspended connection that makes progress
+  void touch(TcpConnection *conn, int timeout_ms);
+  void close(TcpConnection *conn) { handleConnectionClose(conn); }
+
+  // Drive other fds, such as upstream sockets, from the same event loop.
+  // The callback runs on the thread pool with the ready events and the fd
+  // stays disarmed until rewatch()
+  void watch(int fd, int events, const WatchCallback &cb);
+  void rewatch(int fd, int events);
+  void unwatch(int fd);
 
-  TimerQueue *getClientTimer() const noexcept { return alive_timer_.get(); }
   TimerQueue *getSessionTimer() const noexcept { return session_timer_.get(); }
   EPoller *getEPoller() const noexcept { return poller_.get(); }
 
@@ -52,8 +94,10 @@ private:
   void handleRead(int);
   void handleWrite(int);
   void handleClose(int);
-  void handleTimeout(int);
   void handleWakeup();
+  // epoll_wait() timeout until the earliest timer deadline
+  int nextTimeout() const;
+  void handleTimeout();
 
   void handleConnected(int, Channel *);
   void handleConnectionRead(TcpConnection *);
@@ -63,23 +107,46 @@ private:
   void onWrite(TcpConnection *);
   void onRead(TcpConnection *);
 
+  bool dispatchWatcher(int fd, int events);
+  void detach(int fd);
+
+  // The idle timers belong to the event loop, other threads queue their
+  // deadlines and cancels, the loop applies them before the next expiry
+  void postAliveTimer(int fd, int timeout_ms);
+  void applyAliveTimers();
+
 private:
   int evfd_;
-  int idle_timeout_;
+  std::atomic<int> idle_timeout_;
   std::atomic<bool> quit_;
   bool sendfile_;
+  bool read_timing_;
 
   std::unique_ptr<ServerSocket> svr_socket_;
   std::unique_ptr<EPoller> poller_;
-  std::unique_ptr<TimerQueue> alive_timer_;
+  std::unique_ptr<TimerWheel> alive_timer_;
   std::unique_ptr<TimerQueue> session_timer_;
   std::unique_ptr<ServerSsl> ssl_;
+  std::unique_ptr<TcpCapture> capture_;
 
   std::unordered_map<int, TcpConnection> conns_;
 
+  std::mutex watch_mutex_;
+  std::unordered_map<int, WatchCallback> watchers_;
+
+  std::mutex timer_mutex_;
+  std::vector<std::pair<int, int>> timer_updates_;
+
   NewConnectionCallback new_conn_cb_;
   MessageCallback msg_cb_;
   ClosedConnectionCallback closed_cb_;
+  WriteCompleteCallback write_complete_cb_;
+  ReloadCallback reload_cb_;
+
+  Metrics::Counter accepted_;
+  Metrics::Counter active_;
+  // gauges reading the timers, removed with the server
+  std::vector<size_t> gauges_;
 };
 } // namespace net
 
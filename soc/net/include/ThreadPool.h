@@ -34,6 +34,11 @@ public:
     }
     cond_.notify_one();
   }
+  // Tasks waiting for a thread
+  size_t pending() {
+    std::lock_guard<std::mutex> lock(locker_);
+    return tasks_.size();
+  }
   void shutdownAll() {
     running_ = false;
     cond_.notify_all();
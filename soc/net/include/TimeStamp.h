@@ -1,6 +1,7 @@
 #ifndef SOC_NET_TIMESTAMP_H
 #define SOC_NET_TIMESTAMP_H
 
+#include <atomic>
 #include <limits>
 #include <string>
 #include <sys/time.h>
@@ -68,12 +69,60 @@ public:
     return TimeStamp(std::numeric_limits<uint64_t>::max());
   }
 
-  static TimeStamp nowSecond(int sec) { return TimeStamp::now() + second(sec); }
+  // Deadlines are on the monotonic clock, wall clock jumps do not move them
+  static TimeStamp nowSecond(int sec) {
+    return TimeStamp::monotonicNow() + second(sec);
+  }
   static TimeStamp nowMsecond(int msec) {
-    return TimeStamp::now() + millsecond(msec);
+    return TimeStamp::monotonicNow() + millsecond(msec);
   }
   static TimeStamp nowNanosecond(int nsec) {
-    return TimeStamp::now() + nanosecond(nsec);
+    return TimeStamp::monotonicNow() + nanosecond(nsec);
+  }
+  static TimeStamp monotonicNow() { return TimeStamp(loopMonotonic() * 1000); }
+  // CLOCK_MONOTONIC microseconds, read now
+  static uint64_t monotonicMicros() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+  // CLOCK_REALTIME_COARSE microseconds, read now. A vDSO call, cheap enough
+  // for threads that no event loop wakes up
+  static uint64_t coarseRealtimeMicros() {
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  // Sample the coarse clocks, called by the event loop after every
+  // epoll_wait() wakeup
+  static void updateLoopClock() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    loop_monotonic_.store(ts.tv_sec * 1000 + ts.tv_nsec / 1000000,
+                          std::memory_order_relaxed);
+    ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    loop_realtime_.store(ts.tv_sec * 1000000 + ts.tv_nsec / 1000,
+                         std::memory_order_relaxed);
+  }
+  // Wall clock as of the last wakeup of the event loop. Handlers run because
+  // of that wakeup, so this is as fresh as their event
+  static TimeStamp loopNow() {
+    uint64_t us = loop_realtime_.load(std::memory_order_relaxed);
+    if (us == 0) {
+      updateLoopClock();
+      us = loop_realtime_.load(std::memory_order_relaxed);
+    }
+    return TimeStamp(us);
+  }
+  // Monotonic milliseconds as of the last wakeup, for deadlines
+  static uint64_t loopMonotonic() {
+    uint64_t ms = loop_monotonic_.load(std::memory_order_relaxed);
+    if (ms == 0) {
+      updateLoopClock();
+      ms = loop_monotonic_.load(std::memory_order_relaxed);
+    }
+    return ms;
   }
 
   static std::string getServerDate() {
@@ -83,8 +132,26 @@ public:
     return buffer;
   }
 
+  // Date header value, formatted at most once per second on each thread
+  static std::string_view getCachedServerDate() {
+    thread_local time_t last = 0;
+    thread_local char buffer[50]{0};
+    thread_local size_t len = 0;
+    time_t t = loopNow().second();
+    if (t != last) {
+      struct tm tm;
+      ::gmtime_r(&t, &tm);
+      len = ::strftime(buffer, 50, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+      last = t;
+    }
+    return std::string_view(buffer, len);
+  }
+
 private:
   uint64_t microsecond_;
+
+  static inline std::atomic<uint64_t> loop_monotonic_{0};
+  static inline std::atomic<uint64_t> loop_realtime_{0};
 };
 
 } // namespace net
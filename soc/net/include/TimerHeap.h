@@ -3,7 +3,10 @@
 
 #include "TimeStamp.h"
 #include <algorithm>
+#include <functional>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace soc {
 namespace net {
@@ -62,6 +65,11 @@ public:
       throw std::exception();
     return c_[0];
   }
+  // Expiry of the first timer, TimeStamp::max() without timers
+  TimeStamp earliest() const noexcept {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return n_ == 0 ? TimeStamp::max() : c_[0].timestamp;
+  }
   bool empty() const noexcept {
     std::lock_guard<std::mutex> locker(mutex_);
     return n_ == 0;
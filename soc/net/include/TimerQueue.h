@@ -2,30 +2,36 @@
 #define SOC_NET_TIMERQUEUE_H
 
 #include "TimerHeap.h"
+#include <atomic>
 #include <memory>
 
 namespace soc {
 namespace net {
 
+// Timers with their own callbacks, expired by the event loop. Timer stamps
+// are monotonic deadlines from TimeStamp::nowSecond() and friends
 class TimerQueue {
 public:
-  TimerQueue();
+  // wakeup is called when a new timer expires before all the others, so that
+  // a sleeping loop can shorten its wait
+  explicit TimerQueue(const TimeoutCallback &wakeup = nullptr);
 
-  void runOnce(const TimeStamp &t);
-  void runEvery(const TimeStamp &t);
-
-  int getFd() const { return tmfd_; }
   const Timer &getExpiredTimer() { return timer_heap_->top(); }
 
   void add(const Timer &);
   void adjust(const Timer &);
 
+  // Monotonic milliseconds of the first deadline, UINT64_MAX without timers
+  uint64_t nextExpiry() const;
+  // may be read from other threads
+  size_t size() const noexcept { return size_.load(std::memory_order_relaxed); }
   void handleTimeout();
 
 private:
-  int tmfd_;
   std::unique_ptr<TimerHeap> timer_heap_;
-  TimeoutCallback cb_;
+  TimeoutCallback wakeup_;
+  // timer_heap_->size(), updated by the loop thread after every change
+  std::atomic<size_t> size_;
 };
 } // namespace net
 } // namespace soc
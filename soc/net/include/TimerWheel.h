@@ -0,0 +1,71 @@
+#ifndef SOC_NET_TIMERWHEEL_H
+#define SOC_NET_TIMERWHEEL_H
+
+#include "TimeStamp.h"
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace soc {
+namespace net {
+
+// Hashed timing wheel holding one deadline per fd, used for the idle timers
+// of connections. A deadline lives in the slot of its tick and deadlines more
+// than one turn away are visited once per turn. Pushing a deadline back only
+// records it, the entry moves when its old slot comes up, so refreshing on
+// every read or write is a store. Not thread-safe, owned by one event loop
+class TimerWheel {
+public:
+  using ExpireCallback = std::function<void(int)>;
+
+  TimerWheel(int tick_ms, size_t slots, const ExpireCallback &cb);
+
+  int tick() const noexcept { return tick_ms_; }
+
+  // Arm or move the deadline of fd to now + timeout_ms
+  void add(int fd, int timeout_ms);
+  // Same as add(), only for fds that already have a deadline
+  void refresh(int fd, int timeout_ms);
+  void cancel(int fd);
+
+  // may be read from other threads
+  size_t size() const noexcept {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  // Monotonic milliseconds of the first non-empty slot, UINT64_MAX when the
+  // wheel is empty. A pushed back entry may still sit in an earlier slot, so
+  // this can be early but never late
+  uint64_t nextExpiry() const;
+  // Expire the fds whose deadline passed
+  void handleTimeout();
+
+private:
+  struct Entry {
+    uint64_t deadline = 0;
+    // tick of the slot the entry is linked into
+    uint64_t slotted = 0;
+    int prev = -1;
+    int next = -1;
+    bool linked = false;
+  };
+
+  void schedule(int fd, uint64_t deadline);
+  void link(int fd, uint64_t tick);
+  void unlink(int fd);
+  uint64_t nowTick() const;
+
+private:
+  int tick_ms_;
+  std::vector<int> slots_;
+  std::vector<Entry> entries_;
+  std::atomic<size_t> size_;
+  // the last tick whose slot was processed
+  uint64_t current_;
+  ExpireCallback cb_;
+};
+
+} // namespace net
+} // namespace soc
+
+#endif
@@ -30,9 +30,10 @@ void EPoller::removeAndCloseEvent(int fd) {
   ::close(fd);
 }
 
-bool EPoller::poll() {
+bool EPoller::poll(int timeout_ms) {
   events_.resize(1024);
-  int n = ::epoll_wait(epfd_, events_.data(), events_.size(), -1);
+  int n = ::epoll_wait(epfd_, events_.data(), events_.size(), timeout_ms);
+  TimeStamp::updateLoopClock();
   if (n < 0)
     return false;
 
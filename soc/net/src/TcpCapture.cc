@@ -0,0 +1,109 @@
+#include "../include/TcpCapture.h"
+#include "../include/TimeStamp.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace soc::net;
+
+namespace {
+// the buffer is written out at this size, or when it is older than
+// kFlushInterval microseconds
+constexpr size_t kFlushSize = 256 * 1024;
+constexpr uint64_t kFlushInterval = 1000000;
+
+bool writeAll(int fd, const char *p, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+} // namespace
+
+TcpCapture::TcpCapture(const std::string &path, size_t max_bytes)
+    : max_bytes_(max_bytes), written_(0),
+      start_(TimeStamp::monotonicMicros()), last_flush_(start_),
+      full_(false) {
+  // the requests may carry passwords and session cookies, only the owner
+  // reads them, also when an older capture is overwritten
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd_ >= 0 && ::fchmod(fd_, 0600) < 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  if (fd_ < 0) {
+    fprintf(stderr, "Open capture file failed: %s: %s\n", path.c_str(),
+            ::strerror(errno));
+    return;
+  }
+  TcpCaptureHeader header{};
+  ::memcpy(header.magic, TcpCaptureHeader::kMagic, sizeof(header.magic));
+  header.version = TcpCaptureHeader::kVersion;
+  header.record_size = sizeof(TcpCaptureRecord);
+  header.created = TimeStamp::now().microsecond();
+  buffer_.append((const char *)&header, sizeof(header));
+  buffer_.reserve(kFlushSize + kFlushSize / 4);
+}
+
+TcpCapture::~TcpCapture() {
+  flush();
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+void TcpCapture::flush() {
+  std::lock_guard<std::mutex> locker(mutex_);
+  flushLocked();
+}
+
+void TcpCapture::record(uint8_t type, int conn, const char *data,
+                        size_t size) {
+  if (fd_ < 0)
+    return;
+  std::lock_guard<std::mutex> locker(mutex_);
+  if (full_)
+    return;
+  if (max_bytes_ > 0 && written_ + buffer_.size() + sizeof(TcpCaptureRecord) +
+                                size > max_bytes_) {
+    full_ = true;
+    flushLocked();
+    fprintf(stderr, "Capture file reached %zu bytes, capture stopped\n",
+            max_bytes_);
+    return;
+  }
+
+  // taken under the lock, so that the records are in time order
+  uint64_t now = TimeStamp::monotonicMicros();
+  TcpCaptureRecord r{};
+  r.time = now - start_;
+  r.conn = conn;
+  r.size = size;
+  r.type = type;
+  buffer_.append((const char *)&r, sizeof(r));
+  if (size > 0)
+    buffer_.append(data, size);
+
+  if (buffer_.size() >= kFlushSize || now - last_flush_ >= kFlushInterval)
+    flushLocked();
+}
+
+void TcpCapture::flushLocked() {
+  last_flush_ = TimeStamp::monotonicMicros();
+  if (fd_ < 0 || buffer_.empty())
+    return;
+  if (!writeAll(fd_, buffer_.data(), buffer_.size())) {
+    fprintf(stderr, "Write capture file failed: %s\n", ::strerror(errno));
+    full_ = true;
+  }
+  written_ += buffer_.size();
+  buffer_.clear();
+}
@@ -3,20 +3,27 @@
 using namespace soc::net;
 
 TcpConnection::TcpConnection()
-    : disconnected_(false), keep_alive_(false), context_(nullptr),
-      channel_(nullptr) {}
+    : disconnected_(false), keep_alive_(false), context_(nullptr), ready_(0),
+      capture_(nullptr), channel_(nullptr) {}
 
 void TcpConnection::initialize(int connfd) {
   connfd_ = connfd;
   disconnected_ = keep_alive_ = false;
   context_ = nullptr;
+  ready_ = 0;
+  capture_ = nullptr;
   channel_ = nullptr;
 }
 
 TcpConnection::channel_status_ne TcpConnection::read() {
   int n = -1;
+  size_t before = capture_ ? getRecver()->readable() : 0;
   while ((n = channel_->read()) > 0)
     ;
+  // the new bytes are at the end of the readable ones
+  if (capture_ && getRecver()->readable() > before)
+    capture_->data(connfd_, getRecver()->peek() + before,
+                   getRecver()->readable() - before);
   return {n, channel_->getError(n)};
 }
 
@@ -54,5 +61,5 @@ TcpConnection::channel_status_nec TcpConnection::writeAgain() {
     again = (err == EAGAIN);
   else if (channel_->getType() == ChannelType::Ssl)
     again = (err == SSL_ERROR_WANT_WRITE);
-  return {n, err, cflag};
+  return {n, again, cflag};
 }
@@ -4,11 +4,48 @@
 using namespace soc::net;
 using std::placeholders::_1;
 
+namespace {
+// idle timeouts are checked with this precision, one turn of the wheel covers
+// kTimerWheelSlots ticks
+constexpr int kTimerWheelTick = 100;
+constexpr size_t kTimerWheelSlots = 512;
+// queued in place of a timeout to remove the deadline of a closed fd
+constexpr int kCancelTimer = -1;
+
+// set by the signal handlers, which also wake the loop through its event fd
+volatile sig_atomic_t hangup = 0;
+volatile sig_atomic_t terminating = 0;
+std::atomic<int> signal_evfd{-1};
+
+void wakeOnSignal() {
+  uint64_t one = 1;
+  int fd = signal_evfd.load();
+  if (fd >= 0)
+    ::write(fd, &one, sizeof(one));
+}
+
+void onHangup(int) {
+  hangup = 1;
+  wakeOnSignal();
+}
+
+void onTerminate(int) {
+  terminating = 1;
+  wakeOnSignal();
+}
+} // namespace
+
 TcpServer::TcpServer()
     : quit_(false), evfd_(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
       svr_socket_(new ServerSocket(option::createNBSocket())),
-      poller_(new EPoller()), alive_timer_(new TimerQueue) {
+      poller_(new EPoller()),
+      alive_timer_(new TimerWheel(kTimerWheelTick, kTimerWheelSlots,
+                                  [this](int fd) {
+                                    handleConnectionClose(&conns_[fd]);
+                                  })),
+      session_timer_(new TimerQueue(std::bind(&TcpServer::wakeUp, this))) {
   sendfile_ = GET_CONFIG(bool, "server", "enable_sendfile");
+  read_timing_ = false;
   ::signal(SIGPIPE, SIG_IGN);
   svr_socket_->enableReuseAddr(true);
   svr_socket_->enableReusePort(true);
@@ -16,21 +53,31 @@ TcpServer::TcpServer()
   option::setNonBlocking(evfd_);
   // event fd
   poller_->addEvent(evfd_, EPOLLIN | kConnectionEvent);
-  // timer fd
-  poller_->addEvent(alive_timer_->getFd(), EPOLLIN);
 
   // set event callback
   poller_->setReadCallback(std::bind(&TcpServer::handleRead, this, _1));
   poller_->setWriteCallback(std::bind(&TcpServer::handleWrite, this, _1));
   poller_->setCloseCallback(std::bind(&TcpServer::handleClose, this, _1));
+
+  Metrics &metrics = Metrics::instance();
+  accepted_ = metrics.counter("socnet_connections_accepted_total",
+                              "Accepted connections");
+  active_ = metrics.gauge("socnet_connections_active", "Open connections");
+  gauges_.push_back(
+      metrics.gauge("socnet_idle_timers", "Connections with an idle timer",
+                    [this] { return (double)alive_timer_->size(); }));
+  gauges_.push_back(metrics.gauge(
+      "socnet_session_timers", "Timers in the session timer heap",
+      [this] { return (double)session_timer_->size(); }));
 }
 
 TcpServer::~TcpServer() {
+  for (size_t id : gauges_)
+    Metrics::instance().removeGauge(id);
+  int fd = evfd_;
+  signal_evfd.compare_exchange_strong(fd, -1);
   poller_->removeAndCloseEvent(evfd_);
   poller_->removeAndCloseEvent(svr_socket_->getFd());
-  poller_->removeAndCloseEvent(alive_timer_->getFd());
-  if (session_timer_)
-    poller_->removeAndCloseEvent(session_timer_->getFd());
 
   for (const auto &[fd, conn] : conns_) {
     if (!conn.isDisconnected())
@@ -46,12 +93,39 @@ void TcpServer::setCertificate(const std::string &cert_file,
   ssl_ = std::make_unique<ServerSsl>(cert_file, privatekey_file, password);
 }
 
-void TcpServer::createSessionTimer(const TimeStamp &ts) {
-  if (session_timer_ == nullptr) {
-    session_timer_ = std::make_unique<TimerQueue>();
-    session_timer_->runEvery(ts);
+bool TcpServer::setCapture(const std::string &path, size_t max_bytes) {
+  auto capture = std::make_unique<TcpCapture>(path, max_bytes);
+  if (!capture->isOpen())
+    return false;
+  capture_ = std::move(capture);
+  return true;
+}
+
+void TcpServer::setReloadCallback(const ReloadCallback &cb) {
+  reload_cb_ = cb;
+  signal_evfd = evfd_;
+  struct sigaction sa;
+  ::memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onHangup;
+  sa.sa_flags = SA_RESTART;
+  ::sigemptyset(&sa.sa_mask);
+  ::sigaction(SIGHUP, &sa, nullptr);
+}
+
+void TcpServer::setQuitOnSignal() {
+  signal_evfd = evfd_;
+  for (int sig : {SIGTERM, SIGINT}) {
+    struct sigaction old;
+    if (::sigaction(sig, nullptr, &old) < 0 || old.sa_handler != SIG_DFL)
+      continue;
+    struct sigaction sa;
+    ::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onTerminate;
+    // a second signal kills a server that hangs while quitting
+    sa.sa_flags = SA_RESTART | SA_RESETHAND;
+    ::sigemptyset(&sa.sa_mask);
+    ::sigaction(sig, &sa, nullptr);
   }
-  poller_->addEvent(session_timer_->getFd(), EPOLLIN);
 }
 
 void TcpServer::start(const InetAddress &address) {
@@ -59,17 +133,18 @@ void TcpServer::start(const InetAddress &address) {
   svr_socket_->listen();
   // server socket fd
   poller_->addEvent(svr_socket_->getFd(), EPOLLIN | kServerEvent);
-  // alive timer
-  alive_timer_->runEvery(TimeStamp::millsecond(idle_timeout_));
 
-  // event loop
+  // event loop, sleeping until the next event or timer deadline
   while (!quit_) {
-    if (!poller_->poll())
-      continue;
+    poller_->poll(nextTimeout());
+    handleTimeout();
   }
 }
 
-void TcpServer::quit() { wakeUp(); }
+void TcpServer::quit() {
+  quit_ = true;
+  wakeUp();
+}
 
 void TcpServer::wakeUp() {
   uint64_t one = 1;
@@ -79,14 +154,33 @@ void TcpServer::wakeUp() {
 void TcpServer::handleWakeup() {
   uint64_t one = 1;
   ::read(evfd_, &one, sizeof(one));
-  quit_ = true;
+  // re-arm, the wakeup may have been for a new timer deadline
+  poller_->updateEvent(evfd_, EPOLLIN | kConnectionEvent);
+}
+
+int TcpServer::nextTimeout() const {
+  uint64_t deadline =
+      std::min(alive_timer_->nextExpiry(), session_timer_->nextExpiry());
+  if (deadline == UINT64_MAX)
+    return -1;
+  uint64_t now = TimeStamp::loopMonotonic();
+  if (deadline <= now)
+    return 0;
+  return (int)std::min<uint64_t>(deadline - now, INT32_MAX);
 }
 
-void TcpServer::handleTimeout(int fd) {
-  if (alive_timer_ && alive_timer_->getFd() == fd)
-    alive_timer_->handleTimeout();
-  else if (session_timer_ && session_timer_->getFd() == fd)
-    session_timer_->handleTimeout();
+void TcpServer::handleTimeout() {
+  // deadlines queued by other threads since the last wakeup
+  applyAliveTimers();
+  if (hangup) {
+    hangup = 0;
+    if (reload_cb_)
+      reload_cb_();
+  }
+  if (terminating)
+    quit_ = true;
+  alive_timer_->handleTimeout();
+  session_timer_->handleTimeout();
 }
 
 void TcpServer::handleRead(int fd) {
@@ -96,19 +190,109 @@ void TcpServer::handleRead(int fd) {
   } else if (fd == evfd_) {
     // Event fd
     handleWakeup();
-  } else if (alive_timer_ && (fd == alive_timer_->getFd()) ||
-             (session_timer_ && fd == session_timer_->getFd())) {
-    // Timer fd
-    handleTimeout(fd);
-  } else {
+  } else if (!dispatchWatcher(fd, EPOLLIN)) {
     // Connection fd
     handleConnectionRead(&conns_[fd]);
   }
 }
 
-void TcpServer::handleWrite(int fd) { handleConnectionWrite(&conns_[fd]); }
+void TcpServer::handleWrite(int fd) {
+  if (!dispatchWatcher(fd, EPOLLOUT))
+    handleConnectionWrite(&conns_[fd]);
+}
+
+void TcpServer::handleClose(int fd) {
+  if (!dispatchWatcher(fd, EPOLLHUP))
+    handleConnectionClose(&conns_[fd]);
+}
+
+void TcpServer::suspend(TcpConnection *conn, int timeout_ms) {
+  touch(conn, timeout_ms);
+  // EPOLLRDHUP, EPOLLHUP and EPOLLERR only
+  poller_->updateEvent(conn->getFd(), kConnectionEvent);
+}
+
+void TcpServer::touch(TcpConnection *conn, int timeout_ms) {
+  postAliveTimer(conn->getFd(), std::max(timeout_ms, idle_timeout_.load()));
+}
+
+void TcpServer::resume(TcpConnection *conn) {
+  detach(conn->getFd());
+  if (conn->isDisconnected() || conn->getChannel() == nullptr)
+    return;
+  postAliveTimer(conn->getFd(), idle_timeout_);
+  poller_->updateEvent(conn->getFd(), EPOLLOUT | kConnectionEvent);
+}
+
+void TcpServer::postAliveTimer(int fd, int timeout_ms) {
+  std::lock_guard<std::mutex> lock(timer_mutex_);
+  timer_updates_.emplace_back(fd, timeout_ms);
+}
+
+void TcpServer::applyAliveTimers() {
+  std::vector<std::pair<int, int>> updates;
+  {
+    std::lock_guard<std::mutex> lock(timer_mutex_);
+    if (timer_updates_.empty())
+      return;
+    updates.swap(timer_updates_);
+  }
+  for (const auto &[fd, timeout_ms] : updates) {
+    if (timeout_ms == kCancelTimer)
+      alive_timer_->cancel(fd);
+    else
+      alive_timer_->add(fd, timeout_ms);
+  }
+}
+
+void TcpServer::attach(TcpConnection *conn, const WatchCallback &cb) {
+  std::lock_guard<std::mutex> lock(watch_mutex_);
+  watchers_[conn->getFd()] = cb;
+}
+
+void TcpServer::rearm(TcpConnection *conn, int events) {
+  if (conn->isDisconnected() || conn->getChannel() == nullptr)
+    return;
+  poller_->updateEvent(conn->getFd(), events | kConnectionEvent);
+}
+
+void TcpServer::detach(int fd) {
+  std::lock_guard<std::mutex> lock(watch_mutex_);
+  watchers_.erase(fd);
+}
+
+void TcpServer::watch(int fd, int events, const WatchCallback &cb) {
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    watchers_[fd] = cb;
+  }
+  poller_->addEvent(fd, events | kConnectionEvent);
+}
+
+void TcpServer::rewatch(int fd, int events) {
+  poller_->updateEvent(fd, events | kConnectionEvent);
+}
 
-void TcpServer::handleClose(int fd) { handleConnectionClose(&conns_[fd]); }
+void TcpServer::unwatch(int fd) {
+  poller_->removeEvent(fd);
+  std::lock_guard<std::mutex> lock(watch_mutex_);
+  watchers_.erase(fd);
+}
+
+bool TcpServer::dispatchWatcher(int fd, int events) {
+  WatchCallback cb;
+  {
+    std::lock_guard<std::mutex> lock(watch_mutex_);
+    if (watchers_.empty())
+      return false;
+    auto it = watchers_.find(fd);
+    if (it == watchers_.end())
+      return false;
+    cb = it->second;
+  }
+  ThreadPool::instance().add(std::bind(cb, events));
+  return true;
+}
 
 void TcpServer::handleServerAccept() {
   do {
@@ -118,7 +302,8 @@ void TcpServer::handleServerAccept() {
 
     // allocate channel
     Channel *channel = nullptr;
-    if (GET_CONFIG(bool, "server", "enable_https")) {
+    // enable_https takes effect at startup, when the certificate is loaded
+    if (ssl_) {
       SslChannel *ssl_channel = ssl_->createSslChannel(connfd);
       channel = ssl_channel;
       int ret = ssl_->accept(ssl_channel);
@@ -138,12 +323,19 @@ void TcpServer::handleConnected(int connfd, Channel *channel) {
   option::setNonBlocking(connfd);
   conns_[connfd].initialize(connfd);
   conns_[connfd].setChannel(channel);
+  if (capture_) {
+    capture_->open(connfd);
+    conns_[connfd].setCapture(capture_.get());
+  }
+  accepted_.add();
+  active_.add();
 
   poller_->addEvent(connfd, EPOLLIN | kConnectionEvent);
 
-  alive_timer_->add(Timer(
-      connfd, TimeStamp::nowMsecond(idle_timeout_),
-      std::bind(&TcpServer::handleConnectionClose, this, &conns_[connfd])));
+  // the previous connection on this fd queued its cancel before its close,
+  // apply it now so that it cannot remove the new deadline
+  applyAliveTimers();
+  alive_timer_->add(connfd, idle_timeout_);
 
   if (new_conn_cb_)
     new_conn_cb_(&conns_[connfd]);
@@ -153,8 +345,9 @@ void TcpServer::handleConnectionRead(TcpConnection *conn) {
   if (conn->isDisconnected() || conn->getChannel() == nullptr)
     return;
 
-  alive_timer_->adjust(
-      Timer(conn->getFd(), TimeStamp::nowMsecond(idle_timeout_), nullptr));
+  alive_timer_->refresh(conn->getFd(), idle_timeout_);
+  if (read_timing_)
+    conn->setReadyTime(TimeStamp::monotonicMicros());
   ThreadPool::instance().add(std::bind(&TcpServer::onRead, this, conn));
 }
 
@@ -162,8 +355,7 @@ void TcpServer::handleConnectionWrite(TcpConnection *conn) {
   if (conn->isDisconnected() || conn->getChannel() == nullptr)
     return;
 
-  alive_timer_->adjust(
-      Timer(conn->getFd(), TimeStamp::nowMsecond(idle_timeout_), nullptr));
+  alive_timer_->refresh(conn->getFd(), idle_timeout_);
   ThreadPool::instance().add(std::bind(&TcpServer::onWrite, this, conn));
 }
 
@@ -172,11 +364,18 @@ void TcpServer::handleConnectionClose(TcpConnection *conn) {
     return;
 
   conn->setDisconnected(true);
+  active_.add(-1);
+  detach(conn->getFd());
+  // this may run on a pool thread, the loop removes the deadline
+  postAliveTimer(conn->getFd(), kCancelTimer);
 
   if (closed_cb_)
     closed_cb_(conn);
 
   poller_->removeEvent(conn->getFd());
+  // before the fd can be handed to a new connection
+  if (capture_)
+    capture_->close(conn->getFd());
   // free channel
   if (conn->getChannel())
     conn->setChannel(nullptr);
@@ -184,6 +383,8 @@ void TcpServer::handleConnectionClose(TcpConnection *conn) {
 
 void TcpServer::onWrite(TcpConnection *conn) {
   const auto [n, again, cflag] = conn->writeAgain();
+  if (cflag && write_complete_cb_)
+    write_complete_cb_(conn);
   if (n == 0) {
     if (conn->isKeepAlive()) {
       if (cflag) {
@@ -217,12 +418,18 @@ void TcpServer::onRead(TcpConnection *conn) {
     poller_->updateEvent(conn->getFd(), EPOLLIN | kConnectionEvent);
   else {
     // Maybe there's a lot of data to send
-    if (msg_cb_(conn)) {
+    switch (msg_cb_(conn)) {
+    case MessageStatus::Write:
       // After receiving all the data, start sending the message
       poller_->updateEvent(conn->getFd(), EPOLLOUT | kConnectionEvent);
-    } else {
+      break;
+    case MessageStatus::Read:
       // Otherwise, Continue reading data
       poller_->updateEvent(conn->getFd(), EPOLLIN | kConnectionEvent);
+      break;
+    case MessageStatus::Suspend:
+      // suspend() has re-armed the connection, resume() starts the write
+      break;
     }
   }
 }
@@ -1,56 +1,36 @@
 #include "../include/TimerQueue.h"
-#include <sys/timerfd.h>
-#include <unistd.h>
 
 using namespace soc::net;
 
-TimerQueue::TimerQueue()
-    : tmfd_(::timerfd_create(CLOCK_REALTIME, 0)), timer_heap_(new TimerHeap) {}
+TimerQueue::TimerQueue(const TimeoutCallback &wakeup)
+    : timer_heap_(new TimerHeap), wakeup_(wakeup), size_(0) {}
 
-// run once
-void TimerQueue::runOnce(const TimeStamp &t) {
-  uint64_t second = t.second();
-  uint64_t nanosecond = (t.microsecond() - t.second() * 1000000) * 100;
-  timespec now;
-  ::clock_gettime(CLOCK_REALTIME, &now);
-  itimerspec itsp;
-  itsp.it_value.tv_sec = now.tv_sec + second;
-  itsp.it_value.tv_nsec = now.tv_nsec + nanosecond;
-  itsp.it_interval.tv_sec = 0;
-  itsp.it_interval.tv_nsec = 0;
-
-  ::timerfd_settime(tmfd_, TFD_TIMER_ABSTIME, &itsp, nullptr);
+void TimerQueue::add(const Timer &timer) {
+  timer_heap_->push(timer);
+  size_.store(timer_heap_->size(), std::memory_order_relaxed);
+  if (wakeup_ && timer_heap_->earliest() == timer.timestamp)
+    wakeup_();
 }
 
-// run every
-void TimerQueue::runEvery(const TimeStamp &t) {
-  uint64_t second = t.second();
-  uint64_t nanosecond = (t.microsecond() - t.second() * 1000000) * 100;
-  timespec now;
-  ::clock_gettime(CLOCK_REALTIME, &now);
-  itimerspec itsp;
-  itsp.it_value.tv_sec = now.tv_sec + second;
-  itsp.it_value.tv_nsec = now.tv_nsec + nanosecond;
-  itsp.it_interval.tv_sec = second;
-  itsp.it_interval.tv_nsec = nanosecond;
+void TimerQueue::adjust(const Timer &timer) { timer_heap_->adjust(timer); }
 
-  ::timerfd_settime(tmfd_, TFD_TIMER_ABSTIME, &itsp, nullptr);
+uint64_t TimerQueue::nextExpiry() const {
+  TimeStamp earliest = timer_heap_->earliest();
+  if (earliest == TimeStamp::max())
+    return UINT64_MAX;
+  return earliest.millsecond();
 }
 
-void TimerQueue::add(const Timer &timer) { timer_heap_->push(timer); }
-
-void TimerQueue::adjust(const Timer &timer) { timer_heap_->adjust(timer); }
-
 void TimerQueue::handleTimeout() {
-  uint64_t one;
-  ::read(tmfd_, &one, sizeof(one));
-
-  TimeStamp now = TimeStamp::now();
+  TimeStamp now = TimeStamp::monotonicNow();
   while (!timer_heap_->empty()) {
     auto expired = timer_heap_->top();
     if (expired.timestamp <= now) {
-      expired.callback();
+      // pop before running, the callback may add timers
       timer_heap_->pop();
+      size_.store(timer_heap_->size(), std::memory_order_relaxed);
+      if (expired.callback)
+        expired.callback();
     } else {
       break;
     }
@@ -0,0 +1,117 @@
+#include "../include/TimerWheel.h"
+
+using namespace soc::net;
+
+TimerWheel::TimerWheel(int tick_ms, size_t slots, const ExpireCallback &cb)
+    : tick_ms_(tick_ms > 0 ? tick_ms : 1), slots_(slots ? slots : 1, -1),
+      size_(0), current_(nowTick()), cb_(cb) {}
+
+void TimerWheel::add(int fd, int timeout_ms) {
+  if (fd < 0)
+    return;
+  if ((size_t)fd >= entries_.size())
+    entries_.resize(fd + 1);
+  // round up, a deadline never fires early
+  schedule(fd, nowTick() + (timeout_ms + tick_ms_ - 1) / tick_ms_);
+}
+
+void TimerWheel::refresh(int fd, int timeout_ms) {
+  if (fd >= 0 && (size_t)fd < entries_.size() && entries_[fd].linked)
+    add(fd, timeout_ms);
+}
+
+void TimerWheel::cancel(int fd) {
+  if (fd < 0 || (size_t)fd >= entries_.size() || !entries_[fd].linked)
+    return;
+  unlink(fd);
+  --size_;
+}
+
+void TimerWheel::schedule(int fd, uint64_t deadline) {
+  Entry &e = entries_[fd];
+  if (!e.linked) {
+    e.deadline = deadline;
+    link(fd, deadline);
+    ++size_;
+  } else if (deadline < e.slotted) {
+    // an earlier deadline cannot wait for the old slot
+    unlink(fd);
+    e.deadline = deadline;
+    link(fd, deadline);
+  } else {
+    e.deadline = deadline;
+  }
+}
+
+void TimerWheel::link(int fd, uint64_t tick) {
+  // the slot of a deadline that already passed is the next one processed
+  if (tick <= current_)
+    tick = current_ + 1;
+  Entry &e = entries_[fd];
+  int &head = slots_[tick % slots_.size()];
+  e.slotted = tick;
+  e.prev = -1;
+  e.next = head;
+  if (head >= 0)
+    entries_[head].prev = fd;
+  head = fd;
+  e.linked = true;
+}
+
+void TimerWheel::unlink(int fd) {
+  Entry &e = entries_[fd];
+  if (e.prev >= 0)
+    entries_[e.prev].next = e.next;
+  else
+    slots_[e.slotted % slots_.size()] = e.next;
+  if (e.next >= 0)
+    entries_[e.next].prev = e.prev;
+  e.prev = e.next = -1;
+  e.linked = false;
+}
+
+uint64_t TimerWheel::nowTick() const {
+  return TimeStamp::loopMonotonic() / tick_ms_;
+}
+
+uint64_t TimerWheel::nextExpiry() const {
+  if (size_ == 0)
+    return UINT64_MAX;
+  for (uint64_t tick = current_ + 1; tick <= current_ + slots_.size(); ++tick) {
+    if (slots_[tick % slots_.size()] >= 0)
+      return tick * tick_ms_;
+  }
+  return UINT64_MAX;
+}
+
+void TimerWheel::handleTimeout() {
+  uint64_t now = nowTick();
+  // after a long stall one turn covers every slot
+  if (now - current_ > slots_.size())
+    current_ = now - slots_.size();
+
+  std::vector<int> expired;
+  while (current_ < now) {
+    ++current_;
+    int fd = slots_[current_ % slots_.size()];
+    while (fd >= 0) {
+      Entry &e = entries_[fd];
+      int next = e.next;
+      if (e.deadline <= now) {
+        unlink(fd);
+        --size_;
+        expired.push_back(fd);
+      } else if (e.deadline != e.slotted) {
+        // pushed back since it was linked, move it to its real slot
+        unlink(fd);
+        link(fd, e.deadline);
+      }
+      // otherwise the deadline is a later turn of this slot
+      fd = next;
+    }
+  }
+
+  // callbacks may add or cancel timers
+  for (int fd : expired)
+    cb_(fd);
+}
@@ -3,12 +3,38 @@
 
 #include "../../libjson/include/JsonFormatter.h"
 #include "../../libjson/include/JsonParser.h"
+#include "RcuPtr.h"
+#include <memory>
 #include <unordered_map>
 #include <variant>
 
 using namespace libjson;
 
 namespace soc {
+
+// The "server" settings read while serving requests, compiled from the file
+// when it is loaded so that reading one is a field access
+struct ServerConfig {
+  std::string listen_ip;
+  int listen_port = 0;
+  // listen_ip when server_hostname is not configured
+  std::string server_hostname;
+  bool enable_https = false;
+  bool enable_php = false;
+  bool enable_sendfile = false;
+  int idle_timeout = 0;
+  int session_lifetime = 0;
+  std::vector<std::string> default_page;
+  std::string user_pass_file;
+  std::string authenticate_realm;
+  // scheme://host:port, the prefix of HttpRequest::getFullUrl()
+  std::string base_url;
+  // empty for stdout
+  std::string log_file;
+  // Logger::LV_DEBUG when not configured, LV_INFO for an unknown name
+  int log_level = 0;
+};
+
 class AppConfig {
 public:
   using Values = std::variant<std::string, int, bool, std::vector<std::string>>;
@@ -20,12 +46,28 @@ public:
     return config;
   }
 
+  // References into the config stay valid until the calling thread reads
+  // the config again, see RcuPtr
   const Values &get(const std::string &key, const std::string &subKey) const;
-  bool exist(const std::string &key, const std::string &subKey);
+  bool exist(const std::string &key, const std::string &subKey) const;
+
+  // The typed settings of the current load
+  const ServerConfig &server() const { return current_.get()->server; }
+
+  // Parse the file again and publish the result, readers switch over without
+  // a lock and the previous load is freed once no thread reads it. The
+  // current config stays when the file cannot be parsed
+  bool reload();
 
   ~AppConfig() {}
 
 private:
+  // One load of the file, never modified once published
+  struct Snapshot {
+    ConfigMp values;
+    ServerConfig server;
+  };
+
   AppConfig(const std::string &config = "./config.json");
 
   AppConfig(const AppConfig &) = delete;
@@ -33,8 +75,12 @@ private:
   AppConfig(AppConfig &&) = delete;
   AppConfig &operator==(AppConfig &&) = delete;
 
+  static std::unique_ptr<Snapshot> load(const std::string &file);
+  static void compile(Snapshot &snapshot);
+
 private:
-  ConfigMp config_;
+  std::string file_;
+  RcuPtr<Snapshot> current_;
 };
 
 #define EXIST_CONFIG(KEY, SUBKEY) AppConfig::instance().exist((KEY), (SUBKEY))
@@ -42,6 +88,8 @@ private:
 #define GET_CONFIG(T, KEY, SUBKEY)                                             \
   std::get<T>(AppConfig::instance().get((KEY), (SUBKEY)))
 
+#define SERVER_CONFIG() AppConfig::instance().server()
+
 } // namespace soc
 
-#endif
\ No newline at end of file
+#endif
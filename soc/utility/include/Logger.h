@@ -1,17 +1,39 @@
 #ifndef SOC_UTILITY_LOGGER_H
 #define SOC_UTILITY_LOGGER_H
 
+#include "../../net/include/TimeStamp.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Levels below this are compiled out of LOG_* call sites
+#ifndef SOC_LOG_LEVEL
+#define SOC_LOG_LEVEL 0
+#endif
+
 namespace soc {
 
 static constexpr const size_t kMaxLineBuffer = 512;
 
+// Call sites encode the format pointer and the arguments as a binary record
+// into a ring owned by their thread, a background thread formats the records
+// and writes them in batches. A full ring drops the record instead of
+// waiting, the drops are reported in the log. The format and file name must
+// be string literals, the arguments may be integers, floating point numbers,
+// pointers and strings; `*` widths are not supported
 class Logger {
 public:
-  enum { LV_INFO, LV_WARN, LV_DEBUG, LV_ERROR };
+  // in order of severity
+  enum { LV_DEBUG, LV_INFO, LV_WARN, LV_ERROR };
   enum {
     F_None = 0,
     F_Black = 30,
@@ -31,68 +53,184 @@ public:
     return logger;
   }
 
+  ~Logger();
+
+  // Write to path instead of stdout. The file is rotated to path.1 ...
+  // path.<max_files> once it reaches max_bytes, 0 never rotates
+  bool open(const std::string &path, size_t max_bytes = 0,
+            int max_files = 5);
+  void setLevel(int lv) { level_.store(lv, std::memory_order_relaxed); }
+  bool enabled(int lv) const {
+    return lv >= level_.load(std::memory_order_relaxed);
+  }
+  // Block until the records logged so far are written
+  void flush();
+
   template <int fc = F_None, int cc = C_None, int lv = LV_INFO, class... Args>
   void format(const char *fmt, int LINE, const char *FILE_NAME,
               Args &&...args) {
-    int len = ::snprintf(nullptr, 0, fmt, args...);
-    char buffer[kMaxLineBuffer]{0};
-    ::snprintf(buffer, len + 1, fmt, args...);
-
-    char times[25]{0};
-    time_t t = ::time(nullptr);
-    ::strftime(times, 25, "%Y-%m-%d %H:%M:%S", ::localtime(&t));
-
-    char lvs[9]{0};
-    if (lv == LV_INFO)
-      ::strcpy(lvs, "INFO");
-    else if (lv == LV_WARN)
-      ::strcpy(lvs, "WARN");
-    else if (lv == LV_DEBUG)
-      ::strcpy(lvs, "DEBUG");
-    else if (lv == LV_ERROR)
-      ::strcpy(lvs, "ERROR");
-    else
-      ::strcpy(lvs, "UNKNOWN");
-
-    if (fc != F_None && cc != C_None)
-      ::fprintf(stdout, "\033[%d;%dm[%s]:[%s]:[%d]:[%s] %s\033[0m\n", fc, cc,
-                lvs, times, LINE, FILE_NAME, buffer);
-    else if (fc == F_None && cc == C_None)
-      ::fprintf(stdout, "[%s]:[%s]:[%d]:[%s] %s\n", lvs, times, LINE, FILE_NAME,
-                buffer);
-    else {
-      ::fprintf(stdout, "\033[%dm[%s]:[%s]:[%d]:[%s] %s\033[0m\n", fc ? fc : cc,
-                lvs, times, LINE, FILE_NAME, buffer);
-    }
-    ::fflush(stdout);
+    Record record;
+    Header &h = record.header;
+    h.level = lv;
+    h.fc = fc;
+    h.cc = cc;
+    h.nargs = sizeof...(args);
+    h.line = LINE;
+    h.fmt = fmt;
+    h.file = FILE_NAME;
+    // not loopNow(): logging also happens outside of the event loops
+    h.time = net::TimeStamp::coarseRealtimeMicros();
+    (record.encode(args), ...);
+    h.size = record.size;
+    push(record);
   }
 
 private:
-  Logger() = default;
+  // a record in the ring starts with its header, the arguments follow as
+  // a tag byte and the value
+  struct Header {
+    uint32_t size;
+    uint8_t level;
+    uint8_t fc;
+    uint8_t cc;
+    uint8_t nargs;
+    int32_t line;
+    const char *fmt;
+    const char *file;
+    uint64_t time;
+  };
+
+  enum : char { kInt = 'i', kUnsigned = 'u', kDouble = 'd', kString = 's',
+                kPointer = 'p' };
+
+  struct Record {
+    union {
+      Header header;
+      char data[kMaxLineBuffer];
+    };
+    size_t size = sizeof(Header);
+
+    void put(char tag, const void *value, size_t len) {
+      if (size + 1 + len > sizeof(data))
+        return;
+      data[size++] = tag;
+      ::memcpy(data + size, value, len);
+      size += len;
+    }
+    void putString(std::string_view s) {
+      // strings are cut to the room left in the record
+      size_t room = sizeof(data) - size;
+      if (room < 1 + sizeof(uint16_t))
+        return;
+      uint16_t len = std::min(s.size(), room - 1 - sizeof(uint16_t));
+      data[size++] = kString;
+      ::memcpy(data + size, &len, sizeof(len));
+      ::memcpy(data + size + sizeof(len), s.data(), len);
+      size += sizeof(len) + len;
+    }
+
+    template <class T> void encode(const T &value) {
+      using U = std::decay_t<T>;
+      if constexpr (std::is_same_v<U, char *> ||
+                    std::is_same_v<U, const char *>) {
+        putString(value ? std::string_view(value) : "(null)");
+      } else if constexpr (std::is_convertible_v<const U &,
+                                                 std::string_view>) {
+        putString(std::string_view(value));
+      } else if constexpr (std::is_floating_point_v<U>) {
+        double v = value;
+        put(kDouble, &v, sizeof(v));
+      } else if constexpr (std::is_integral_v<U> && std::is_unsigned_v<U> &&
+                           !std::is_same_v<U, bool>) {
+        uint64_t v = value;
+        put(kUnsigned, &v, sizeof(v));
+      } else if constexpr (std::is_integral_v<U> || std::is_enum_v<U>) {
+        int64_t v = (int64_t)value;
+        put(kInt, &v, sizeof(v));
+      } else {
+        static_assert(std::is_pointer_v<U>, "unsupported log argument");
+        uint64_t v = (uintptr_t)value;
+        put(kPointer, &v, sizeof(v));
+      }
+    }
+  };
+
+  // Single producer, the owning thread, and single consumer, the writer
+  struct Ring {
+    static constexpr size_t kCapacity = 1024 * 1024;
+    char data[kCapacity];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    // the thread exited, the ring is freed once drained
+    std::atomic<bool> retired{false};
+  };
+  struct RingOwner;
+
+  Logger();
   Logger(const Logger &) = delete;
   Logger &operator=(const Logger &) = delete;
   Logger(Logger &&) = delete;
   Logger &operator=(Logger &&) = delete;
+
+  Ring *localRing();
+  void push(const Record &record);
+  void run();
+  // Format every record in the rings into out, returns whether any was found
+  bool drain(std::string &out);
+  void formatRecord(const char *data, std::string &out);
+  void write(const std::string &out);
+  void rotate();
+
+private:
+  std::atomic<int> level_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+  // flush() waits for a batch started after its request
+  uint64_t flush_requested_ = 0;
+  uint64_t flushed_ = 0;
+  bool stop_ = false;
+
+  // the output, changed by open()
+  std::mutex file_mutex_;
+  int fd_;
+  bool color_;
+  std::string path_;
+  size_t max_bytes_;
+  int max_files_;
+  size_t written_;
+  // only used by the writer thread
+  uint64_t dropped_;
+  uint64_t last_second_;
+  char times_[25];
+  std::thread writer_;
 };
 
 #define LOG_TEMPLATE(fmt, F, C, L, LN, FN, ...)                                \
-  Logger::getLogger().format<Logger::F, Logger::C, Logger::L>((fmt), LN, FN,   \
-                                                              __VA_ARGS__)
+  do {                                                                         \
+    if constexpr (Logger::L >= SOC_LOG_LEVEL) {                                \
+      if (Logger::getLogger().enabled(Logger::L))                              \
+        Logger::getLogger().format<Logger::F, Logger::C, Logger::L>(           \
+            (fmt), LN, FN, ##__VA_ARGS__);                                     \
+    }                                                                          \
+  } while (0)
+
 #define LOG_INFO(fmt, ...)                                                     \
   LOG_TEMPLATE((fmt), F_Green, C_Highlight, LV_INFO, __LINE__, __FILE__,       \
-               __VA_ARGS__)
+               ##__VA_ARGS__)
 
 #define LOG_WARN(fmt, ...)                                                     \
   LOG_TEMPLATE((fmt), F_Orange, C_Highlight, LV_WARN, __LINE__, __FILE__,      \
-               __VA_ARGS__)
+               ##__VA_ARGS__)
 
 #define LOG_DEBUG(fmt, ...)                                                    \
   LOG_TEMPLATE((fmt), F_None, C_Highlight, LV_DEBUG, __LINE__, __FILE__,       \
-               __VA_ARGS__)
+               ##__VA_ARGS__)
 
 #define LOG_ERROR(fmt, ...)                                                    \
   LOG_TEMPLATE((fmt), F_Red, C_Highlight, LV_ERROR, __LINE__, __FILE__,        \
-               __VA_ARGS__)
+               ##__VA_ARGS__)
 
 } // namespace soc
 
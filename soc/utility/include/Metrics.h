@@ -0,0 +1,131 @@
+#ifndef SOC_UTILITY_METRICS_H
+#define SOC_UTILITY_METRICS_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace soc {
+
+// Counters, gauges and latency histograms in the Prometheus text format.
+// Every thread adds to its own shard of slots, written only by that thread,
+// so an update is a thread_local lookup and a plain add. The shards are
+// summed when the metrics are scraped
+class Metrics {
+public:
+  static Metrics &instance() {
+    static Metrics metrics;
+    return metrics;
+  }
+
+  // A counter or gauge series
+  class Counter {
+  public:
+    Counter() : slot_(kNoSlot) {}
+    void add(int64_t n = 1) const {
+      if (slot_ != kNoSlot)
+        Metrics::add(slot_, n);
+    }
+
+  private:
+    friend class Metrics;
+    explicit Counter(size_t slot) : slot_(slot) {}
+    size_t slot_;
+  };
+
+  // Durations in microseconds, exported in seconds
+  class Histogram {
+  public:
+    Histogram() : slot_(kNoSlot) {}
+    void observe(uint64_t us) const;
+
+  private:
+    friend class Metrics;
+    explicit Histogram(size_t slot) : slot_(slot) {}
+    size_t slot_;
+  };
+
+  // labels such as `code="2xx"`, series of one name share its help. A series
+  // registered again, say by a second server, shares the slots of the first
+  Counter counter(const std::string &name, const std::string &help,
+                  const std::string &labels = "");
+  Counter gauge(const std::string &name, const std::string &help,
+                const std::string &labels = "");
+  Histogram histogram(const std::string &name, const std::string &help,
+                      const std::string &labels = "");
+  // A gauge read when scraped, for values kept elsewhere. The readers of one
+  // name are summed. The returned id is passed to removeGauge() before the
+  // value goes away
+  size_t gauge(const std::string &name, const std::string &help,
+               const std::function<double()> &value);
+  // Waits for a scrape that may be calling the reader
+  void removeGauge(size_t id);
+
+  std::string scrape() const;
+
+private:
+  static constexpr size_t kSlots = 512;
+  // slot of default handles and of those registered once the slots ran out,
+  // their updates are dropped
+  static constexpr size_t kNoSlot = SIZE_MAX;
+
+  struct Shard {
+    std::atomic<int64_t> slots[kSlots];
+  };
+
+  struct Series {
+    std::string labels;
+    size_t slot;
+  };
+
+  struct Reader {
+    size_t id;
+    std::function<double()> value;
+  };
+
+  struct Family {
+    std::string name;
+    std::string help;
+    // counter, gauge or histogram
+    const char *type;
+    std::vector<Series> series;
+    std::vector<Reader> readers;
+  };
+
+  Metrics() : next_slot_(0), next_reader_(0) {}
+  Metrics(const Metrics &) = delete;
+  Metrics &operator=(const Metrics &) = delete;
+
+  static void add(size_t slot, int64_t n) {
+    std::atomic<int64_t> &v = local()->slots[slot];
+    // only this thread writes its shard
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  static Shard *local();
+  Family &family(const std::string &name, const std::string &help,
+                 const char *type);
+  size_t reserve(const std::string &name, const std::string &help,
+                 const char *type, const std::string &labels, size_t slots);
+  int64_t sum(size_t slot) const;
+
+private:
+  mutable std::mutex mutex_;
+  std::vector<Family> families_;
+  size_t next_slot_;
+  size_t next_reader_;
+  // held while the readers are called, outside mutex_ so that they may
+  // update metrics
+  mutable std::mutex readers_mutex_;
+  // shards of exited threads are kept, their counts still belong to the
+  // totals
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+} // namespace soc
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef SOC_UTILITY_RCUPTR_H
+#define SOC_UTILITY_RCUPTR_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace soc {
+
+// An immutable value that writers replace as a whole and readers use without
+// a lock. Every thread holds on to the version it read last and swaps it for
+// the current one on its next read after a publish(), so a replaced version
+// is freed once all threads that read it have read again and no copy of
+// pinned() is left. A reference from get() is valid until the same thread
+// reads this RcuPtr again
+template <class T> class RcuPtr {
+public:
+  RcuPtr() : slot_(slots_.fetch_add(1, std::memory_order_relaxed)) {}
+
+  RcuPtr(const RcuPtr &) = delete;
+  RcuPtr &operator=(const RcuPtr &) = delete;
+
+  void publish(std::shared_ptr<const T> value) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    current_ = std::move(value);
+    version_.fetch_add(1, std::memory_order_release);
+  }
+
+  // The current version, nullptr before the first publish()
+  const T *get() const { return pinned().get(); }
+
+  // The version this thread holds, copy it to keep it past the next read
+  const std::shared_ptr<const T> &pinned() const {
+    if (pins_.size() <= slot_)
+      pins_.resize(slot_ + 1);
+    Pin &pin = pins_[slot_];
+    if (pin.version != version_.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> locker(mutex_);
+      pin.value = current_;
+      pin.version = version_.load(std::memory_order_relaxed);
+    }
+    return pin.value;
+  }
+
+private:
+  struct Pin {
+    uint64_t version = 0;
+    std::shared_ptr<const T> value;
+  };
+
+  // each RcuPtr owns one pin per thread, slots are never reused
+  static inline std::atomic<size_t> slots_{0};
+  static inline thread_local std::vector<Pin> pins_;
+
+  const size_t slot_;
+  std::atomic<uint64_t> version_{0};
+  std::shared_ptr<const T> current_;
+  mutable std::mutex mutex_;
+};
+
+} // namespace soc
+
+#endif
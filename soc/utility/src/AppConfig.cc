@@ -1,12 +1,48 @@
 #include "../include/AppConfig.h"
+#include "../include/Logger.h"
 using namespace soc;
 
-AppConfig::AppConfig(const std::string &config) {
-  std::ifstream ifs(config, std::ios_base::in);
-  JsonParser parser(ifs);
+namespace {
+template <class T>
+T valueOf(const AppConfig::ConfigMp &config, const std::string &key,
+          const std::string &subKey, const T &value) {
+  auto x = config.find(key);
+  if (x == config.end())
+    return value;
+  auto y = x->second.find(subKey);
+  if (y == x->second.end())
+    return value;
+  const T *v = std::get_if<T>(&y->second);
+  return v ? *v : value;
+}
+} // namespace
+
+AppConfig::AppConfig(const std::string &config) : file_(config) {
+  // nothing can run without a config
+  auto snapshot = load(file_);
+  if (!snapshot) {
+    fprintf(stderr, "Load config failed: %s\n", file_.c_str());
+    ::exit(-1);
+  }
+  current_.publish(std::move(snapshot));
+}
+
+std::unique_ptr<AppConfig::Snapshot> AppConfig::load(const std::string &file) {
+  std::ifstream ifs(file, std::ios_base::in);
+  std::shared_ptr<JsonObject> objPtr;
+  try {
+    JsonParser parser(ifs);
+    objPtr = std::get<0>(parser.parse());
+  } catch (const JsonError &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return nullptr;
+  }
   ifs.close();
-  auto [objPtr, arrPtr, valuePtr] = parser.parse();
+  if (!objPtr)
+    return nullptr;
 
+  auto snapshot = std::make_unique<Snapshot>();
+  ConfigMp &config = snapshot->values;
   size_t n = objPtr->size();
   for (size_t i = 0; i < n; i++) {
     auto obj = objPtr->get(i);
@@ -20,13 +56,13 @@ AppConfig::AppConfig(const std::string &config) {
 
       switch (subvalue->type()) {
       case JsonType::String:
-        config_[key][subkey] = subvalue->value<std::string>();
+        config[key][subkey] = subvalue->value<std::string>();
         break;
       case JsonType::Number:
-        config_[key][subkey] = subvalue->value<int>();
+        config[key][subkey] = subvalue->value<int>();
         break;
       case JsonType::Boolean:
-        config_[key][subkey] = subvalue->value<bool>();
+        config[key][subkey] = subvalue->value<bool>();
         break;
       case JsonType::Array: {
         auto arr = subvalue->toJsonArray();
@@ -35,21 +71,77 @@ AppConfig::AppConfig(const std::string &config) {
           auto val = arr->get(k);
           values.emplace_back(val->value<std::string>());
         }
-        config_[key][subkey] = values;
+        config[key][subkey] = values;
       } break;
       default:
         break;
       }
     }
   }
+  compile(*snapshot);
+  return snapshot;
+}
+
+void AppConfig::compile(Snapshot &snapshot) {
+  const ConfigMp &config = snapshot.values;
+  ServerConfig &server = snapshot.server;
+  server.listen_ip = valueOf<std::string>(config, "server", "listen_ip", "");
+  server.listen_port = valueOf<int>(config, "server", "listen_port", 0);
+  server.server_hostname = valueOf<std::string>(config, "server",
+                                                "server_hostname",
+                                                server.listen_ip);
+  server.enable_https = valueOf<bool>(config, "server", "enable_https", false);
+  server.enable_php = valueOf<bool>(config, "server", "enable_php", false);
+  server.enable_sendfile =
+      valueOf<bool>(config, "server", "enable_sendfile", false);
+  server.idle_timeout = valueOf<int>(config, "server", "idle_timeout", 0);
+  server.session_lifetime =
+      valueOf<int>(config, "server", "session_lifetime", 0);
+  server.default_page = valueOf<std::vector<std::string>>(
+      config, "server", "default_page", {});
+  server.user_pass_file =
+      valueOf<std::string>(config, "server", "user_pass_file", "");
+  server.authenticate_realm =
+      valueOf<std::string>(config, "server", "authenticate_realm", "");
+  server.base_url = std::string(server.enable_https ? "https" : "http") +
+                    "://" + server.server_hostname + ":" +
+                    std::to_string(server.listen_port);
+  server.log_file = valueOf<std::string>(config, "server", "log_file", "");
+
+  std::string level =
+      valueOf<std::string>(config, "server", "log_level", "debug");
+  if (level == "debug")
+    server.log_level = Logger::LV_DEBUG;
+  else if (level == "info")
+    server.log_level = Logger::LV_INFO;
+  else if (level == "warn")
+    server.log_level = Logger::LV_WARN;
+  else if (level == "error")
+    server.log_level = Logger::LV_ERROR;
+  else {
+    fprintf(stderr, "Unknown log_level %s, use info\n", level.c_str());
+    server.log_level = Logger::LV_INFO;
+  }
+}
+
+bool AppConfig::reload() {
+  auto snapshot = load(file_);
+  if (!snapshot) {
+    fprintf(stderr, "Reload config failed, keep the current one: %s\n",
+            file_.c_str());
+    return false;
+  }
+  current_.publish(std::move(snapshot));
+  return true;
 }
 
 const AppConfig::Values &AppConfig::get(const std::string &key,
                                         const std::string &subKey) const {
-  return config_.at(key).at(subKey);
+  return current_.get()->values.at(key).at(subKey);
 }
 
-bool AppConfig::exist(const std::string &key, const std::string &subKey) {
-  return config_.find(key) != config_.end() &&
-         config_[key].find(subKey) != config_[key].end();
+bool AppConfig::exist(const std::string &key, const std::string &subKey) const {
+  const ConfigMp &config = current_.get()->values;
+  auto x = config.find(key);
+  return x != config.end() && x->second.find(subKey) != x->second.end();
 }
@@ -0,0 +1,364 @@
+#include "../include/Logger.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace soc;
+
+namespace {
+// the writer sleeps this long when the rings are empty
+constexpr auto kWriterInterval = std::chrono::milliseconds(10);
+
+const char *levelName(int lv) {
+  switch (lv) {
+  case Logger::LV_DEBUG:
+    return "DEBUG";
+  case Logger::LV_INFO:
+    return "INFO";
+  case Logger::LV_WARN:
+    return "WARN";
+  case Logger::LV_ERROR:
+    return "ERROR";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+void copyFromRing(const char *ring, size_t capacity, uint64_t pos, char *out,
+                  size_t len) {
+  size_t at = pos % capacity;
+  size_t first = std::min(len, capacity - at);
+  ::memcpy(out, ring + at, first);
+  ::memcpy(out + first, ring, len - first);
+}
+
+template <class T> T take(const char *&p) {
+  T v;
+  ::memcpy(&v, p, sizeof(T));
+  p += sizeof(T);
+  return v;
+}
+} // namespace
+
+// Marks the ring of an exiting thread, the writer frees it once drained
+struct Logger::RingOwner {
+  Ring *ring = nullptr;
+  ~RingOwner() {
+    if (ring)
+      ring->retired.store(true, std::memory_order_release);
+  }
+};
+
+Logger::Logger()
+    : level_(LV_DEBUG), fd_(STDOUT_FILENO), color_(::isatty(STDOUT_FILENO)),
+      max_bytes_(0), max_files_(0), written_(0), dropped_(0), last_second_(0),
+      times_{0} {
+  writer_ = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger() {
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  if (writer_.joinable())
+    writer_.join();
+  if (fd_ != STDOUT_FILENO)
+    ::close(fd_);
+}
+
+bool Logger::open(const std::string &path, size_t max_bytes, int max_files) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+  if (fd < 0) {
+    fprintf(stderr, "Open log file failed: %s\n", path.c_str());
+    return false;
+  }
+  std::lock_guard<std::mutex> locker(file_mutex_);
+  if (fd_ != STDOUT_FILENO)
+    ::close(fd_);
+  fd_ = fd;
+  color_ = false;
+  path_ = path;
+  max_bytes_ = max_bytes;
+  max_files_ = max_files;
+  written_ = ::lseek(fd, 0, SEEK_END);
+  return true;
+}
+
+void Logger::flush() {
+  std::unique_lock<std::mutex> locker(mutex_);
+  uint64_t ticket = ++flush_requested_;
+  cond_.notify_all();
+  cond_.wait(locker, [&] { return flushed_ >= ticket || stop_; });
+}
+
+Logger::Ring *Logger::localRing() {
+  thread_local RingOwner owner;
+  if (owner.ring == nullptr) {
+    auto ring = std::make_unique<Ring>();
+    owner.ring = ring.get();
+    std::lock_guard<std::mutex> locker(mutex_);
+    rings_.emplace_back(std::move(ring));
+  }
+  return owner.ring;
+}
+
+void Logger::push(const Record &record) {
+  Ring *ring = localRing();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint64_t tail = ring->tail.load(std::memory_order_acquire);
+  size_t len = record.size;
+  if (Ring::kCapacity - (head - tail) < len) {
+    ring->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  size_t at = head % Ring::kCapacity;
+  size_t first = std::min(len, Ring::kCapacity - at);
+  ::memcpy(ring->data + at, record.data, first);
+  ::memcpy(ring->data, record.data + first, len - first);
+  ring->head.store(head + len, std::memory_order_release);
+}
+
+void Logger::run() {
+  std::string out;
+  while (true) {
+    bool stop;
+    uint64_t serving;
+    {
+      std::unique_lock<std::mutex> locker(mutex_);
+      cond_.wait_for(locker, kWriterInterval, [&] {
+        return stop_ || flush_requested_ > flushed_;
+      });
+      stop = stop_;
+      serving = flush_requested_;
+    }
+
+    out.clear();
+    drain(out);
+    if (!out.empty())
+      write(out);
+
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      flushed_ = serving;
+    }
+    cond_.notify_all();
+    if (stop)
+      break;
+  }
+}
+
+bool Logger::drain(std::string &out) {
+  std::vector<Ring *> rings;
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    for (const auto &ring : rings_)
+      rings.push_back(ring.get());
+  }
+
+  bool found = false;
+  bool retired = false;
+  Record record;
+  for (Ring *ring : rings) {
+    // checked before the records, a retired ring gets no more of them
+    retired |= ring->retired.load(std::memory_order_acquire);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    while (tail < head) {
+      uint32_t size;
+      copyFromRing(ring->data, Ring::kCapacity, tail, (char *)&size,
+                   sizeof(size));
+      copyFromRing(ring->data, Ring::kCapacity, tail, record.data, size);
+      formatRecord(record.data, out);
+      tail += size;
+      found = true;
+    }
+    ring->tail.store(tail, std::memory_order_release);
+    dropped_ += ring->dropped.exchange(0, std::memory_order_relaxed);
+  }
+
+  if (dropped_ > 0) {
+    char line[64];
+    ::snprintf(line, sizeof(line), "[WARN]: logger dropped %lu records\n",
+               (unsigned long)dropped_);
+    out.append(line);
+    dropped_ = 0;
+  }
+
+  if (retired) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    std::erase_if(rings_, [](const std::unique_ptr<Ring> &ring) {
+      return ring->retired.load(std::memory_order_acquire) &&
+             ring->tail.load(std::memory_order_relaxed) ==
+                 ring->head.load(std::memory_order_acquire);
+    });
+  }
+  return found;
+}
+
+void Logger::formatRecord(const char *data, std::string &out) {
+  Header h;
+  ::memcpy(&h, data, sizeof(h));
+  const char *args = data + sizeof(Header);
+  const char *end = data + h.size;
+
+  uint64_t second = h.time / 1000000;
+  if (second != last_second_) {
+    time_t t = second;
+    struct tm tm;
+    ::strftime(times_, sizeof(times_), "%Y-%m-%d %H:%M:%S",
+               ::localtime_r(&t, &tm));
+    last_second_ = second;
+  }
+
+  char buffer[kMaxLineBuffer];
+  bool colored = color_ && (h.fc != F_None || h.cc != C_None);
+  if (colored) {
+    if (h.fc != F_None && h.cc != C_None)
+      ::snprintf(buffer, sizeof(buffer), "\033[%d;%dm", h.fc, h.cc);
+    else
+      ::snprintf(buffer, sizeof(buffer), "\033[%dm", h.fc ? h.fc : h.cc);
+    out.append(buffer);
+  }
+  ::snprintf(buffer, sizeof(buffer), "[%s]:[%s]:[%d]:[%s] ",
+             levelName(h.level), times_, h.line, h.file);
+  out.append(buffer);
+
+  // each conversion of the format is printed on its own with the next
+  // argument, converted to the type the argument was recorded as
+  const char *p = h.fmt;
+  while (*p) {
+    if (*p != '%') {
+      const char *next = ::strchr(p, '%');
+      size_t n = next ? next - p : ::strlen(p);
+      out.append(p, n);
+      p += n;
+      continue;
+    }
+    if (p[1] == '%') {
+      out += '%';
+      p += 2;
+      continue;
+    }
+
+    const char *begin = p++;
+    while (*p && ::strchr("-+ #0", *p))
+      ++p;
+    while (*p >= '0' && *p <= '9')
+      ++p;
+    if (*p == '.') {
+      ++p;
+      while (*p >= '0' && *p <= '9')
+        ++p;
+    }
+    // the length modifier is replaced by the recorded type
+    std::string spec(begin, p - begin);
+    while (*p && ::strchr("hljztLq", *p))
+      ++p;
+    char conv = *p;
+    if (conv == '\0') {
+      out.append(begin);
+      break;
+    }
+    ++p;
+    if (args >= end) {
+      out.append(begin, p - begin);
+      continue;
+    }
+
+    bool integer = ::strchr("diouxXc", conv) != nullptr;
+    bool floating = ::strchr("eEfFgGaA", conv) != nullptr;
+    int n = 0;
+    char tag = *args++;
+    switch (tag) {
+    case kInt:
+    case kUnsigned: {
+      int64_t v = take<int64_t>(args);
+      bool is_signed = tag == kInt;
+      if (conv == 'c') {
+        n = ::snprintf(buffer, sizeof(buffer), (spec + "c").c_str(), (int)v);
+      } else if (floating) {
+        n = ::snprintf(buffer, sizeof(buffer), (spec + conv).c_str(),
+                       is_signed ? (double)v : (double)(uint64_t)v);
+      } else {
+        if (!integer)
+          conv = is_signed ? 'd' : 'u';
+        n = ::snprintf(buffer, sizeof(buffer), (spec + "ll" + conv).c_str(),
+                       (long long)v);
+      }
+      break;
+    }
+    case kDouble: {
+      double v = take<double>(args);
+      if (!floating)
+        conv = 'g';
+      n = ::snprintf(buffer, sizeof(buffer), (spec + conv).c_str(), v);
+      break;
+    }
+    case kString: {
+      uint16_t len = take<uint16_t>(args);
+      std::string s(args, len);
+      args += len;
+      n = ::snprintf(buffer, sizeof(buffer), (spec + "s").c_str(), s.c_str());
+      break;
+    }
+    case kPointer: {
+      uint64_t v = take<uint64_t>(args);
+      n = ::snprintf(buffer, sizeof(buffer), (spec + "p").c_str(),
+                     (void *)(uintptr_t)v);
+      break;
+    }
+    default:
+      // unknown tag, the rest of the record cannot be decoded
+      args = end;
+      break;
+    }
+    if (n > 0)
+      out.append(buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+  }
+
+  if (colored)
+    out.append("\033[0m");
+  out += '\n';
+}
+
+void Logger::write(const std::string &out) {
+  std::lock_guard<std::mutex> locker(file_mutex_);
+  if (max_bytes_ > 0 && written_ > 0 && written_ + out.size() > max_bytes_)
+    rotate();
+
+  const char *p = out.data();
+  size_t len = out.size();
+  while (len > 0) {
+    ssize_t n = ::write(fd_, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    p += n;
+    len -= n;
+  }
+  written_ += out.size();
+}
+
+void Logger::rotate() {
+  // path.<max_files> falls off, path becomes path.1
+  for (int i = max_files_ - 1; i >= 1; --i) {
+    std::string from = path_ + "." + std::to_string(i);
+    std::string to = path_ + "." + std::to_string(i + 1);
+    ::rename(from.c_str(), to.c_str());
+  }
+  if (max_files_ > 0)
+    ::rename(path_.c_str(), (path_ + ".1").c_str());
+
+  int fd = ::open(path_.c_str(),
+                  O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Rotate log file failed: %s\n", path_.c_str());
+    return;
+  }
+  ::close(fd_);
+  fd_ = fd;
+  written_ = 0;
+}
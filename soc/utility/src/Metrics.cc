@@ -0,0 +1,181 @@
+#include "../include/Metrics.h"
+#include <stdio.h>
+
+using namespace soc;
+
+namespace {
+// upper bounds of the histogram buckets in microseconds, the last bucket is
+// +Inf
+constexpr uint64_t kBuckets[] = {100,    500,    1000,   5000,    10000,
+                                 50000,  100000, 500000, 1000000, 5000000};
+constexpr size_t kBucketCount = sizeof(kBuckets) / sizeof(kBuckets[0]) + 1;
+// buckets, then the sum and the count
+constexpr size_t kHistogramSlots = kBucketCount + 2;
+
+std::string seriesName(const std::string &name, const std::string &labels,
+                       const std::string &extra = "") {
+  if (labels.empty() && extra.empty())
+    return name;
+  std::string s = name + "{" + labels;
+  if (!labels.empty() && !extra.empty())
+    s += ",";
+  return s + extra + "}";
+}
+
+void appendValue(std::string &out, const std::string &series, double value) {
+  char buffer[32];
+  ::snprintf(buffer, sizeof(buffer), " %.15g\n", value);
+  out += series;
+  out += buffer;
+}
+} // namespace
+
+Metrics::Shard *Metrics::local() {
+  thread_local Shard *shard = nullptr;
+  if (shard == nullptr) {
+    auto s = std::make_unique<Shard>();
+    for (auto &slot : s->slots)
+      slot.store(0, std::memory_order_relaxed);
+    shard = s.get();
+    Metrics &metrics = instance();
+    std::lock_guard<std::mutex> locker(metrics.mutex_);
+    metrics.shards_.emplace_back(std::move(s));
+  }
+  return shard;
+}
+
+void Metrics::Histogram::observe(uint64_t us) const {
+  if (slot_ == kNoSlot)
+    return;
+  size_t i = 0;
+  while (i < kBucketCount - 1 && us > kBuckets[i])
+    ++i;
+  Metrics::add(slot_ + i, 1);
+  Metrics::add(slot_ + kBucketCount, us);
+  Metrics::add(slot_ + kBucketCount + 1, 1);
+}
+
+Metrics::Family &Metrics::family(const std::string &name,
+                                 const std::string &help, const char *type) {
+  for (auto &family : families_) {
+    if (family.name == name)
+      return family;
+  }
+  families_.push_back({name, help, type, {}, {}});
+  return families_.back();
+}
+
+size_t Metrics::reserve(const std::string &name, const std::string &help,
+                        const char *type, const std::string &labels,
+                        size_t slots) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  Family &f = family(name, help, type);
+  for (const auto &series : f.series) {
+    if (series.labels == labels)
+      return series.slot;
+  }
+  if (next_slot_ + slots > kSlots) {
+    fprintf(stderr, "Too many metrics, %s is not recorded\n", name.c_str());
+    return kNoSlot;
+  }
+  size_t slot = next_slot_;
+  next_slot_ += slots;
+  f.series.push_back({labels, slot});
+  return slot;
+}
+
+Metrics::Counter Metrics::counter(const std::string &name,
+                                  const std::string &help,
+                                  const std::string &labels) {
+  return Counter(reserve(name, help, "counter", labels, 1));
+}
+
+Metrics::Counter Metrics::gauge(const std::string &name,
+                                const std::string &help,
+                                const std::string &labels) {
+  return Counter(reserve(name, help, "gauge", labels, 1));
+}
+
+Metrics::Histogram Metrics::histogram(const std::string &name,
+                                      const std::string &help,
+                                      const std::string &labels) {
+  return Histogram(reserve(name, help, "histogram", labels, kHistogramSlots));
+}
+
+size_t Metrics::gauge(const std::string &name, const std::string &help,
+                      const std::function<double()> &value) {
+  std::lock_guard<std::mutex> locker(mutex_);
+  size_t id = next_reader_++;
+  family(name, help, "gauge").readers.push_back({id, value});
+  return id;
+}
+
+void Metrics::removeGauge(size_t id) {
+  std::lock_guard<std::mutex> readers_locker(readers_mutex_);
+  std::lock_guard<std::mutex> locker(mutex_);
+  for (auto &family : families_) {
+    auto &readers = family.readers;
+    for (auto it = readers.begin(); it != readers.end(); ++it) {
+      if (it->id == id) {
+        readers.erase(it);
+        return;
+      }
+    }
+  }
+}
+
+int64_t Metrics::sum(size_t slot) const {
+  int64_t n = 0;
+  for (const auto &shard : shards_)
+    n += shard->slots[slot].load(std::memory_order_relaxed);
+  return n;
+}
+
+std::string Metrics::scrape() const {
+  // the readers are not called under mutex_, readers_mutex_ keeps them
+  // registered until the scrape is done
+  std::lock_guard<std::mutex> readers_locker(readers_mutex_);
+  std::vector<Family> families;
+  {
+    std::lock_guard<std::mutex> locker(mutex_);
+    families = families_;
+  }
+
+  std::string out;
+  for (const auto &family : families) {
+    if (family.series.empty() && family.readers.empty())
+      continue;
+    out += "# HELP " + family.name + " " + family.help + "\n";
+    out += "# TYPE " + family.name + " " + family.type + "\n";
+    if (!family.readers.empty()) {
+      double value = 0;
+      for (const auto &reader : family.readers)
+        value += reader.value();
+      appendValue(out, family.name, value);
+    }
+    for (const auto &series : family.series) {
+      std::lock_guard<std::mutex> locker(mutex_);
+      if (family.type[0] != 'h') {
+        appendValue(out, seriesName(family.name, series.labels),
+                    (double)sum(series.slot));
+        continue;
+      }
+      int64_t cumulative = 0;
+      for (size_t i = 0; i < kBucketCount; ++i) {
+        cumulative += sum(series.slot + i);
+        char le[32];
+        if (i < kBucketCount - 1)
+          ::snprintf(le, sizeof(le), "le=\"%g\"", kBuckets[i] / 1e6);
+        else
+          ::snprintf(le, sizeof(le), "le=\"+Inf\"");
+        appendValue(out, seriesName(family.name + "_bucket", series.labels, le),
+                    (double)cumulative);
+      }
+      appendValue(out, seriesName(family.name + "_sum", series.labels),
+                  sum(series.slot + kBucketCount) / 1e6);
+      appendValue(out, seriesName(family.name + "_count", series.labels),
+                  (double)sum(series.slot + kBucketCount + 1));
+    }
+  }
+  return out;
+}
@@ -138,6 +138,36 @@ public:
   }
 };
 
+// Counts the values of an application/json upload while it arrives
+class JsonStreamService : public HttpService {
+public:
+  struct Counter : public libjson::JsonSaxHandler {
+    void onString(std::string_view) override { values++; }
+    void onNumber(double, bool) override { values++; }
+    void onBoolean(bool) override { values++; }
+    void onNull() override { values++; }
+    void onEndObject() override { values++; }
+    void onEndArray() override { values++; }
+
+    size_t values = 0;
+  };
+
+  std::unique_ptr<libjson::JsonSaxHandler>
+  doJsonStream(const HttpRequest &req) override {
+    return std::make_unique<Counter>();
+  }
+
+  void doPost(const HttpRequest &req, HttpResponse &resp) override {
+    auto counter = static_cast<Counter *>(req.getJsonHandler());
+    if (!counter) {
+      resp.setCode(HttpStatus::BAD_REQUEST);
+      return;
+    }
+    resp.setContentType("text/plain")
+        .setBody(std::to_string(counter->values) + " values\n");
+  }
+};
+
 HttpServer server;
 
 void handlerSignal(int) { server.quit(); }
@@ -151,6 +181,7 @@ int main() {
   server.addService<GetHeaderService>("/json");
   server.addService<LoginTestService>("/login");
   server.addService<PostTestService>("/post");
+  server.addService<JsonStreamService>("/json-stream");
 
   // server.addUrlPatternService<PostTestService>("/regex/(.*?)$");
 
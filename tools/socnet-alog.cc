@@ -0,0 +1,179 @@
+// Decode access log segments written by HttpAccessLog
+//
+//   socnet-alog [-j] <segment>...
+//
+// Records of all segments are sorted by arrival time and printed one per
+// line, as text or with -j as JSON objects
+#include "../soc/http/include/HttpAccessLog.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace soc::http;
+
+namespace {
+struct Segment {
+  const HttpAccessRecord *records = nullptr;
+  size_t count = 0;
+};
+
+bool openSegment(const char *path, Segment &segment) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", path, ::strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) < 0 ||
+      (size_t)st.st_size < sizeof(HttpAccessSegmentHeader)) {
+    fprintf(stderr, "%s: not an access log segment\n", path);
+    ::close(fd);
+    return false;
+  }
+  void *p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "%s: %s\n", path, ::strerror(errno));
+    return false;
+  }
+
+  const auto *header = (const HttpAccessSegmentHeader *)p;
+  if (::memcmp(header->magic, HttpAccessSegmentHeader::kMagic,
+               sizeof(header->magic)) != 0 ||
+      header->version != HttpAccessSegmentHeader::kVersion ||
+      header->record_size != sizeof(HttpAccessRecord)) {
+    fprintf(stderr, "%s: not an access log segment\n", path);
+    ::munmap(p, st.st_size);
+    return false;
+  }
+  segment.records =
+      (const HttpAccessRecord *)((const char *)p +
+                                 sizeof(HttpAccessSegmentHeader));
+  size_t n = (st.st_size - sizeof(HttpAccessSegmentHeader)) /
+             sizeof(HttpAccessRecord);
+  // a segment of a running or crashed server ends with unused records
+  while (segment.count < n && segment.records[segment.count].time != 0)
+    ++segment.count;
+  return true;
+}
+
+const char *methodName(uint8_t method) {
+  // HttpMethod
+  switch (method) {
+  case 0x01:
+    return "GET";
+  case 0x02:
+    return "POST";
+  case 0x03:
+    return "HEAD";
+  default:
+    return "-";
+  }
+}
+
+const char *versionName(uint8_t version) {
+  // HttpVersion
+  switch (version) {
+  case 0x10:
+    return "HTTP/1.0";
+  case 0x11:
+    return "HTTP/1.1";
+  case 0x20:
+    return "HTTP/2.0";
+  default:
+    return "-";
+  }
+}
+
+std::string jsonEscape(std::string_view s) {
+  std::string out;
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (c < 0x20) {
+      char buf[8];
+      ::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
+
+void print(const HttpAccessRecord &r, bool json) {
+  char addr[INET_ADDRSTRLEN];
+  in_addr in;
+  in.s_addr = r.addr;
+  ::inet_ntop(AF_INET, &in, addr, sizeof(addr));
+
+  std::string path(r.path, ::strnlen(r.path, HttpAccessRecord::kPathSize));
+  // cut to the size of the record
+  if (r.path_len > path.size())
+    path += "...";
+
+  char times[32];
+  time_t t = r.time / 1000000;
+  struct tm tm;
+  ::strftime(times, sizeof(times), "%Y-%m-%d %H:%M:%S", ::localtime_r(&t, &tm));
+
+  if (json) {
+    printf("{\"time\":\"%s.%06u\",\"peer\":\"%s:%u\",\"method\":\"%s\","
+           "\"path\":\"%s\",\"version\":\"%s\",\"status\":%u,\"bytes\":%llu,"
+           "\"latency_us\":%u,\"upstream_us\":%u}\n",
+           times, (unsigned)(r.time % 1000000), addr, r.port,
+           methodName(r.method), jsonEscape(path).c_str(),
+           versionName(r.version), r.status, (unsigned long long)r.bytes,
+           r.latency, r.upstream);
+  } else {
+    printf("[%s.%06u] %s:%u \"%s %s %s\" %u %llu %.3fms %.3fms\n", times,
+           (unsigned)(r.time % 1000000), addr, r.port, methodName(r.method),
+           path.c_str(), versionName(r.version), r.status,
+           (unsigned long long)r.bytes, r.latency / 1000.0,
+           r.upstream / 1000.0);
+  }
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  bool json = false;
+  std::vector<Segment> segments;
+  for (int i = 1; i < argc; ++i) {
+    if (::strcmp(argv[i], "-j") == 0) {
+      json = true;
+      continue;
+    }
+    Segment segment;
+    if (openSegment(argv[i], segment))
+      segments.push_back(segment);
+  }
+  if (segments.empty()) {
+    fprintf(stderr, "usage: %s [-j] <segment>...\n", argv[0]);
+    return 1;
+  }
+
+  // records are written when a request finishes but stamped with its
+  // arrival, so a slow request follows faster ones that arrived after it
+  std::vector<const HttpAccessRecord *> records;
+  for (const auto &segment : segments) {
+    for (size_t i = 0; i < segment.count; ++i)
+      records.push_back(segment.records + i);
+  }
+  std::stable_sort(records.begin(), records.end(),
+                   [](const HttpAccessRecord *a, const HttpAccessRecord *b) {
+                     return a->time < b->time;
+                   });
+  for (const auto *record : records)
+    print(*record, json);
+  return 0;
+}